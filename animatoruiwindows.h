@@ -9,8 +9,8 @@
 #include <FL/Fl_Tabs.H>
 #include <FL/Fl_Scroll.H>
 #include <FL/Fl_Pack.H>
-#include "FL/Fl_Box.h"
-#include "FL/Fl_Value_Slider.h"
+#include "FL/Fl_Box.H"
+#include "FL/Fl_Value_Slider.H"
 #include <FL/Fl_Group.H>
 #include <FL/Fl_Box.H>
 #include "rulerwindow.h"
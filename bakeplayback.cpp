@@ -0,0 +1,181 @@
+#pragma warning(disable : 4786)
+
+#include <math.h>
+#include <string.h>
+
+#include "bakeplayback.h"
+#include "bakestore.h"
+
+static const char* s_interpolationNames[BakePlayback::NUM_INTERPOLATIONS] = {
+	"nearest", "linear", "hermite"
+};
+
+BakePlayback::BakePlayback(BakeStore& s)
+	: store(s), revision(s.revision()), clock(0)
+{
+	for (int i = 0; i < SLOTS; i++) {
+		slotValid[i] = false;
+		slotFrame[i] = 0;
+		slotUsed[i] = 0;
+	}
+}
+
+const char* BakePlayback::name(Interpolation mode)
+{
+	return (mode >= 0 && mode < NUM_INTERPOLATIONS) ? s_interpolationNames[mode] : "";
+}
+
+BakePlayback::Interpolation BakePlayback::byName(const char* szName)
+{
+	for (int i = 0; i < NUM_INTERPOLATIONS; i++) {
+		if (strcmp(szName, s_interpolationNames[i]) == 0)
+			return (Interpolation)i;
+	}
+	return NUM_INTERPOLATIONS;
+}
+
+const ParticleState* BakePlayback::frame(int f)
+{
+	// anything decoded before the store changed may be stale
+	if (store.revision() != revision) {
+		for (int i = 0; i < SLOTS; i++)
+			slotValid[i] = false;
+		revision = store.revision();
+	}
+
+	clock++;
+	for (int i = 0; i < SLOTS; i++) {
+		if (slotValid[i] && slotFrame[i] == f) {
+			slotUsed[i] = clock;
+			return &slot[i];
+		}
+	}
+
+	// an empty slot, else the least recently used
+	int victim = 0;
+	for (int i = 0; i < SLOTS; i++) {
+		if (!slotValid[i]) {
+			victim = i;
+			break;
+		}
+		if (slotUsed[i] < slotUsed[victim])
+			victim = i;
+	}
+	slotValid[victim] = false;
+	if (!store.decode(f, slot[victim]))
+		return NULL;
+	slotValid[victim] = true;
+	slotFrame[victim] = f;
+	slotUsed[victim] = clock;
+	return &slot[victim];
+}
+
+const ParticleState* BakePlayback::nearest(int f)
+{
+	// the frame itself, else a neighbour
+	const int order[3] = { f, f + 1, f - 1 };
+	for (int i = 0; i < 3; i++) {
+		if (store.has(order[i]))
+			return frame(order[i]);
+	}
+	return NULL;
+}
+
+const ParticleState* BakePlayback::at(float u, Interpolation mode)
+{
+	int f = (int)floorf(u + 0.5f);
+	if (mode == NEAREST || fabsf(u - f) < 1e-3f)
+		return nearest(f);
+
+	// the baked frames on either side of u, no more than two apart
+	int f0 = (int)floorf(u);
+	int a, b;
+	if (!store.frameBefore(f0, a) || !store.frameAfter(f0 + 1, b) || b - a > 2)
+		return nearest(f);
+	if (!interpolate((u - a) / (b - a), a, b, mode))
+		return nearest(f);
+	return &blended;
+}
+
+bool BakePlayback::interpolate(float s, int fa, int fb, Interpolation mode)
+{
+	const ParticleState* p0 = frame(fa);
+	const ParticleState* p1 = frame(fb);
+	if (p0 == NULL || p1 == NULL)
+		return false;
+
+	// Hermite tangents from the neighbouring frames, if there are any
+	const ParticleState* pm = NULL;
+	const ParticleState* pn = NULL;
+	int fm = fa, fn = fb;
+	if (mode == HERMITE) {
+		if (store.frameBefore(fa - 1, fm) && fa - fm <= 2)
+			pm = frame(fm);
+		if (store.frameAfter(fb + 1, fn) && fn - fb <= 2)
+			pn = frame(fn);
+	}
+	// tangents are scaled to the fa .. fb interval
+	float sm = (float)(fb - fa) / (fb - fm);
+	float sn = (float)(fb - fa) / (fn - fa);
+	float s2 = s * s, s3 = s2 * s;
+	float h00 = 2 * s3 - 3 * s2 + 1, h10 = s3 - 2 * s2 + s;
+	float h01 = -2 * s3 + 3 * s2, h11 = s3 - s2;
+
+	int n0 = p0->size(), n1 = p1->size();
+	const float* x0[3] = { p0->px, p0->py, p0->pz };
+	const float* x1[3] = { p1->px, p1->py, p1->pz };
+	const float* xm[3] = { pm ? pm->px : NULL, pm ? pm->py : NULL, pm ? pm->pz : NULL };
+	const float* xn[3] = { pn ? pn->px : NULL, pn ? pn->py : NULL, pn ? pn->pz : NULL };
+	blended.resize(n0 + n1);
+	float* out[3] = { blended.px, blended.py, blended.pz };
+
+	// walk both frames in id order
+	int i = 0, j = 0, im = 0, in = 0, n = 0;
+	while (i < n0 || j < n1) {
+		if (j >= n1 || (i < n0 && p0->id[i] < p1->id[j])) {
+			// died before fb
+			if (s < 0.5f) {
+				for (int c = 0; c < 3; c++)
+					out[c][n] = x0[c][i];
+				blended.id[n++] = p0->id[i];
+			}
+			i++;
+			continue;
+		}
+		if (i >= n0 || p1->id[j] < p0->id[i]) {
+			// emitted after fa
+			if (s >= 0.5f) {
+				for (int c = 0; c < 3; c++)
+					out[c][n] = x1[c][j];
+				blended.id[n++] = p1->id[j];
+			}
+			j++;
+			continue;
+		}
+
+		unsigned int id = p0->id[i];
+		if (mode == LINEAR) {
+			for (int c = 0; c < 3; c++)
+				out[c][n] = x0[c][i] + s * (x1[c][j] - x0[c][i]);
+		}
+		else {
+			while (pm && im < pm->size() && pm->id[im] < id)
+				im++;
+			while (pn && in < pn->size() && pn->id[in] < id)
+				in++;
+			bool hasM = pm && im < pm->size() && pm->id[im] == id;
+			bool hasN = pn && in < pn->size() && pn->id[in] == id;
+			for (int c = 0; c < 3; c++) {
+				float d = x1[c][j] - x0[c][i];
+				float m0 = hasM ? (x1[c][j] - xm[c][im]) * sm : d;
+				float m1 = hasN ? (xn[c][in] - x0[c][i]) * sn : d;
+				out[c][n] = h00 * x0[c][i] + h10 * m0 + h01 * x1[c][j] + h11 * m1;
+			}
+		}
+		blended.id[n++] = id;
+		i++;
+		j++;
+	}
+	blended.resize(n);
+	return true;
+}
@@ -0,0 +1,63 @@
+#ifndef BAKEPLAYBACK_H
+#define BAKEPLAYBACK_H
+
+#pragma warning(disable : 4786)
+
+#include "particlestate.h"
+
+class BakeStore;
+
+// BakePlayback turns a BakeStore into particles to draw at any time.
+// Decoded frames are kept in a few slots and handed out as read-only
+// views, so drawing a frame again, or drawing it at a rate above the
+// bake rate, decodes and copies nothing.
+//
+// Between two baked frames the particles can be interpolated: linearly,
+// or with cubic Hermite curves whose tangents come from the frames on
+// either side (the bake has no velocities). Particles are matched by id;
+// one that is only in one of the two frames, having been emitted or
+// died in between, is shown while that frame is the nearer one.
+class BakePlayback {
+public:
+	enum Interpolation {
+		NEAREST = 0,					// nearest baked frame within one frame
+		LINEAR,
+		HERMITE,
+		NUM_INTERPOLATIONS
+	};
+
+	BakePlayback(BakeStore& store);
+
+	// Particles at (fractional) bake frame u, or NULL if there is no
+	// baked frame close enough. Only positions and ids are set. Valid
+	// until the next call.
+	const ParticleState* at(float u, Interpolation mode);
+	// Baked frame f, decoded; NULL if f is not baked
+	const ParticleState* frame(int f);
+
+	static const char* name(Interpolation mode);
+	// NUM_INTERPOLATIONS if szName is none of them
+	static Interpolation byName(const char* szName);
+
+private:
+	BakePlayback(const BakePlayback& other) : store(other.store) {}
+	BakePlayback& operator=(const BakePlayback&) { return *this; }
+
+	const ParticleState* nearest(int f);
+	// blends frames f0 and f1 at s in [0, 1]; false if one won't decode
+	bool interpolate(float s, int f0, int f1, Interpolation mode);
+
+	// enough for the four frames a Hermite segment reads
+	enum { SLOTS = 4 };
+
+	BakeStore& store;
+	unsigned int revision;				// of the store, when slots were filled
+	ParticleState slot[SLOTS];
+	bool slotValid[SLOTS];
+	int slotFrame[SLOTS];
+	unsigned int slotUsed[SLOTS];		// clock at last use, for eviction
+	unsigned int clock;
+	ParticleState blended;
+};
+
+#endif
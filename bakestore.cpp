@@ -0,0 +1,521 @@
+#pragma warning(disable : 4786)
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "bakestore.h"
+
+/******************
+ * Encoding helpers
+ ******************/
+
+static void putVarint(std::vector<unsigned char>& data, unsigned int v)
+{
+	while (v >= 0x80) {
+		data.push_back((unsigned char)(v | 0x80));
+		v >>= 7;
+	}
+	data.push_back((unsigned char)v);
+}
+
+static unsigned int getVarint(const unsigned char*& p)
+{
+	unsigned int v = 0;
+	for (int shift = 0; ; shift += 7) {
+		unsigned char b = *p++;
+		v |= (unsigned int)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return v;
+	}
+}
+
+// small magnitudes of either sign to small unsigned values
+static unsigned int zigzag(int v)
+{
+	return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+static int unzigzag(unsigned int v)
+{
+	return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+// ids ascend, so they are stored as differences; unsigned arithmetic
+// wraps, so any order still round trips
+static void putIds(std::vector<unsigned char>& data, const unsigned int* id, int n)
+{
+	unsigned int last = 0;
+	for (int i = 0; i < n; i++) {
+		putVarint(data, id[i] - last);
+		last = id[i];
+	}
+}
+
+static void getIds(const unsigned char*& p, unsigned int* id, int n)
+{
+	unsigned int last = 0;
+	for (int i = 0; i < n; i++)
+		id[i] = last += getVarint(p);
+}
+
+static void bounds(const float* x, int n, float& origin, float& step)
+{
+	float lo = n > 0 ? x[0] : 0, hi = lo;
+	for (int i = 1; i < n; i++) {
+		if (x[i] < lo) lo = x[i];
+		if (x[i] > hi) hi = x[i];
+	}
+	origin = lo;
+	step = (hi - lo) / 65535.0f;
+	if (step <= 0)
+		step = 1.0f;
+}
+
+static void putQuantized(std::vector<unsigned char>& data, const float* x, int begin, int end,
+	float origin, float step)
+{
+	for (int i = begin; i < end; i++) {
+		float q = floorf((x[i] - origin) / step + 0.5f);
+		unsigned int v = q <= 0 ? 0 : (q >= 65535 ? 65535 : (unsigned int)q);
+		data.push_back((unsigned char)v);
+		data.push_back((unsigned char)(v >> 8));
+	}
+}
+
+static void getQuantized(const unsigned char*& p, float* x, int begin, int end,
+	float origin, float step)
+{
+	for (int i = begin; i < end; i++, p += 2)
+		x[i] = origin + (float)(p[0] | (p[1] << 8)) * step;
+}
+
+/******************
+ * BakeStore
+ ******************/
+
+BakeStore::BakeStore(int n)
+	: total(0), changes(0), cached(0), cacheValid(false)
+{
+	keyInterval(n);
+}
+
+void BakeStore::add(int f, const ParticleState& s)
+{
+	forget(f);
+	changes++;
+
+	Frame& frame = frames[f];
+	encodeKey(s, frame);
+	frame.key = f;
+
+	// frames between keyframes go against the keyframe before them
+	int k = f - ((f % interval) + interval) % interval;
+	if (k != f && cacheKey(k)) {
+		Frame delta;
+		if (encodeDelta(s, cache, delta) && delta.data.size() < frame.data.size()) {
+			delta.key = k;
+			std::swap(frame, delta);
+		}
+	}
+	total += resident(frame);
+}
+
+void BakeStore::forget(int f)
+{
+	std::map<int, Frame>::iterator it = frames.find(f);
+	if (it == frames.end())
+		return;
+	changes++;
+	bool key = it->second.key == f;
+	total -= resident(it->second);
+	frames.erase(it);
+	if (!key)
+		return;
+
+	// the frames stored against it are lost with it
+	if (cacheValid && cached == f)
+		cacheValid = false;
+	for (int g = f + 1; g < f + interval; g++) {
+		it = frames.find(g);
+		if (it != frames.end() && it->second.key == f) {
+			total -= resident(it->second);
+			frames.erase(it);
+		}
+	}
+}
+
+bool BakeStore::decode(int f, ParticleState& out)
+{
+	std::map<int, Frame>::const_iterator it = frames.find(f);
+	if (it == frames.end())
+		return false;
+	const Frame& frame = it->second;
+	if (frame.key == f) {
+		decodeKey(frame, out);
+		return true;
+	}
+	if (!cacheKey(frame.key))
+		return false;
+	decodeDelta(frame, cache, out);
+	return true;
+}
+
+bool BakeStore::cacheKey(int f)
+{
+	if (cacheValid && cached == f)
+		return true;
+	std::map<int, Frame>::const_iterator it = frames.find(f);
+	if (it == frames.end() || it->second.key != f)
+		return false;
+	decodeKey(it->second, cache);
+	cached = f;
+	cacheValid = true;
+	return true;
+}
+
+void BakeStore::clear()
+{
+	frames.clear();
+	total = 0;
+	changes++;
+	cacheValid = false;
+	mapping.close();
+	mappedName.clear();
+}
+
+void BakeStore::removeAfter(int f)
+{
+	// from the last, so keyframes go after the frames stored against them
+	while (!frames.empty() && frames.rbegin()->first > f)
+		forget(frames.rbegin()->first);
+}
+
+void BakeStore::swap(BakeStore& other)
+{
+	std::swap(interval, other.interval);
+	frames.swap(other.frames);
+	std::swap(total, other.total);
+	mapping.swap(other.mapping);
+	mappedName.swap(other.mappedName);
+	changes++;
+	other.changes++;
+	cacheValid = other.cacheValid = false;
+}
+
+bool BakeStore::frameBefore(int f, int& g) const
+{
+	std::map<int, Frame>::const_iterator it = frames.upper_bound(f);
+	if (it == frames.begin())
+		return false;
+	g = (--it)->first;
+	return true;
+}
+
+bool BakeStore::frameAfter(int f, int& g) const
+{
+	std::map<int, Frame>::const_iterator it = frames.lower_bound(f);
+	if (it == frames.end())
+		return false;
+	g = it->first;
+	return true;
+}
+
+const unsigned char* BakeStore::bytes(const Frame& frame)
+{
+	if (frame.mapped)
+		return frame.mapped;
+	return frame.data.empty() ? NULL : &frame.data[0];
+}
+
+size_t BakeStore::size(const Frame& frame)
+{
+	return frame.mapped ? frame.mappedSize : frame.data.size();
+}
+
+size_t BakeStore::resident(const Frame& frame)
+{
+	return sizeof(Frame) + frame.data.size();
+}
+
+std::vector<int> BakeStore::frameIndices() const
+{
+	std::vector<int> indices;
+	indices.reserve(frames.size());
+	std::map<int, Frame>::const_iterator it;
+	for (it = frames.begin(); it != frames.end(); it++)
+		indices.push_back(it->first);
+	return indices;
+}
+
+/** Keyframe data:
+  *   ids, then x, y and z of every particle as 16 bit offsets from origin
+  */
+void BakeStore::encodeKey(const ParticleState& s, Frame& frame) const
+{
+	int n = s.size();
+	const float* x[3] = { s.px, s.py, s.pz };
+	frame.count = n;
+	frame.data.clear();
+	frame.data.reserve(n * 7);
+	putIds(frame.data, s.id, n);
+	for (int c = 0; c < 3; c++) {
+		bounds(x[c], n, frame.origin[c], frame.step[c]);
+		putQuantized(frame.data, x[c], 0, n, frame.origin[c], frame.step[c]);
+	}
+}
+
+void BakeStore::decodeKey(const Frame& frame, ParticleState& out) const
+{
+	int n = frame.count;
+	out.resize(n);
+	if (n == 0)
+		return;
+	float* x[3] = { out.px, out.py, out.pz };
+	const unsigned char* p = bytes(frame);
+	getIds(p, out.id, n);
+	for (int c = 0; c < 3; c++)
+		getQuantized(p, x[c], 0, n, frame.origin[c], frame.step[c]);
+}
+
+/** Delta frame data:
+  *   a bit per keyframe particle, set if it survives into this frame
+  *   number of particles emitted since the keyframe, and their ids
+  *   x, y, z offsets of the survivors from the keyframe, in steps
+  *   x, y, z of the emitted particles as in a keyframe
+  * Survivors come first in the frame, in keyframe order.
+  */
+bool BakeStore::encodeDelta(const ParticleState& s, const ParticleState& key, Frame& frame) const
+{
+	int n = s.size(), nk = key.size();
+	const float* x[3] = { s.px, s.py, s.pz };
+	const float* kx[3] = { key.px, key.py, key.pz };
+
+	// match leading particles to the keyframe by id
+	std::vector<int> match;
+	match.reserve(n);
+	frame.data.assign((nk + 7) / 8, 0);
+	int i = 0, j = 0;
+	while (i < n && j < nk) {
+		if (key.id[j] == s.id[i]) {
+			frame.data[j >> 3] |= 1 << (j & 7);
+			match.push_back(j);
+			i++;
+			j++;
+		}
+		else if (key.id[j] < s.id[i])
+			j++;
+		else
+			break;
+	}
+	int survivors = i;
+	// everything after them must be newer than the keyframe
+	for (; i < n; i++) {
+		if (nk > 0 && s.id[i] <= key.id[nk - 1])
+			return false;
+	}
+
+	frame.count = n;
+	putVarint(frame.data, n - survivors);
+	putIds(frame.data, s.id + survivors, n - survivors);
+	for (int c = 0; c < 3; c++) {
+		bounds(x[c], n, frame.origin[c], frame.step[c]);
+		for (int m = 0; m < survivors; m++) {
+			float d = floorf((x[c][m] - kx[c][match[m]]) / frame.step[c] + 0.5f);
+			if (fabsf(d) > 1e9f)
+				return false;
+			putVarint(frame.data, zigzag((int)d));
+		}
+	}
+	for (int c = 0; c < 3; c++)
+		putQuantized(frame.data, x[c], survivors, n, frame.origin[c], frame.step[c]);
+	return true;
+}
+
+void BakeStore::decodeDelta(const Frame& frame, const ParticleState& key, ParticleState& out) const
+{
+	int n = frame.count, nk = key.size();
+	out.resize(n);
+	float* x[3] = { out.px, out.py, out.pz };
+	const float* kx[3] = { key.px, key.py, key.pz };
+	const unsigned char* mask = bytes(frame);
+	const unsigned char* p = mask + (nk + 7) / 8;
+
+	// survivors start at their keyframe positions
+	int survivors = 0;
+	for (int j = 0; j < nk; j++) {
+		if (!(mask[j >> 3] & (1 << (j & 7))))
+			continue;
+		for (int c = 0; c < 3; c++)
+			x[c][survivors] = kx[c][j];
+		out.id[survivors++] = key.id[j];
+	}
+
+	int emitted = getVarint(p);
+	getIds(p, out.id + survivors, emitted);
+	for (int c = 0; c < 3; c++) {
+		for (int m = 0; m < survivors; m++)
+			x[c][m] += (float)unzigzag(getVarint(p)) * frame.step[c];
+	}
+	for (int c = 0; c < 3; c++)
+		getQuantized(p, x[c], survivors, n, frame.origin[c], frame.step[c]);
+}
+
+/******************
+ * Cache file
+ ******************/
+
+/** Cache file layout (native byte order):
+  *   CacheHeader
+  *   the encoded frames, back to back
+  *   a CacheEntry per frame, at header.index
+  * 64 bit fields come first, so the structs have no padding with any
+  * compiler's alignment rules.
+  */
+struct CacheHeader {
+	unsigned long long key;
+	unsigned long long index;			// file offset of the entries
+	char magic[4];
+	int interval;
+	float fps;
+	int frames;
+};
+
+struct CacheEntry {
+	unsigned long long offset;			// file offset of the encoded frame
+	int frame;
+	int key;
+	int count;
+	unsigned int size;
+	float origin[3];
+	float step[3];
+};
+
+static const char s_cacheMagic[4] = { 'P', 'B', 'K', '1' };
+
+bool BakeStore::attach(const char* szFileName, const std::vector<CacheEntry>& entries)
+{
+	MappedFile file;
+	bool ok = file.open(szFileName) && entries.size() == frames.size();
+	if (ok && !entries.empty())
+		ok = entries.back().offset + entries.back().size <= file.size();
+	if (!ok) {
+		clear();
+		return false;
+	}
+
+	// entries are in frame order, as save() wrote them
+	std::map<int, Frame>::iterator it;
+	std::vector<CacheEntry>::const_iterator entry = entries.begin();
+	for (it = frames.begin(); it != frames.end(); it++, entry++) {
+		Frame& frame = it->second;
+		frame.mapped = file.data() + entry->offset;
+		frame.mappedSize = entry->size;
+		std::vector<unsigned char>().swap(frame.data);
+	}
+	mapping.swap(file);
+	mappedName = szFileName;
+	total = frames.size() * sizeof(Frame);
+	return true;
+}
+
+bool BakeStore::save(const char* szFileName, unsigned long long key, float fps)
+{
+	// write next to it and swap it in once complete, so a failed save
+	// never leaves a truncated cache behind
+	std::string strTemp = std::string(szFileName) + ".tmp";
+	FILE* pf = fopen(strTemp.c_str(), "wb");
+	if (pf == NULL)
+		return false;
+
+	CacheHeader header;
+	memcpy(header.magic, s_cacheMagic, 4);
+	header.interval = interval;
+	header.key = key;
+	header.fps = fps;
+	header.frames = frames.size();
+	header.index = 0;
+	bool ok = fwrite(&header, sizeof(header), 1, pf) == 1;
+
+	std::vector<CacheEntry> entries;
+	entries.reserve(frames.size());
+	unsigned long long offset = sizeof(header);
+	std::map<int, Frame>::const_iterator it;
+	for (it = frames.begin(); it != frames.end() && ok; it++) {
+		const Frame& frame = it->second;
+		CacheEntry entry;
+		entry.frame = it->first;
+		entry.key = frame.key;
+		entry.count = frame.count;
+		entry.size = size(frame);
+		memcpy(entry.origin, frame.origin, sizeof(entry.origin));
+		memcpy(entry.step, frame.step, sizeof(entry.step));
+		entry.offset = offset;
+		entries.push_back(entry);
+		ok = entry.size == 0 || fwrite(bytes(frame), entry.size, 1, pf) == 1;
+		offset += entry.size;
+	}
+
+	header.index = offset;
+	if (ok && !entries.empty())
+		ok = fwrite(&entries[0], sizeof(CacheEntry), entries.size(), pf) == entries.size();
+	ok = ok && fseek(pf, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, pf) == 1;
+	ok = (fclose(pf) == 0) && ok;
+	if (!ok) {
+		remove(strTemp.c_str());
+		return false;
+	}
+
+	// every frame is in the new file now, so read them all from there
+	// rather than keeping copies; the old file is unmapped first, as it
+	// can't be replaced while mapped
+	mapping.close();
+	mappedName.clear();
+	remove(szFileName);
+	if (rename(strTemp.c_str(), szFileName) != 0) {
+		attach(strTemp.c_str(), entries);
+		return false;
+	}
+	return attach(szFileName, entries);
+}
+
+bool BakeStore::open(const char* szFileName, unsigned long long key, float& fps)
+{
+	MappedFile file;
+	if (!file.open(szFileName) || file.size() < sizeof(CacheHeader))
+		return false;
+
+	CacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, s_cacheMagic, 4) != 0 || header.key != key ||
+		header.frames < 0 || header.interval <= 0 || header.index > file.size() ||
+		(file.size() - header.index) / sizeof(CacheEntry) < (size_t)header.frames)
+		return false;
+
+	// only the index is read here
+	std::map<int, Frame> loaded;
+	const unsigned char* index = file.data() + header.index;
+	for (int i = 0; i < header.frames; i++) {
+		CacheEntry entry;
+		memcpy(&entry, index + i * sizeof(CacheEntry), sizeof(entry));
+		if (entry.offset > header.index || entry.size > header.index - entry.offset)
+			return false;
+		Frame& frame = loaded[entry.frame];
+		frame.key = entry.key;
+		frame.count = entry.count;
+		memcpy(frame.origin, entry.origin, sizeof(frame.origin));
+		memcpy(frame.step, entry.step, sizeof(frame.step));
+		frame.mapped = file.data() + entry.offset;
+		frame.mappedSize = entry.size;
+	}
+
+	clear();
+	frames.swap(loaded);
+	mapping.swap(file);
+	mappedName = szFileName;
+	interval = header.interval;
+	total = frames.size() * sizeof(Frame);
+	fps = header.fps;
+	return true;
+}
@@ -0,0 +1,118 @@
+#ifndef BAKESTORE_H
+#define BAKESTORE_H
+
+#pragma warning(disable : 4786)
+
+#include <map>
+#include <string>
+#include <vector>
+#include "particlestate.h"
+#include "mappedfile.h"
+
+struct CacheEntry;
+
+// BakeStore holds baked particle frames compressed, keeping only what
+// playback needs: positions and particle ids.
+//
+// Positions are quantized to 16 bits per axis within each frame's
+// bounding box. Every keyInterval()-th frame is a keyframe stored that
+// way; the frames between are stored against their keyframe, matching
+// particles by id: a bit per keyframe particle saying whether it is
+// still alive, the survivors' offsets from their keyframe positions
+// (in the frame's quantization step, as variable length integers), and
+// the particles emitted since, quantized as in a keyframe. A frame whose
+// keyframe is missing, or which would not come out smaller, is stored
+// as a keyframe itself.
+//
+// Any frame decodes from at most two stored frames, so access stays
+// random; the last keyframe decoded is cached for sequential playback.
+//
+// A store can be saved as a cache file: a header with a key (the hash
+// of the simulation settings), the encoded frames one after another,
+// and an index of the frames at the end. Opening a cache maps the file
+// and reads only the header and index; a frame's bytes are paged in
+// when it is first decoded. Frames added afterwards are kept in memory
+// until the next save(), which writes them along with the mapped ones
+// and then maps all of them from the new file.
+class BakeStore {
+public:
+	BakeStore(int interval = 8);
+
+	void keyInterval(int n) { interval = n > 0 ? n : 1; }
+	int keyInterval() const { return interval; }
+
+	// Store s as frame f, replacing any frame f there was
+	void add(int f, const ParticleState& s);
+	bool has(int f) const { return frames.find(f) != frames.end(); }
+	// Positions and ids of frame f into out (other fields are left as
+	// they are); false if f is not stored
+	bool decode(int f, ParticleState& out);
+
+	void clear();
+	// drop every frame after f
+	void removeAfter(int f);
+	void swap(BakeStore& other);
+
+	// Write all frames to szFileName, replacing it, tagged with key and
+	// fps, and read them from there from now on. False on I/O error.
+	bool save(const char* szFileName, unsigned long long key, float fps);
+	// Replace the frames with those of a cache file. False, leaving the
+	// store as it was, if the file can't be read or was saved under a
+	// different key.
+	bool open(const char* szFileName, unsigned long long key, float& fps);
+
+	// the stored frame nearest to f at or before / at or after it
+	bool frameBefore(int f, int& g) const;
+	bool frameAfter(int f, int& g) const;
+	// changes whenever frames are added or removed
+	unsigned int revision() const { return changes; }
+
+	int frameCount() const { return frames.size(); }
+	int firstFrame() const { return frames.empty() ? 0 : frames.begin()->first; }
+	int lastFrame() const { return frames.empty() ? 0 : frames.rbegin()->first; }
+	std::vector<int> frameIndices() const;
+	// memory taken by frames, for budgets; mapped frames are not counted
+	size_t bytes() const { return total; }
+
+private:
+	struct Frame {
+		Frame() : mapped(NULL), mappedSize(0) {}
+		int key;						// frame stored against; own index for keyframes
+		int count;
+		float origin[3];				// bounding box minimum
+		float step[3];					// quantization step
+		std::vector<unsigned char> data;	// the encoded frame, unless
+		const unsigned char* mapped;		// it is in the cache file, here
+		size_t mappedSize;
+	};
+
+	static const unsigned char* bytes(const Frame& frame);
+	static size_t size(const Frame& frame);
+	static size_t resident(const Frame& frame);
+	// map szFileName, just written by save() with entries, and read
+	// every frame from it; empties the store if it can't be mapped
+	bool attach(const char* szFileName, const std::vector<CacheEntry>& entries);
+
+	void encodeKey(const ParticleState& s, Frame& frame) const;
+	// false if s can't be stored against key
+	bool encodeDelta(const ParticleState& s, const ParticleState& key, Frame& frame) const;
+	void decodeKey(const Frame& frame, ParticleState& out) const;
+	void decodeDelta(const Frame& frame, const ParticleState& key, ParticleState& out) const;
+	// decodes keyframe f into the cache
+	bool cacheKey(int f);
+	void forget(int f);
+
+	int interval;
+	std::map<int, Frame> frames;
+	size_t total;
+	MappedFile mapping;
+	std::string mappedName;
+	unsigned int changes;
+
+	// the last keyframe decoded
+	int cached;
+	bool cacheValid;
+	ParticleState cache;
+};
+
+#endif
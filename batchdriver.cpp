@@ -0,0 +1,695 @@
+#pragma warning(disable : 4786)
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "batchdriver.h"
+#include "modelerapp.h"
+#include "graphwidget.h"
+#include "curve.h"
+#include "camera.h"
+#include "particleSystem.h"
+#include "perftimer.h"
+#include "particleoptions.h"
+
+#include "linearcurveevaluator.h"
+#include "beziercurveevaluator.h"
+#include "bsplinecurveevaluator.h"
+#include "catmullromcurveevaluator.h"
+
+#ifdef WIN32
+typedef HANDLE process_t;
+#else
+typedef pid_t process_t;
+#endif
+
+// Start szExecutable with the given arguments
+static bool startProcess(const std::string& strExecutable,
+						 const std::vector<std::string>& strvArgs, process_t& process)
+{
+#ifdef WIN32
+	std::string strCommandLine = "\"" + strExecutable + "\"";
+	for (int i = 0; i < strvArgs.size(); ++i)
+		strCommandLine += " \"" + strvArgs[i] + "\"";
+
+	STARTUPINFOA si;
+	PROCESS_INFORMATION pi;
+	ZeroMemory(&si, sizeof(si));
+	si.cb = sizeof(si);
+	std::vector<char> cvCommandLine(strCommandLine.begin(), strCommandLine.end());
+	cvCommandLine.push_back('\0');
+	if (!CreateProcessA(NULL, &cvCommandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+		return false;
+	CloseHandle(pi.hThread);
+	process = pi.hProcess;
+	return true;
+#else
+	std::vector<char*> pszvArgv;
+	pszvArgv.push_back(const_cast<char*>(strExecutable.c_str()));
+	for (int i = 0; i < strvArgs.size(); ++i)
+		pszvArgv.push_back(const_cast<char*>(strvArgs[i].c_str()));
+	pszvArgv.push_back(NULL);
+
+	process = fork();
+	if (process < 0)
+		return false;
+	if (process == 0) {
+		execvp(pszvArgv[0], &pszvArgv[0]);
+		_exit(127);
+	}
+	return true;
+#endif
+}
+
+// Wait for the process to exit; true if it exited with status 0
+static bool waitProcess(process_t process)
+{
+#ifdef WIN32
+	DWORD dwExitCode = 1;
+	WaitForSingleObject(process, INFINITE);
+	GetExitCodeProcess(process, &dwExitCode);
+	CloseHandle(process);
+	return dwExitCode == 0;
+#else
+	int iStatus = 0;
+	if (waitpid(process, &iStatus, 0) < 0)
+		return false;
+	return WIFEXITED(iStatus) && WEXITSTATUS(iStatus) == 0;
+#endif
+}
+
+static std::string toString(double d)
+{
+	char sz[64];
+	sprintf(sz, "%.9g", d);
+	return sz;
+}
+
+// szName in the system's directory for temporary files
+static std::string tempFileName(const char* szName)
+{
+#ifdef WIN32
+	char szDir[MAX_PATH + 1];
+	DWORD dwLength = GetTempPathA(sizeof(szDir), szDir);
+	std::string strDir = (dwLength > 0 && dwLength < sizeof(szDir)) ? szDir : ".\\";
+#else
+	const char* szTmp = getenv("TMPDIR");
+	std::string strDir = std::string(szTmp && *szTmp ? szTmp : "/tmp") + "/";
+#endif
+	return strDir + szName;
+}
+
+// iCount particles spread over a 10 unit cube, always the same ones
+static void syntheticCloud(ParticleState& ps, int iCount)
+{
+	ps.resize(iCount);
+	unsigned int uiSeed = 1;
+	for (int i = 0; i < iCount; ++i) {
+		float fvRandom[6];
+		for (int j = 0; j < 6; ++j) {
+			uiSeed = uiSeed * 1664525u + 1013904223u;
+			fvRandom[j] = (float)(uiSeed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+		}
+		ps.setPosition(i, 5.0f * Vec3f(fvRandom[0], fvRandom[1], fvRandom[2]));
+		ps.setVelocity(i, Vec3f(fvRandom[3], fvRandom[4], fvRandom[5]));
+		ps.mass[i] = 3.0f;
+		ps.age[i] = 0.0f;
+		ps.lifetime[i] = 0.0f;
+	}
+}
+
+BatchDriver::BatchDriver(const ModelerControl controls[], unsigned numControls,
+						 ParticleSystem* pps, ParticleEmitter_f pfEmitter) :
+m_pps(pps),
+m_pfEmitter(pfEmitter),
+m_fEndTime(20.0f)
+{
+	// same evaluators, in the same order, as GraphWidget
+	m_ppceCurveEvaluators = new CurveEvaluator*[CURVE_TYPE_COUNT];
+	m_ppceCurveEvaluators[CURVE_TYPE_LINEAR] = new LinearCurveEvaluator();
+	m_ppceCurveEvaluators[CURVE_TYPE_BSPLINE] = new BSplineCurveEvaluator();
+	m_ppceCurveEvaluators[CURVE_TYPE_BEZIER] = new BezierCurveEvaluator();
+	m_ppceCurveEvaluators[CURVE_TYPE_CATMULLROM] = new CatmullRomCurveEvaluator();
+	m_ppceCurveEvaluators[CURVE_TYPE_C2INTERPOLATING] = new LinearCurveEvaluator();
+
+	// a control without a curve in the script keeps its default value
+	for (unsigned i = 0; i < numControls; ++i) {
+		Curve* pcrv = new Curve(m_fEndTime, controls[i].m_value);
+		pcrv->setEvaluator(m_ppceCurveEvaluators[CURVE_TYPE_LINEAR]);
+		m_pcrvvCurves.push_back(pcrv);
+		m_ivCurveTypes.push_back(CURVE_TYPE_LINEAR);
+	}
+	m_ullScriptHash = scriptHash(m_fEndTime, m_pcrvvCurves, m_ivCurveTypes);
+
+	m_pcamCamera = new Camera();
+}
+
+BatchDriver::~BatchDriver()
+{
+	for (int i = 0; i < m_pcrvvCurves.size(); ++i) {
+		delete m_pcrvvCurves[i];
+	}
+	for (int i = 0; i < CURVE_TYPE_COUNT; ++i) {
+		delete m_ppceCurveEvaluators[i];
+	}
+	delete[] m_ppceCurveEvaluators;
+	delete m_pcamCamera;
+}
+
+bool BatchDriver::requested(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "--benchmark") == 0)
+			return true;
+	}
+	return false;
+}
+
+int BatchDriver::run(int argc, char** argv)
+{
+	const char* szScript = NULL;
+	const char* szPoseFile = NULL;
+	const char* szBakeFile = NULL;
+	const char* szCacheFile = NULL;
+	const char* szMovieFile = NULL;
+	float fStart = 0.0f;
+	float fEnd = -1.0f;
+	int iFps = m_pps ? (int)m_pps->getBakeFps() : 30;
+	int iWorkers = std::thread::hardware_concurrency();
+	int iWidth = 0, iHeight = 0;
+
+#ifdef WIN32
+	char szExecutable[MAX_PATH];
+	GetModuleFileNameA(NULL, szExecutable, MAX_PATH);
+	m_strExecutable = szExecutable;
+#else
+	m_strExecutable = argv[0];
+#endif
+
+	// an option given without its value, or one not known, leaves the
+	// usage printed
+	bool bUsage = false;
+	int iBenchmark = -1;
+	ParticleOptions options;
+	for (int i = 1; i < argc && !bUsage; ++i) {
+		int iTaken = options.parse(argc, argv, i, m_pps);
+		if (iTaken < 0)
+			bUsage = true;
+		else if (iTaken > 0)
+			i += iTaken - 1;
+		else if (strcmp(argv[i], "--benchmark") == 0) {
+			// the particle count is optional
+			iBenchmark = 0;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				iBenchmark = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--size") == 0) {
+			if (i + 2 >= argc)
+				bUsage = true;
+			else {
+				iWidth = atoi(argv[i + 1]);
+				iHeight = atoi(argv[i + 2]);
+			}
+			i += 2;
+		}
+		else if (strcmp(argv[i], "--export") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				szMovieFile = argv[i + 1];
+			++i;
+		}
+		else if (strcmp(argv[i], "--workers") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				iWorkers = atoi(argv[i + 1]);
+			++i;
+		}
+		else if (strcmp(argv[i], "--batch") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				szScript = argv[i + 1];
+			++i;
+		}
+		else if (strcmp(argv[i], "--start") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				fStart = (float)atof(argv[i + 1]);
+			++i;
+		}
+		else if (strcmp(argv[i], "--end") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				fEnd = (float)atof(argv[i + 1]);
+			++i;
+		}
+		else if (strcmp(argv[i], "--fps") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				iFps = atoi(argv[i + 1]);
+			++i;
+		}
+		else if (strcmp(argv[i], "--poses") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				szPoseFile = argv[i + 1];
+			++i;
+		}
+		else if (strcmp(argv[i], "--bake") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				szBakeFile = argv[i + 1];
+			++i;
+		}
+		else if (strcmp(argv[i], "--cache") == 0) {
+			if (i + 1 >= argc)
+				bUsage = true;
+			else
+				szCacheFile = argv[i + 1];
+			++i;
+		}
+		else {
+			fprintf(stderr, "ERROR: unknown option %s\n", argv[i]);
+			bUsage = true;
+		}
+	}
+
+	if (!bUsage && iBenchmark >= 0) {
+		benchmarkIntegrators(iBenchmark > 0 ? iBenchmark : 1000000, 10);
+		return 0;
+	}
+	if (bUsage || szScript == NULL || iFps <= 0) {
+		fprintf(stderr, "usage: %s --batch <script.ani> [--start <t>] [--end <t>] "
+			"[--fps <n>] [--poses <file>] [--bake <file>] [--cache <file>] "
+			"[--export <movie.bmp> [--workers <n>] [--size <w> <h>]] %s\n"
+			"       %s --benchmark [<particles>] %s\n",
+			argv[0], ParticleOptions::usage(), argv[0], ParticleOptions::usage());
+		return 1;
+	}
+
+	options.apply(m_pps);
+
+	if (!loadScript(szScript)) {
+		fprintf(stderr, "ERROR: can't load animation script %s\n", szScript);
+		return 1;
+	}
+
+	std::string strPoseFile = szPoseFile ? szPoseFile : std::string(szScript) + ".poses";
+	std::string strBakeFile = szBakeFile ? szBakeFile : std::string(szScript) + ".bake";
+	if (fEnd < 0.0f)
+		fEnd = endTime();
+
+	if (m_pps)
+		m_pps->getIntegrator().resetStepCounts();
+	if (!bake(fStart, fEnd, iFps, strPoseFile.c_str(), strBakeFile.c_str(), szCacheFile))
+		return 1;
+	if (m_pps && m_pps->getIntegrator().scheme() == Integrator::DOPRI5) {
+		const Integrator& integrator = m_pps->getIntegrator();
+		printf("dopri5: %d substeps accepted, %d rejected\n",
+			integrator.acceptedSteps(), integrator.rejectedSteps());
+	}
+
+	if (szMovieFile) {
+		// same frame grid as bake()
+		int iFirst = (int)floor(fStart * iFps + 0.5f);
+		int iLast = (int)floor(fEnd * iFps + 0.5f);
+		if (!exportMovie(szScript, strBakeFile.c_str(), szMovieFile, (float)iFirst / iFps,
+			iLast - iFirst + 1, iFps, iWorkers, iWidth, iHeight))
+			return 1;
+	}
+	return 0;
+}
+
+bool BatchDriver::loadScript(const char* szFileName)
+{
+	// same format as GraphWidget::loadScript()
+	std::ifstream ifsFile;
+
+	ifsFile.open(szFileName, std::ios::in);
+	if (ifsFile.fail())
+		return false;
+
+	int iCurveCount;
+	float fEndTime;
+
+	ifsFile >> fEndTime;
+	if (fEndTime <= 0.0f)
+		return false;
+	m_fEndTime = fEndTime;
+	for (int i = 0; i < m_pcrvvCurves.size(); ++i) {
+		m_pcrvvCurves[i]->maxX(m_fEndTime);
+	}
+
+	ifsFile >> iCurveCount;
+	if (iCurveCount != m_pcrvvCurves.size())
+		return false;
+
+	for (int i = 0; i < iCurveCount; ++i) {
+		int iType;
+		ifsFile >> iType;
+		if (iType < 0 || iType >= CURVE_TYPE_COUNT)
+			return false;
+		m_ivCurveTypes[i] = iType;
+		m_pcrvvCurves[i]->setEvaluator(m_ppceCurveEvaluators[iType]);
+		m_pcrvvCurves[i]->fromStream(ifsFile);
+	}
+	// hashed as the UI hashes it, so both share a bake cache
+	m_ullScriptHash = scriptHash(m_fEndTime, m_pcrvvCurves, m_ivCurveTypes);
+
+	// the UI keeps camera keyframes next to the script
+	std::string strCamFile = std::string(szFileName) + ".cam";
+	m_pcamCamera->loadKeyframes(strCamFile.c_str());
+
+	return true;
+}
+
+bool BatchDriver::bake(float fStart, float fEnd, int iFps,
+					   const char* szPoseFile, const char* szBakeFile,
+					   const char* szCacheFile)
+{
+	FILE* pfPoses = NULL;
+	if (szPoseFile) {
+		pfPoses = fopen(szPoseFile, "w");
+		if (pfPoses == NULL) {
+			fprintf(stderr, "ERROR: can't write poses to %s\n", szPoseFile);
+			return false;
+		}
+	}
+
+	int iFirst = (int)floor(fStart * iFps + 0.5f);
+	int iLast = (int)floor(fEnd * iFps + 0.5f);
+	int iCurveCount = m_pcrvvCurves.size();
+
+	// poses: "<frames> <controls>", then one line per frame with the time,
+	// every control value and AZIMUTH .. LOOKAT_Z of the camera
+	if (pfPoses)
+		fprintf(pfPoses, "%d %d\n", iLast - iFirst + 1, iCurveCount);
+
+	// a cached bake of the same script and settings that covers the range
+	// is played back instead of simulating; its frames are numbered from
+	// time 0, so the start frame doesn't need to be part of the key
+	bool bCached = false;
+	if (m_pps) {
+		m_pps->setFps(iFps);
+		if (szCacheFile) {
+			bCached = m_pps->openBakeCache(szCacheFile, m_ullScriptHash) &&
+				m_pps->isBaked(iFirst, iLast);
+			if (bCached)
+				printf("using cached bake %s\n", szCacheFile);
+		}
+		if (!bCached) {
+			m_pps->clearBaked();
+			m_pps->startSimulation((float)iFirst / iFps);
+		}
+	}
+
+	std::vector<float> fvControls(iCurveCount);
+	float fvCamera[NUM_KEY_CURVES];
+	double dStart = perfSeconds();
+
+	for (int iFrame = iFirst; iFrame <= iLast; ++iFrame) {
+		float t = (float)iFrame / iFps;
+
+		for (int i = 0; i < iCurveCount; ++i)
+			fvControls[i] = m_pcrvvCurves[i]->evaluateCurveAt(t);
+
+		if (pfPoses) {
+			if (!m_pcamCamera->evaluateKeyframes(t, fvCamera)) {
+				fvCamera[AZIMUTH] = m_pcamCamera->getAzimuth();
+				fvCamera[ELEVATION] = m_pcamCamera->getElevation();
+				fvCamera[DOLLY] = m_pcamCamera->getDolly();
+				fvCamera[LOOKAT_X] = m_pcamCamera->getLookAt()[0];
+				fvCamera[LOOKAT_Y] = m_pcamCamera->getLookAt()[1];
+				fvCamera[LOOKAT_Z] = m_pcamCamera->getLookAt()[2];
+			}
+			fprintf(pfPoses, "%g", t);
+			for (int i = 0; i < iCurveCount; ++i)
+				fprintf(pfPoses, " %.9g", fvControls[i]);
+			for (int i = 0; i < NUM_KEY_CURVES; ++i)
+				fprintf(pfPoses, " %.9g", fvCamera[i]);
+			fprintf(pfPoses, "\n");
+		}
+
+		if (m_pps && !bCached) {
+			if (m_pfEmitter)
+				m_pfEmitter(&fvControls[0]);
+			m_pps->computeForcesAndUpdateParticles(t);
+		}
+	}
+
+	double dElapsed = perfSeconds() - dStart;
+	// writes the cache, if there is one
+	if (m_pps && !bCached)
+		m_pps->stopSimulation((float)iLast / iFps);
+
+	bool bOk = true;
+	if (pfPoses) {
+		bOk = !ferror(pfPoses);
+		fclose(pfPoses);
+		if (!bOk)
+			fprintf(stderr, "ERROR: can't write poses to %s\n", szPoseFile);
+	}
+	if (m_pps && szBakeFile && !m_pps->saveBakeFile(szBakeFile)) {
+		fprintf(stderr, "ERROR: can't write bake to %s\n", szBakeFile);
+		bOk = false;
+	}
+
+	int iFrames = iLast - iFirst + 1;
+	printf("baked %d frames (%g .. %g s at %d fps) in %.3f s, %.1f frames/s\n",
+		iFrames, (float)iFirst / iFps, (float)iLast / iFps, iFps,
+		dElapsed, dElapsed > 0.0 ? iFrames / dElapsed : 0.0);
+
+	return bOk;
+}
+
+bool BatchDriver::exportMovie(const char* szScript, const char* szBakeFile,
+							  const char* szMovieFileName, float fStart, int iFrameCount, int iFps,
+							  int iWorkers, int iWidth, int iHeight)
+{
+	if (iWorkers < 1)
+		iWorkers = 1;
+	if (iWorkers > iFrameCount)
+		iWorkers = iFrameCount;
+
+	double dStart = perfSeconds();
+
+	// contiguous chunks; every worker reads the bake, so none of them
+	// depends on frames simulated by another
+	std::vector<process_t> pvWorkers;
+	bool bOk = true;
+	for (int i = 0; i < iWorkers; ++i) {
+		int iFirst = (int)((long long)iFrameCount * i / iWorkers);
+		int iLast = (int)((long long)iFrameCount * (i + 1) / iWorkers) - 1;
+
+		std::vector<std::string> strvArgs;
+		strvArgs.push_back("--render-frames");
+		strvArgs.push_back(toString(iFirst));
+		strvArgs.push_back(toString(iLast));
+		strvArgs.push_back("--script");
+		strvArgs.push_back(szScript);
+		strvArgs.push_back("--bake");
+		strvArgs.push_back(szBakeFile);
+		strvArgs.push_back("--movie");
+		strvArgs.push_back(szMovieFileName);
+		strvArgs.push_back("--fps");
+		strvArgs.push_back(toString(iFps));
+		strvArgs.push_back("--start");
+		strvArgs.push_back(toString(fStart));
+		if (iWidth > 0 && iHeight > 0) {
+			strvArgs.push_back("--size");
+			strvArgs.push_back(toString(iWidth));
+			strvArgs.push_back(toString(iHeight));
+		}
+
+		process_t process;
+		if (!startProcess(m_strExecutable, strvArgs, process)) {
+			fprintf(stderr, "ERROR: can't start export worker for frames %d .. %d\n", iFirst, iLast);
+			bOk = false;
+			break;
+		}
+		pvWorkers.push_back(process);
+	}
+
+	for (int i = 0; i < pvWorkers.size(); ++i) {
+		if (!waitProcess(pvWorkers[i])) {
+			fprintf(stderr, "ERROR: export worker %d failed\n", i);
+			bOk = false;
+		}
+	}
+
+	double dElapsed = perfSeconds() - dStart;
+	printf("exported %d frames with %d workers in %.3f s, %.1f frames/s\n",
+		iFrameCount, (int)pvWorkers.size(), dElapsed,
+		dElapsed > 0.0 ? iFrameCount / dElapsed : 0.0);
+
+	return bOk;
+}
+
+void BatchDriver::benchmarkIntegrators(int iCount, int iSteps)
+{
+	ForceField ffEmpty;
+	const ForceField& ff = m_pps ? m_pps->forceField() : ffEmpty;
+	const float dt = 1.0f / 30.0f;
+
+	// the same synthetic cloud for every run
+	ParticleState psStart;
+	syntheticCloud(psStart, iCount);
+
+	printf("%d particles, %d steps, %d force kernels\n", iCount, iSteps, ff.size());
+	printf("%-10s %-7s %16s\n", "scheme", "simd", "particles/s");
+
+	ParticleState ps;
+	for (int iScheme = 0; iScheme < Integrator::NUM_SCHEMES; ++iScheme) {
+		for (int iSimd = 0; iSimd <= Integrator::bestSimd(); ++iSimd) {
+			Integrator integrator((Integrator::Scheme)iScheme);
+			integrator.simd((Integrator::Simd)iSimd);
+
+			// first step sizes the scratch arrays
+			ps.copyFrom(psStart);
+			integrator.step(ps, ff, dt);
+
+			double dStart = perfSeconds();
+			for (int iStep = 0; iStep < iSteps; ++iStep)
+				integrator.step(ps, ff, dt);
+			double dElapsed = perfSeconds() - dStart;
+
+			printf("%-10s %-7s %16.0f\n",
+				Integrator::schemeName(integrator.scheme()),
+				Integrator::simdName(integrator.simd()),
+				dElapsed > 0.0 ? (double)iCount * iSteps / dElapsed : 0.0);
+		}
+	}
+
+	// scaling of the default scheme over the thread pool
+	int iMaxThreads = m_pps ? m_pps->getThreadCount() : ThreadPool::hardwareThreads();
+	printf("\n%-10s %-7s %16s\n", "threads", "", "particles/s");
+	for (int iThreads = 1; ; iThreads *= 2) {
+		if (iThreads > iMaxThreads)
+			iThreads = iMaxThreads;
+		ThreadPool tp(iThreads);
+		Integrator integrator;
+
+		ps.copyFrom(psStart);
+		integrator.step(ps, ff, dt, &tp);
+
+		double dStart = perfSeconds();
+		for (int iStep = 0; iStep < iSteps; ++iStep)
+			integrator.step(ps, ff, dt, &tp);
+		double dElapsed = perfSeconds() - dStart;
+
+		printf("%-10d %-7s %16.0f\n", iThreads, Integrator::schemeName(integrator.scheme()),
+			dElapsed > 0.0 ? (double)iCount * iSteps / dElapsed : 0.0);
+		if (iThreads == iMaxThreads)
+			break;
+	}
+
+	// neighbour grid, then collisions (which rebuild it), on the
+	// starting cloud so every step sees the same density
+	ThreadPool tp(iMaxThreads);
+	SpatialGrid grid;
+	ParticleCollisions pc(0.05f);
+	grid.build(psStart.px, psStart.py, psStart.pz, iCount, 0.1f, &tp);
+	double dStart = perfSeconds();
+	for (int iStep = 0; iStep < iSteps; ++iStep)
+		grid.build(psStart.px, psStart.py, psStart.pz, iCount, 0.1f, &tp);
+	double dBuild = perfSeconds() - dStart;
+	double dResolve = 0.0;
+	for (int iStep = 0; iStep < iSteps; ++iStep) {
+		ps.copyFrom(psStart);
+		dStart = perfSeconds();
+		pc.resolve(ps, grid, &tp);
+		dResolve += perfSeconds() - dStart;
+	}
+	printf("\n%-10s %-7s %16s\n", "neighbours", "", "particles/s");
+	printf("%-10s %-7s %16.0f\n", "grid", "build",
+		dBuild > 0.0 ? (double)iCount * iSteps / dBuild : 0.0);
+	printf("%-10s %-7s %16.0f  %d contacts\n", "collide", "resolve",
+		dResolve > 0.0 ? (double)iCount * iSteps / dResolve : 0.0, pc.contacts());
+
+	// mutual gravitation: sort, octree build and walks, on a cloud of
+	// 100k bodies whatever the particle count, and over the threads
+	const int iBodies = 100000;
+	ParticleState psBodies;
+	syntheticCloud(psBodies, iBodies);
+	printf("\n%-10s %-7s %16s  %d bodies\n", "nbody", "threads", "particles/s", iBodies);
+	for (int iThreads = 1; ; iThreads *= 2) {
+		if (iThreads > iMaxThreads)
+			iThreads = iMaxThreads;
+		ThreadPool tpBodies(iThreads);
+		NBodyGravity nbody;
+		nbody.prepare(psBodies, &tpBodies);
+		dStart = perfSeconds();
+		for (int iStep = 0; iStep < iSteps; ++iStep)
+			nbody.prepare(psBodies, &tpBodies);
+		double dGravity = perfSeconds() - dStart;
+		printf("%-10s %-7d %16.0f  %d cells\n", "prepare", iThreads,
+			dGravity > 0.0 ? (double)iBodies * iSteps / dGravity : 0.0, nbody.cells());
+		if (iThreads == iMaxThreads)
+			break;
+	}
+
+	// a vector field, written to a scratch volume in the temporary
+	// directory and mapped back: a swirl around y on a 64^3 grid over
+	// the cloud, sampled per particle
+	const int iGrid = 64;
+	const int ivSize[3] = { iGrid, iGrid, iGrid };
+	const float fvLo[3] = { -5.0f, -5.0f, -5.0f };
+	const float fvHi[3] = { 5.0f, 5.0f, 5.0f };
+	std::vector<float> fvVectors(3 * iGrid * iGrid * iGrid);
+	for (int z = 0; z < iGrid; ++z) {
+		for (int y = 0; y < iGrid; ++y) {
+			for (int x = 0; x < iGrid; ++x) {
+				float* pf = &fvVectors[3 * ((z * iGrid + y) * iGrid + x)];
+				pf[0] = (float)(z - iGrid / 2) / iGrid;
+				pf[1] = 0.1f;
+				pf[2] = (float)(iGrid / 2 - x) / iGrid;
+			}
+		}
+	}
+	std::string strVolume = tempFileName("animator-benchmark.vfld");
+	VectorField vf;
+	if (VectorField::save(strVolume.c_str(), ivSize, VectorField::ACCELERATION, fvLo, fvHi, &fvVectors[0]) &&
+		vf.open(strVolume.c_str())) {
+		std::vector<float> fvAccel[3];
+		for (int c = 0; c < 3; ++c)
+			fvAccel[c].assign(iCount, 0.0f);
+		double dField = 0.0;
+		for (int iStep = 0; iStep <= iSteps; ++iStep) {
+			dStart = perfSeconds();
+			tp.forRange(iCount, Integrator::CHUNK, [&](int begin, int end) {
+				ForceInput in = { psStart.px + begin, psStart.py + begin, psStart.pz + begin,
+					psStart.vx + begin, psStart.vy + begin, psStart.vz + begin,
+					psStart.mass + begin, end - begin, begin };
+				vf.accumulate(in, &fvAccel[0][begin], &fvAccel[1][begin], &fvAccel[2][begin]);
+			});
+			// the first pass pages the volume in
+			if (iStep > 0)
+				dField += perfSeconds() - dStart;
+		}
+		printf("\n%-10s %-7s %16s  %d^3 grid\n", "field", "", "particles/s", iGrid);
+		printf("%-10s %-7s %16.0f\n", "sample", "",
+			dField > 0.0 ? (double)iCount * iSteps / dField : 0.0);
+		vf.close();
+	}
+	else
+		fprintf(stderr, "ERROR: can't write %s\n", strVolume.c_str());
+	remove(strVolume.c_str());
+}
@@ -0,0 +1,119 @@
+#ifndef BATCHDRIVER_H_INCLUDED
+#define BATCHDRIVER_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <string>
+#include <vector>
+
+struct ModelerControl;
+class Curve;
+class CurveEvaluator;
+class Camera;
+class ParticleSystem;
+
+// Places the particle system's emitters and model collider for a set of
+// control values, without drawing anything: the model is posed (see
+// beginPose() in modelerdraw.h), so its own drawing code calls
+// spawnParticles() for each emitter, and records its primitives, just as
+// it does while it draws.
+typedef void (*ParticleEmitter_f)(const float* pfControls);
+
+// BatchDriver runs an animation without opening a window: it loads an
+// .ani script (and its .ani.cam camera keyframes, if present), evaluates
+// every channel and the camera at a fixed frame rate over a time range,
+// steps the particle simulation at that rate as fast as it will go, and
+// writes the poses and the particle bake to disk.
+//
+// With --export it then renders the range as a movie: the frames are
+// split into contiguous chunks, one per worker process, and each worker
+// (the same executable, run with --render-frames) opens its own GL
+// context, restores the particles from the bake and saves its frames
+// under the same names the UI's Save Movie uses.
+//
+// Usage:
+//   animator --batch <script.ani> [--start <t>] [--end <t>] [--fps <n>]
+//                    [--poses <file>] [--bake <file>] [--cache <file>]
+//                    [--export <movie.bmp> [--workers <n>] [--size <w> <h>]]
+//                    [--integrator euler|midpoint|rk4|verlet|dopri5]
+//                    [--tolerance <t>] [--threads <n>]
+//                    [--collide <radius>] [--fluid] [--nbody] [--seed <n>]
+//                    [--field <volume> [--field-strength <s>]
+//                                      [--field-transform <x> <y> <z> <scale>]]
+//   animator --benchmark [<particles>] [<particle options>]
+// --benchmark steps a synthetic particle set with every integration
+// scheme and instruction set, over growing thread counts, and through
+// the neighbour grid and collision pass, then times the Barnes-Hut tree
+// of 100k bodies and the sampling of a vector field, and prints
+// particles per second.
+// --tolerance bounds dopri5's relative error per substep, which it keeps
+// to by splitting steps; the other schemes take fixed steps.
+// --collide makes the particles collide as spheres of the given radius,
+// --fluid turns them into an SPH fluid, and --nbody makes them attract
+// each other. --field pushes them with a VectorField volume file, its
+// box scaled by <scale> and moved to <x> <y> <z>, at the given strength.
+// --seed picks the emission jitter; a bake only depends on it and the
+// settings, never on the run.
+// The particle options, from --integrator to --field-transform, are
+// read by ParticleOptions and the UI takes them too, so the UI and a
+// batch run of the same script make the same bake.
+// --cache keeps the bake in a ParticleSystem bake cache as well; when
+// the cache already holds this script's particles for the range, they
+// are reused rather than simulated again. The cache is salted with
+// scriptHash() of the curves, as the UI's --bake-cache is, so either
+// can reuse what the other baked.
+// The range defaults to the whole script, the rate to the particle
+// system's bake rate, the outputs to <script.ani>.poses and
+// <script.ani>.bake, and the worker count to the number of cores.
+class BatchDriver
+{
+public:
+	BatchDriver(const ModelerControl controls[], unsigned numControls,
+		ParticleSystem* pps, ParticleEmitter_f pfEmitter);
+	~BatchDriver();
+
+	// True if the command line asks for a batch run
+	static bool requested(int argc, char** argv);
+	// Parse the command line and run; returns the process exit code
+	int run(int argc, char** argv);
+
+	bool loadScript(const char* szFileName);
+	float endTime() const { return m_fEndTime; }
+
+	// Evaluate and simulate frames fStart .. fEnd at iFps; any of the
+	// files may be NULL
+	bool bake(float fStart, float fEnd, int iFps,
+		const char* szPoseFile, const char* szBakeFile, const char* szCacheFile = NULL);
+
+	// Time iSteps steps of iCount particles under the particle system's
+	// forces for every Integrator scheme and SIMD level, then for 1, 2,
+	// 4, ... threads up to the particle system's thread count, then the
+	// collision pass, then mutual gravitation of 100k bodies over the
+	// same thread counts, then a 64^3 vector field
+	void benchmarkIntegrators(int iCount, int iSteps);
+
+	// Render frames 0 .. iFrameCount - 1 (frame n at fStart + n / iFps)
+	// of szScript in iWorkers processes. Returns false if any worker fails.
+	bool exportMovie(const char* szScript, const char* szBakeFile,
+		const char* szMovieFileName, float fStart, int iFrameCount, int iFps,
+		int iWorkers, int iWidth, int iHeight);
+
+private:
+	BatchDriver(const BatchDriver&) {}
+	BatchDriver& operator=(const BatchDriver&) { return *this; }
+
+	std::vector<Curve*> m_pcrvvCurves;
+	CurveEvaluator** m_ppceCurveEvaluators;
+	Camera* m_pcamCamera;
+	ParticleSystem* m_pps;
+	ParticleEmitter_f m_pfEmitter;
+	std::vector<int> m_ivCurveTypes;
+	float m_fEndTime;
+	// scriptHash() of the curves; salts the bake cache, as the animation
+	// moves the emitter
+	unsigned long long m_ullScriptHash;
+	// this executable, for starting export workers
+	std::string m_strExecutable;
+};
+
+#endif // BATCHDRIVER_H_INCLUDED
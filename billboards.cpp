@@ -0,0 +1,100 @@
+#pragma warning(disable : 4786)
+
+#include "billboards.h"
+#include "particle.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BILLBOARDS_SSE
+#include <xmmintrin.h>
+#endif
+
+// corners of a billboard in its own plane, with their texture coordinates
+static const float s_corner[4][2] = { { -1, -1 }, { -1, 1 }, { 1, 1 }, { 1, -1 } };
+static const float s_texCoord[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+
+Billboards::Billboards(float s)
+	: size(s)
+{
+}
+
+void Billboards::reserve(int n)
+{
+	int had = texCoords.size() / 8;
+	if (n <= had)
+		return;
+	vertices.resize(n * 12 + 1);
+	texCoords.resize(n * 8);
+	for (int i = had; i < n; i++) {
+		for (int k = 0; k < 4; k++) {
+			texCoords[i * 8 + k * 2] = s_texCoord[k][0];
+			texCoords[i * 8 + k * 2 + 1] = s_texCoord[k][1];
+		}
+	}
+}
+
+void Billboards::draw(const ParticleState& s, const std::vector<int>* order, Camera* camera)
+{
+	int n = s.size();
+	if (n == 0)
+		return;
+	reserve(n);
+
+	// the view plane basis, as a billboard at the look-at point would have
+	Vec3f d = camera->getPos() - camera->getLookAt();
+	d.normalize();
+	Vec3f right = d ^ camera->getUp();
+	right.normalize();
+	Vec3f up = d ^ right;
+
+	float half = size * 0.5f;
+	float offset[4][4];
+	for (int k = 0; k < 4; k++) {
+		for (int c = 0; c < 3; c++)
+			offset[k][c] = half * (s_corner[k][0] * right[c] + s_corner[k][1] * up[c]);
+		offset[k][3] = 0;
+	}
+	corners(s, order ? &(*order)[0] : NULL, n, offset);
+
+	float c[] = { 0.01, 0.9, 0.01, 1.0 };
+	glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, c);
+	glColor4d(0.0f, 1.0f, 1.0f, 1.0f);
+	glBindTexture(GL_TEXTURE_2D, Particle::texID);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, &vertices[0]);
+	glTexCoordPointer(2, GL_FLOAT, 0, &texCoords[0]);
+	glDrawArrays(GL_QUADS, 0, n * 4);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void Billboards::corners(const ParticleState& s, const int* order, int n, const float offset[4][4])
+{
+	float* out = &vertices[0];
+#ifdef BILLBOARDS_SSE
+	__m128 o0 = _mm_loadu_ps(offset[0]);
+	__m128 o1 = _mm_loadu_ps(offset[1]);
+	__m128 o2 = _mm_loadu_ps(offset[2]);
+	__m128 o3 = _mm_loadu_ps(offset[3]);
+	for (int i = 0; i < n; i++, out += 12) {
+		int j = order ? order[i] : i;
+		__m128 p = _mm_set_ps(0.0f, s.pz[j], s.py[j], s.px[j]);
+		// each store spills a float into the next corner, which the
+		// next store overwrites
+		_mm_storeu_ps(out, _mm_add_ps(p, o0));
+		_mm_storeu_ps(out + 3, _mm_add_ps(p, o1));
+		_mm_storeu_ps(out + 6, _mm_add_ps(p, o2));
+		_mm_storeu_ps(out + 9, _mm_add_ps(p, o3));
+	}
+#else
+	for (int i = 0; i < n; i++) {
+		int j = order ? order[i] : i;
+		for (int k = 0; k < 4; k++, out += 3) {
+			out[0] = s.px[j] + offset[k][0];
+			out[1] = s.py[j] + offset[k][1];
+			out[2] = s.pz[j] + offset[k][2];
+		}
+	}
+#endif
+}
@@ -0,0 +1,44 @@
+#ifndef BILLBOARDS_H
+#define BILLBOARDS_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include <FL/gl.h>
+#include "vec.h"
+#include "camera.h"
+#include "particlestate.h"
+
+// Billboards draws every particle as a textured square facing the
+// camera, all in one vertex array draw call.
+//
+// The squares are aligned with the view plane, so they share one right
+// and one up vector and each corner is a fixed offset from its
+// particle's position. The corners of all particles are written in a
+// single pass, four floats at a time with SSE where there is SSE; the
+// texture coordinates never change and are only written when the
+// arrays grow.
+class Billboards {
+public:
+	// size is the width of a square
+	Billboards(float size = 0.2f);
+
+	// Vertices for n particles are allocated up front
+	void reserve(int n);
+
+	// Draws s's particles, in the order given by order (all of them, in
+	// index order, if order is NULL), with Particle::texID bound
+	void draw(const ParticleState& s, const std::vector<int>* order, Camera* camera);
+
+private:
+	// fills vertices for n particles from the corner offsets
+	void corners(const ParticleState& s, const int* order, int n, const float offset[4][4]);
+
+	float size;
+	// 4 corners of xyz per particle, and one float past the end, which
+	// the SSE stores of the last corner write to
+	std::vector<float> vertices;
+	std::vector<float> texCoords;
+};
+
+#endif
@@ -1,12 +1,14 @@
+#ifdef WIN32
 #include <windows.h>
-#include <Fl/gl.h>
-#include <gl/glu.h>
+#endif
+#include <FL/gl.h>
+#include <GL/glu.h>
 #include <fstream>
 
-#include "Camera.h"
-#include "Curve.h"
-#include "CurveEvaluator.h"
-#include "LinearCurveEvaluator.h"
+#include "camera.h"
+#include "curve.h"
+#include "curveevaluator.h"
+#include "linearcurveevaluator.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -263,17 +265,37 @@ void Camera::applyViewingTransform() {
 /** Update camera params based on keyframes **/
 void Camera::update(float t)
 {
+	float values[NUM_KEY_CURVES];
+
 	// do nothing if no keyframes
-	if (mNumKeyframes == 0) 
+	if (!evaluateKeyframes(t, values))
 		return;
 
 	// otherwise, update based on curves
-	mAzimuth = mKeyframes[AZIMUTH]->evaluateCurveAt(t);
-	mElevation = mKeyframes[ELEVATION]->evaluateCurveAt(t);
-	mDolly = mKeyframes[DOLLY]->evaluateCurveAt(t);
-	mLookAt[0] = mKeyframes[LOOKAT_X]->evaluateCurveAt(t);
-	mLookAt[1] = mKeyframes[LOOKAT_Y]->evaluateCurveAt(t);
-	mLookAt[2] = mKeyframes[LOOKAT_Z]->evaluateCurveAt(t);
+	applyKeyframes(values);
+}
+
+/** Evaluate the keyframe curves at t without touching the camera **/
+bool Camera::evaluateKeyframes(float t, float values[NUM_KEY_CURVES]) const
+{
+	if (mNumKeyframes == 0)
+		return false;
+
+	for (int i = AZIMUTH; i < NUM_KEY_CURVES; i++)
+		values[i] = mKeyframes[i]->evaluateCurveAt(t);
+
+	return true;
+}
+
+/** Set camera params from values produced by evaluateKeyframes **/
+void Camera::applyKeyframes(const float values[NUM_KEY_CURVES])
+{
+	mAzimuth = values[AZIMUTH];
+	mElevation = values[ELEVATION];
+	mDolly = values[DOLLY];
+	mLookAt[0] = values[LOOKAT_X];
+	mLookAt[1] = values[LOOKAT_Y];
+	mLookAt[2] = values[LOOKAT_Z];
 
 	mDirtyTransform = true;
 }
@@ -343,51 +365,59 @@ bool Camera::saveKeyframes(const char* szFileName) const
 
 	ofsFile.open(szFileName, std::ios::out);
 	if (!ofsFile.fail()) {
-		ofsFile << mNumKeyframes << std::endl;
-		ofsFile << NUM_KEY_CURVES << std::endl;
-
-		if (mKeyframes[0]) 
-			for (int i = 0; i < NUM_KEY_CURVES; ++i) {
-				mKeyframes[i]->toStream(ofsFile);
-			}
-
+		writeKeyframes(ofsFile);
 		return true;
 	}
 
 	return false;
 }
 
+void Camera::writeKeyframes(std::ostream& os) const
+{
+	os << mNumKeyframes << std::endl;
+	os << NUM_KEY_CURVES << std::endl;
+
+	if (mKeyframes[0]) 
+		for (int i = 0; i < NUM_KEY_CURVES; ++i) {
+			mKeyframes[i]->toStream(os);
+		}
+}
+
 bool Camera::loadKeyframes(const char* szFileName)
 {
 	std::ifstream ifsFile;
 
 	ifsFile.open(szFileName, std::ios::in);
-	if (!ifsFile.fail()) {
-		int iCurveCount;
-		int iNumKeyframes;
+	if (!ifsFile.fail())
+		return readKeyframes(ifsFile);
 
-		ifsFile >> iNumKeyframes;
-		if (iNumKeyframes <= 0)
-			return false;
-		mNumKeyframes = iNumKeyframes;
+	return false;
+}
 
-		ifsFile >> iCurveCount;
+bool Camera::readKeyframes(std::istream& is)
+{
+	int iCurveCount;
+	int iNumKeyframes;
 
-		if (iCurveCount != NUM_KEY_CURVES) {
-			return false;
-		}
+	is >> iNumKeyframes;
+	if (iNumKeyframes <= 0)
+		return false;
+	mNumKeyframes = iNumKeyframes;
 
-		deleteCurves();
-		createCurves(0.0f, 1.0f);
+	is >> iCurveCount;
 
-		for (int i = 0; i < iCurveCount; ++i) {
-			mKeyframes[i]->fromStream(ifsFile);
-		}
+	if (iCurveCount != NUM_KEY_CURVES) {
+		return false;
+	}
 
-		return true;
+	deleteCurves();
+	createCurves(0.0f, 1.0f);
+
+	for (int i = 0; i < iCurveCount; ++i) {
+		mKeyframes[i]->fromStream(is);
 	}
 
-	return false;
+	return true;
 }
 
 float Camera::keyframeTime(int keyframe) const
@@ -125,6 +125,8 @@ public:
 	void createCurves(float t, float maxX);
 	void deleteCurves();
 	void update(float t);
+	bool evaluateKeyframes(float t, float values[NUM_KEY_CURVES]) const;
+	void applyKeyframes(const float values[NUM_KEY_CURVES]);
 	bool setKeyframe(float t, float maxT);
 	void removeKeyframe(float t);
 	bool m_bSnapped;
@@ -137,6 +139,9 @@ public:
 	//---[ Save/Load Kerframes ]------------------------------
 	bool saveKeyframes(const char* szFileName) const;
 	bool loadKeyframes(const char* szFileName);
+	// the same, on a stream
+	void writeKeyframes(std::ostream& os) const;
+	bool readKeyframes(std::istream& is);
 	float keyframeTime(int keyframe) const;
 };
 
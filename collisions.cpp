@@ -0,0 +1,108 @@
+#pragma warning(disable : 4786)
+
+#include <math.h>
+
+#include "collisions.h"
+#include "particlestate.h"
+#include "threadpool.h"
+#include "integrator.h"
+#include "hash.h"
+
+ParticleCollisions::ParticleCollisions(float r, float e)
+	: sphere(r), bounce(e), found(0)
+{
+}
+
+unsigned long long ParticleCollisions::hash(unsigned long long h) const
+{
+	if (!enabled())
+		return h;
+	h = hashBytes("ParticleCollisions", 18, h);
+	h = hashValue(sphere, h);
+	return hashValue(bounce, h);
+}
+
+void ParticleCollisions::resolve(ParticleState& s, SpatialGrid& grid, ThreadPool* pool)
+{
+	int n = s.size();
+	found = 0;
+	if (!enabled() || n < 2)
+		return;
+
+	// cells as large as a contact distance find every contact
+	grid.build(s.px, s.py, s.pz, n, 2.0f * sphere, pool);
+	for (int c = 0; c < 3; c++) {
+		dp[c].resize(n);
+		dv[c].resize(n);
+	}
+	const int chunk = Integrator::CHUNK;
+	chunkContacts.assign((n + chunk - 1) / chunk, 0);
+
+	const ParticleState& before = s;
+	if (pool) {
+		pool->forRange(n, chunk, [&](int begin, int end) {
+			resolveRange(before, grid, begin, end);
+		});
+	} else {
+		for (int begin = 0; begin < n; begin += chunk)
+			resolveRange(before, grid, begin, begin + chunk < n ? begin + chunk : n);
+	}
+
+	float* p[3] = { s.px, s.py, s.pz };
+	float* v[3] = { s.vx, s.vy, s.vz };
+	for (int c = 0; c < 3; c++) {
+		for (int i = 0; i < n; i++) {
+			p[c][i] += dp[c][i];
+			v[c][i] += dv[c][i];
+		}
+	}
+	for (int k = 0; k < chunkContacts.size(); k++)
+		found += chunkContacts[k];
+	found /= 2;
+}
+
+void ParticleCollisions::resolveRange(const ParticleState& s, const SpatialGrid& grid, int begin, int end)
+{
+	float reach = 2.0f * sphere;
+	int contacts = 0;
+	for (int i = begin; i < end; i++) {
+		float x = s.px[i], y = s.py[i], z = s.pz[i];
+		float ux = s.vx[i], uy = s.vy[i], uz = s.vz[i];
+		float mi = s.mass[i];
+		float cp[3] = { 0, 0, 0 };
+		float cv[3] = { 0, 0, 0 };
+		int touching = 0;
+
+		grid.forNeighbors(x, y, z, [&](int j) {
+			if (j == i)
+				return;
+			float nx = x - s.px[j], ny = y - s.py[j], nz = z - s.pz[j];
+			float d2 = nx * nx + ny * ny + nz * nz;
+			// coincident particles have no direction to separate along
+			if (d2 >= reach * reach || d2 == 0)
+				return;
+			float d = sqrtf(d2);
+			nx /= d; ny /= d; nz /= d;
+			// i's share of the pair's correction
+			float share = s.mass[j] / (mi + s.mass[j]);
+
+			float depth = (reach - d) * share;
+			cp[0] += nx * depth; cp[1] += ny * depth; cp[2] += nz * depth;
+			touching++;
+
+			float closing = (ux - s.vx[j]) * nx + (uy - s.vy[j]) * ny + (uz - s.vz[j]) * nz;
+			if (closing < 0) {
+				float impulse = -(1.0f + bounce) * closing * share;
+				cv[0] += nx * impulse; cv[1] += ny * impulse; cv[2] += nz * impulse;
+			}
+		});
+
+		float average = touching > 0 ? 1.0f / touching : 0.0f;
+		for (int c = 0; c < 3; c++) {
+			dp[c][i] = cp[c] * average;
+			dv[c][i] = cv[c];
+		}
+		contacts += touching;
+	}
+	chunkContacts[begin / Integrator::CHUNK] = contacts;
+}
@@ -0,0 +1,55 @@
+#ifndef COLLISIONS_H
+#define COLLISIONS_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include "spatialgrid.h"
+
+class ParticleState;
+class ThreadPool;
+
+// ParticleCollisions treats particles as spheres of one radius and
+// resolves contacts between them after each step: overlapping pairs are
+// pushed apart along the line between their centers, in inverse
+// proportion to their masses, and pairs moving into each other get an
+// impulse that reverses their closing speed, scaled by restitution.
+//
+// Contacts are found with a SpatialGrid and resolved Jacobi style:
+// every particle works out its own correction from the positions and
+// velocities before resolution, and all corrections are applied
+// afterwards. Particles never write each other's state, so the pass
+// runs on the thread pool and gives the same result on any number of
+// threads. A particle touching several others moves by the average of
+// its separations, which keeps dense clusters from overshooting.
+class ParticleCollisions {
+public:
+	// radius <= 0 disables collisions
+	ParticleCollisions(float radius = 0.0f, float restitution = 0.5f);
+
+	void radius(float r) { sphere = r; }
+	float radius() const { return sphere; }
+	void restitution(float e) { bounce = e; }
+	float restitution() const { return bounce; }
+	bool enabled() const { return sphere > 0; }
+
+	// Rebuilds grid over s's particles and resolves their contacts
+	void resolve(ParticleState& s, SpatialGrid& grid, ThreadPool* pool = NULL);
+	// contacts found by the last resolve(), each pair counted once
+	int contacts() const { return found; }
+
+	unsigned long long hash(unsigned long long h) const;
+
+private:
+	void resolveRange(const ParticleState& s, const SpatialGrid& grid, int begin, int end);
+
+	float sphere;						// radius
+	float bounce;						// restitution
+	int found;
+	// corrections per particle: position, velocity; and contacts per chunk
+	std::vector<float> dp[3];
+	std::vector<float> dv[3];
+	std::vector<int> chunkContacts;
+};
+
+#endif
@@ -1,4 +1,4 @@
-#include "Color.h"
+#include "color.h"
 
 Color::Color(void)
 	:red(0.0), green(0.0), blue(0.0)
@@ -1,4 +1,4 @@
-#include "Curve.h"
+#include "curve.h"
 
 #include <algorithm>
 #include <functional>
@@ -11,11 +11,14 @@
 #endif // WIN32
 #include <GL/gl.h>
 #include <float.h>
+#include <sstream>
 
-#include "Curve.h"
-#include "CurveEvaluator.h"
+#include "curve.h"
+#include "curveevaluator.h"
+#include "hash.h"
 
 float Curve::s_fCtrlPtXEpsilon = 0.0001f;
+int Curve::s_iRevision = 0;
 
 Curve::Curve() :
 	m_pceEvaluator(NULL),
@@ -60,7 +63,7 @@ void Curve::maxX(const float fNewMaxX)
 		}
 	}
 
-	m_bDirty = true;
+	invalidate();
 }
 
 Curve::Curve(std::istream& isInputStream)
@@ -97,13 +100,13 @@ void Curve::fromStream(std::istream& isInputStream)
 
 	isInputStream >> m_bWrap;
 
-	m_bDirty = true;
+	invalidate();
 }
 
 void Curve::wrap(bool bWrap)
 {
 	m_bWrap = bWrap;
-	m_bDirty = true;
+	invalidate();
 }
 
 bool Curve::wrap() const
@@ -173,21 +176,21 @@ void Curve::scaleX(const float fScale)
 		control_point_iterator->x *= fScale;
 	}
 	m_fMaxX *= fScale;
-	m_bDirty = true;
+	invalidate();
 }
 
 void Curve::addControlPoint(const Point& point)
 {
 	m_ptvCtrlPts.push_back(point);
 	sortControlPoints();
-	m_bDirty = true;
+	invalidate();
 }
 
 void Curve::removeControlPoint(const int iCtrlPt)
 {
 	if (iCtrlPt < m_ptvCtrlPts.size() && m_ptvCtrlPts.size() > 2) {
 		m_ptvCtrlPts.erase(m_ptvCtrlPts.begin() + iCtrlPt);
-		m_bDirty = true;
+		invalidate();
 	}
 }
 
@@ -196,7 +199,7 @@ void Curve::removeControlPoint2(const int iCtrlPt)
 {
 	if (iCtrlPt < m_ptvCtrlPts.size()) {
 		m_ptvCtrlPts.erase(m_ptvCtrlPts.begin() + iCtrlPt);
-		m_bDirty = true;
+		invalidate();
 	}
 }
 
@@ -285,7 +288,7 @@ void Curve::moveControlPoint(const int iCtrlPt, const Point& ptNewPt)
 		}
 	}
 
-	m_bDirty = true;
+	invalidate();
 }
 
 void Curve::moveControlPoints(const std::vector<int>& ivCtrlPts, const Point& ptOffset,
@@ -342,7 +345,7 @@ void Curve::moveControlPoints(const std::vector<int>& ivCtrlPts, const Point& pt
 		m_ptvCtrlPts[iCtrlPt].y += ptActualOffset.y;
 	}
 
-	m_bDirty = true;
+	invalidate();
 }
 
 void Curve::drawCurve() const
@@ -431,6 +434,7 @@ void Curve::reevaluate() const
 void Curve::invalidate() const
 {
 	m_bDirty = true;
+	++s_iRevision;
 }
 
 std::ostream& operator<<(std::ostream& output_stream, const Curve & curve_data)
@@ -445,3 +449,24 @@ std::istream& operator>>(std::istream& isInputStream, Curve & curve_data)
 	return isInputStream;
 }
 
+
+void writeScript(std::ostream& os, float fEndTime,
+	const std::vector<Curve*>& pcrvvCurves, const std::vector<int>& ivCurveTypes)
+{
+	os << fEndTime << std::endl;
+	os << pcrvvCurves.size() << std::endl;
+
+	for (int i = 0; i < pcrvvCurves.size(); ++i) {
+		os << ivCurveTypes[i] << std::endl;
+		pcrvvCurves[i]->toStream(os);
+	}
+}
+
+unsigned long long scriptHash(float fEndTime,
+	const std::vector<Curve*>& pcrvvCurves, const std::vector<int>& ivCurveTypes)
+{
+	std::ostringstream oss;
+	writeScript(oss, fEndTime, pcrvvCurves, ivCurveTypes);
+	std::string strScript = oss.str();
+	return hashBytes(strScript.data(), strScript.size());
+}
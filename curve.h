@@ -7,7 +7,7 @@
 #include <iostream>
 #include <string>
 
-#include "Point.h"
+#include "point.h"
 
 class CurveEvaluator;
 
@@ -49,6 +49,9 @@ public:
 	void drawControlPoint(int iCtrlPt) const;
 	void drawCurve(void) const;
 	void invalidate(void) const;
+	// bumped whenever any curve changes shape; lets caches of
+	// evaluated values know when they are stale
+	static int revision() { return s_iRevision; }
 
 	void toStream(std::ostream& output_stream) const;
 	void fromStream(std::istream& input_stream);
@@ -68,9 +71,21 @@ protected:
 	float m_fMaxX;
 	bool m_bWrap;
 	static float s_fCtrlPtXEpsilon;
+	static int s_iRevision;
 };
 
 std::ostream& operator<<(std::ostream& output_stream, const Curve& curve_data);
 std::istream& operator>>(std::istream& input_stream, Curve& curve_data);
 
+// Write an animation script: the end time, the curve count, then each
+// curve's evaluator type and control points. GraphWidget::saveScript()
+// saves this and BatchDriver::loadScript() reads it.
+void writeScript(std::ostream& os, float fEndTime,
+	const std::vector<Curve*>& pcrvvCurves, const std::vector<int>& ivCurveTypes);
+// hash of the script writeScript() would write, so a script hashes the
+// same in the UI and in a batch run however its file was formatted; the
+// bake caches are salted with it
+unsigned long long scriptHash(float fEndTime,
+	const std::vector<Curve*>& pcrvvCurves, const std::vector<int>& ivCurveTypes);
+
 #endif // CURVE_H_INCLUDED
@@ -1,4 +1,4 @@
-#include "CurveEvaluator.h"
+#include "curveevaluator.h"
 
 float CurveEvaluator::s_fFlatnessEpsilon = 0.00001f;
 int CurveEvaluator::s_iSegCount = 16;
@@ -3,7 +3,7 @@
 
 #pragma warning(disable : 4786)
 
-#include "Curve.h"
+#include "curve.h"
 
 //using namespace std;
 
@@ -0,0 +1,138 @@
+#pragma warning(disable : 4786)
+
+#include "depthsort.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+// Maps a float to an unsigned int whose order is the float's order,
+// flipped, so that larger depths come first in an ascending sort
+inline unsigned int farFirst(float f)
+{
+	unsigned int u;
+	memcpy(&u, &f, sizeof(u));
+	u ^= (u & 0x80000000u) ? 0xffffffffu : 0x80000000u;
+	return ~u;
+}
+
+enum { RADIX_BITS = 11, RADIX = 1 << RADIX_BITS, PASSES = 3 };
+
+}
+
+DepthSort::DepthSort()
+	: lastCount(-1), lastReused(false)
+{
+	coherence(0.02f);
+}
+
+void DepthSort::coherence(float angle)
+{
+	minCos = cosf(angle);
+}
+
+bool DepthSort::orderIndependent(GLenum src, GLenum dst)
+{
+	// dst' = dst + src * factor: additive, commutative
+	if (dst == GL_ONE)
+		return src == GL_ONE || src == GL_SRC_ALPHA || src == GL_ZERO;
+	// dst' = dst * src: multiplicative
+	if (src == GL_ZERO && dst == GL_SRC_COLOR)
+		return true;
+	if (src == GL_DST_COLOR && dst == GL_ZERO)
+		return true;
+	return false;
+}
+
+void DepthSort::sort(const ParticleState& s, const Vec3f& dir, std::vector<int>& order)
+{
+	int n = s.size();
+	keys.resize(n);
+	for (int i = 0; i < n; i++)
+		keys[i] = farFirst(s.position(i) * dir);
+
+	double len = dir.length() * lastDir.length();
+	bool coherent = n == lastCount && (int)order.size() == n && len > 0
+		&& (dir * lastDir) >= minCos * len;
+	lastDir = dir;
+	lastCount = n;
+
+	lastReused = coherent && insertionSort(order, n);
+	if (!lastReused)
+		radixSort(order, n);
+}
+
+bool DepthSort::insertionSort(std::vector<int>& order, int n) const
+{
+	// a nearly sorted order takes a few moves per particle; past this
+	// the radix sort is cheaper
+	long long budget = 8LL * n + 64;
+	for (int i = 1; i < n; i++) {
+		int index = order[i];
+		unsigned int key = keys[index];
+		int j = i;
+		while (j > 0 && keys[order[j - 1]] > key) {
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = index;
+		budget -= i - j;
+		if (budget < 0)
+			return false;
+	}
+	return true;
+}
+
+void DepthSort::radixSort(std::vector<int>& order, int n)
+{
+	if (n == 0) {
+		order.clear();
+		return;
+	}
+	order.resize(n);
+	swapOrder.resize(n);
+	sorted.resize(n);
+	scratch.resize(n);
+
+	// one histogram per pass, all counted in a single read of the keys
+	histogram.assign(PASSES * RADIX, 0);
+	unsigned int* count[PASSES];
+	for (int p = 0; p < PASSES; p++)
+		count[p] = &histogram[p * RADIX];
+	for (int i = 0; i < n; i++) {
+		unsigned int k = keys[i];
+		sorted[i] = k;
+		order[i] = i;
+		for (int p = 0; p < PASSES; p++)
+			count[p][(k >> (p * RADIX_BITS)) & (RADIX - 1)]++;
+	}
+
+	unsigned int* kIn = &sorted[0];
+	unsigned int* kOut = &scratch[0];
+	int* iIn = &order[0];
+	int* iOut = &swapOrder[0];
+	for (int p = 0; p < PASSES; p++) {
+		int shift = p * RADIX_BITS;
+		// a pass where all keys share the digit changes nothing
+		if (count[p][(kIn[0] >> shift) & (RADIX - 1)] == (unsigned int)n)
+			continue;
+		unsigned int sum = 0;
+		for (int d = 0; d < RADIX; d++) {
+			unsigned int c = count[p][d];
+			count[p][d] = sum;
+			sum += c;
+		}
+		for (int i = 0; i < n; i++) {
+			unsigned int d = (kIn[i] >> shift) & (RADIX - 1);
+			unsigned int to = count[p][d]++;
+			kOut[to] = kIn[i];
+			iOut[to] = iIn[i];
+		}
+		std::swap(kIn, kOut);
+		std::swap(iIn, iOut);
+	}
+	if (iIn != &order[0])
+		order.swap(swapOrder);
+}
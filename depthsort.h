@@ -0,0 +1,57 @@
+#ifndef DEPTHSORT_H
+#define DEPTHSORT_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include <FL/gl.h>
+#include "vec.h"
+#include "particlestate.h"
+
+// DepthSort orders particles back to front for blending.
+//
+// Each particle's depth along the view direction is computed once, into
+// a key, and an array of indices is sorted by it; the particles
+// themselves never move. A fresh order comes from a radix sort of the
+// keys (three 11-bit passes, so linear in the particle count). When the
+// view direction has barely turned since the last sort, and the
+// particles are the same in number, the last order is nearly right and
+// is fixed up by insertion sort instead; if that turns out to need too
+// many moves it gives up and the radix sort runs after all.
+class DepthSort {
+public:
+	DepthSort();
+
+	// true if drawing with glBlendFunc(src, dst) gives the same picture
+	// in any order, e.g. additive or multiplicative blending, provided
+	// depth writes are off while drawing
+	static bool orderIndependent(GLenum src, GLenum dst);
+
+	// Indices of s's particles into order, farthest along dir first.
+	// order should be the vector filled by the last call.
+	void sort(const ParticleState& s, const Vec3f& dir, std::vector<int>& order);
+
+	// how far (radians) the view may turn for the last order to be reused
+	void coherence(float angle);
+
+	// how the last sort went, for statistics
+	bool reused() const { return lastReused; }
+
+private:
+	// false, leaving order partly sorted, if it took too many moves
+	bool insertionSort(std::vector<int>& order, int n) const;
+	void radixSort(std::vector<int>& order, int n);
+
+	std::vector<unsigned int> keys;		// per particle; smaller is farther
+	// radix sort buffers: keys and indices, and their copies per pass
+	std::vector<unsigned int> sorted;
+	std::vector<unsigned int> scratch;
+	std::vector<int> swapOrder;
+	std::vector<unsigned int> histogram;
+	Vec3f lastDir;
+	int lastCount;
+	float minCos;						// cosine of the coherence angle
+	bool lastReused;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#pragma warning(disable : 4786)
+
+#include "emitter.h"
+#include "particlestate.h"
+#include "hash.h"
+
+Emitter::Emitter(const char* szName)
+	: name(szName), active(true), rate(10), speed(1.0f), spread(0.1f), lifetime(10.0f),
+	mass(3.0f), acceleration(0, 0, 0), drag(0), position(0, 0, 0), direction(0, 0, 0),
+	emitted(false), emittedPosition(0, 0, 0), emittedDirection(0, 0, 0)
+{
+}
+
+unsigned long long Emitter::hash(unsigned long long h) const
+{
+	h = hashBytes(name.c_str(), name.size(), h);
+	h = hashValue(active, h);
+	h = hashValue(rate, h);
+	h = hashValue(speed, h);
+	h = hashValue(spread, h);
+	h = hashValue(lifetime, h);
+	h = hashValue(mass, h);
+	h = hashValue(acceleration, h);
+	return hashValue(drag, h);
+}
+
+void EmitterForces::prepare(const ParticleState& s, ThreadPool* /*pool*/)
+{
+	count = s.size();
+	owner = s.emitter;
+	any = false;
+	table.resize(4 * emitters.size());
+	for (int e = 0; e < emitters.size(); e++) {
+		const Emitter& emitter = emitters[e];
+		for (int c = 0; c < 3; c++)
+			table[4 * e + c] = emitter.acceleration[c];
+		table[4 * e + 3] = emitter.drag;
+		any = any || emitter.acceleration.length2() > 0 || emitter.drag != 0;
+	}
+}
+
+void EmitterForces::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	// nothing prepared for this state, e.g. stepped without prepare()
+	if (!any || in.first + in.n > count)
+		return;
+	const unsigned short* e = owner + in.first;
+	for (int i = 0; i < in.n; i++) {
+		const float* f = &table[4 * e[i]];
+		ax[i] += f[0] - f[3] * in.vx[i];
+		ay[i] += f[1] - f[3] * in.vy[i];
+		az[i] += f[2] - f[3] * in.vz[i];
+	}
+}
+
+unsigned long long EmitterForces::hash(unsigned long long h) const
+{
+	// the emitters' settings are hashed with the rest of the system's
+	return hashBytes("EmitterForces", 13, h);
+}
@@ -0,0 +1,62 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#pragma warning(disable : 4786)
+
+#include <string>
+#include <vector>
+#include "vec.h"
+#include "forcefield.h"
+
+// An Emitter is a named source of particles in a ParticleSystem. The
+// model moves it each frame (ParticleSystem::setEmitterStart(), from
+// wherever in its hierarchy the emitter is attached); the rest are its
+// settings. All emitters of a system fill one pool and are integrated
+// together; each particle remembers its emitter, which is how an
+// emitter's own forces find its particles.
+struct Emitter {
+	Emitter(const char* szName = "");
+
+	std::string name;
+	bool active;
+	int rate;							// particles per frame
+	float speed;						// scales the emitting direction
+	float spread;						// jitter steps of position and velocity, per axis
+	float lifetime;						// of its particles; <= 0: no limit
+	float mass;
+	// forces on its particles only, on top of the system's
+	Vec3f acceleration;
+	float drag;							// a -= drag * v
+
+	// where it is, and which way it emits, as of the last frame
+	Vec3f position;
+	Vec3f direction;
+	// where it emitted the last frame simulated from, if it has; frames
+	// simulated together emit from between there and position
+	bool emitted;
+	Vec3f emittedPosition;
+	Vec3f emittedDirection;
+
+	unsigned long long hash(unsigned long long h) const;
+};
+
+// The forces of each emitter, applied to its own particles: one kernel
+// for all emitters, looking up each particle's emitter in a table made
+// by prepare().
+class EmitterForces : public ForceKernel {
+public:
+	EmitterForces(const std::vector<Emitter>& e) : emitters(e), count(0), any(false) {}
+
+	virtual void prepare(const ParticleState& s, ThreadPool* pool);
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+
+private:
+	const std::vector<Emitter>& emitters;
+	const unsigned short* owner;		// the particles' emitters
+	int count;							// particles prepared for
+	bool any;							// some emitter has forces
+	std::vector<float> table;			// ax, ay, az, drag per emitter
+};
+
+#endif
@@ -0,0 +1,262 @@
+#pragma warning(disable : 4786)
+
+#include <FL/Fl.H>
+#include <FL/Fl_Widget.H>
+#include <FL/Fl_Window.H>
+#include <FL/Fl_Slider.H>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "eventrecorder.h"
+#include "redrawscheduler.h"
+#include "perftimer.h"
+
+static const char* s_szTargetNames[EventRecorder::NUM_TARGETS] = {
+	"graph", "view", "indicator", "time", "playstart", "playend"
+};
+
+static const char* eventName(int iEvent)
+{
+	switch (iEvent) {
+	case FL_PUSH: return "push";
+	case FL_DRAG: return "drag";
+	case FL_RELEASE: return "release";
+	default: return "value";
+	}
+}
+
+// value at fraction f (0..1) of an already sorted sample
+static double percentile(const std::vector<double>& dvSorted, double f)
+{
+	if (dvSorted.empty())
+		return 0.0;
+	int i = (int)(f * (double)(dvSorted.size() - 1) + 0.5);
+	return dvSorted[i];
+}
+
+EventRecorder* EventRecorder::m_instance = NULL;
+
+EventRecorder* EventRecorder::Instance()
+{
+	return (m_instance) ? (m_instance) : (m_instance = new EventRecorder());
+}
+
+EventRecorder::EventRecorder() :
+m_pfRecord(NULL),
+m_dRecordStart(0.0),
+m_bReplaying(false),
+m_bPaced(true),
+m_iReplayNext(0)
+{
+	for (int i = 0; i < NUM_TARGETS; ++i)
+		m_pwndvTargets[i] = NULL;
+}
+
+void EventRecorder::target(Target target, Fl_Widget* pwndWidget)
+{
+	m_pwndvTargets[target] = pwndWidget;
+}
+
+bool EventRecorder::startRecording(const char* szFileName, const std::string& strSession)
+{
+	stopRecording();
+
+	m_pfRecord = fopen(szFileName, "w");
+	if (m_pfRecord == NULL)
+		return false;
+
+	if (!strSession.empty()) {
+		fprintf(m_pfRecord, "session %d\n", (int)strSession.size());
+		fwrite(strSession.data(), 1, strSession.size(), m_pfRecord);
+	}
+
+	m_dRecordStart = perfSeconds();
+	return true;
+}
+
+void EventRecorder::stopRecording()
+{
+	if (m_pfRecord) {
+		fclose(m_pfRecord);
+		m_pfRecord = NULL;
+	}
+}
+
+void EventRecorder::record(Target target, int iEvent)
+{
+	if (m_pfRecord == NULL)
+		return;
+	if (iEvent != FL_PUSH && iEvent != FL_DRAG && iEvent != FL_RELEASE)
+		return;
+
+	Event event;
+	event.m_dTime = perfSeconds() - m_dRecordStart;
+	event.m_iTarget = target;
+	event.m_iEvent = iEvent;
+	event.m_iX = Fl::event_x();
+	event.m_iY = Fl::event_y();
+	event.m_iButton = Fl::event_button();
+	event.m_iState = Fl::event_state();
+	event.m_dValue = 0.0;
+	writeEvent(event);
+}
+
+void EventRecorder::recordValue(Target target, double dValue)
+{
+	if (m_pfRecord == NULL)
+		return;
+
+	Event event;
+	event.m_dTime = perfSeconds() - m_dRecordStart;
+	event.m_iTarget = target;
+	event.m_iEvent = 0;
+	event.m_iX = event.m_iY = event.m_iButton = event.m_iState = 0;
+	event.m_dValue = dValue;
+	writeEvent(event);
+}
+
+void EventRecorder::writeEvent(const Event& event)
+{
+	fprintf(m_pfRecord, "%.6f %s %d %d %d %d %d %.9g\n",
+		event.m_dTime, s_szTargetNames[event.m_iTarget], event.m_iEvent,
+		event.m_iX, event.m_iY, event.m_iButton, event.m_iState, event.m_dValue);
+}
+
+bool EventRecorder::startReplay(const char* szFileName, bool bPaced, const char* szReportFile)
+{
+	FILE* pf = fopen(szFileName, "r");
+	if (pf == NULL)
+		return false;
+
+	stopRecording();
+	m_evvReplay.clear();
+	m_dvLatency.clear();
+	m_strSession.clear();
+
+	int iSessionSize;
+	if (fscanf(pf, " session %d", &iSessionSize) == 1 && iSessionSize > 0) {
+		// the session starts on the next line
+		fgetc(pf);
+		m_strSession.resize(iSessionSize);
+		if ((int)fread(&m_strSession[0], 1, iSessionSize, pf) != iSessionSize) {
+			fclose(pf);
+			m_strSession.clear();
+			return false;
+		}
+	}
+
+	Event event;
+	char szTarget[32];
+	while (fscanf(pf, "%lf %31s %d %d %d %d %d %lf", &event.m_dTime, szTarget,
+		&event.m_iEvent, &event.m_iX, &event.m_iY, &event.m_iButton,
+		&event.m_iState, &event.m_dValue) == 8) {
+		event.m_iTarget = -1;
+		for (int i = 0; i < NUM_TARGETS; ++i) {
+			if (strcmp(szTarget, s_szTargetNames[i]) == 0)
+				event.m_iTarget = i;
+		}
+		if (event.m_iTarget >= 0)
+			m_evvReplay.push_back(event);
+	}
+	fclose(pf);
+
+	m_bReplaying = true;
+	m_bPaced = bPaced;
+	m_strReport = szReportFile ? szReportFile : "";
+	m_iReplayNext = 0;
+	Fl::add_timeout(0.0, cb_replay, (void*)this);
+	return true;
+}
+
+void EventRecorder::cb_replay(void* p)
+{
+	((EventRecorder*)p)->replayNext();
+}
+
+void EventRecorder::replayNext()
+{
+	if (m_iReplayNext >= m_evvReplay.size()) {
+		finishReplay();
+		return;
+	}
+
+	const Event& event = m_evvReplay[m_iReplayNext++];
+	Fl_Widget* pwnd = m_pwndvTargets[event.m_iTarget];
+
+	double dStart = perfSeconds();
+	if (pwnd) {
+		if (event.m_iEvent == 0) {
+			// slider: set the value and run its callback like a user drag
+			((Fl_Slider*)pwnd)->value(event.m_dValue);
+			pwnd->do_callback();
+		}
+		else {
+			Fl::e_x = event.m_iX;
+			Fl::e_y = event.m_iY;
+			Fl::e_state = event.m_iState;
+			Fl::e_keysym = FL_Button + event.m_iButton;
+			pwnd->handle(event.m_iEvent);
+		}
+	}
+	// include the redraw the event caused
+	RedrawScheduler::Instance()->flush();
+	Fl::flush();
+	m_dvLatency.push_back(perfSeconds() - dStart);
+
+	double dDelay = 0.0;
+	if (m_bPaced && m_iReplayNext < m_evvReplay.size())
+		dDelay = std::max(0.0, m_evvReplay[m_iReplayNext].m_dTime - event.m_dTime);
+	Fl::add_timeout(dDelay, cb_replay, (void*)this);
+}
+
+void EventRecorder::finishReplay()
+{
+	m_bReplaying = false;
+
+	report(stdout);
+	if (!m_strReport.empty()) {
+		FILE* pf = fopen(m_strReport.c_str(), "w");
+		if (pf) {
+			report(pf);
+			fclose(pf);
+		}
+	}
+
+	// let Fl::run() return
+	while (Fl::first_window())
+		Fl::first_window()->hide();
+}
+
+void EventRecorder::report(FILE* pf) const
+{
+	fprintf(pf, "%-10s %-8s %7s %9s %9s %9s %9s\n",
+		"target", "event", "count", "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)");
+
+	// one row per (target, event) pair that occurred, then the total
+	for (int iTarget = 0; iTarget <= NUM_TARGETS; ++iTarget) {
+		int ivEvents[] = { FL_PUSH, FL_DRAG, FL_RELEASE, 0 };
+		for (int j = 0; j < 4; ++j) {
+			std::vector<double> dvSample;
+			for (int i = 0; i < m_dvLatency.size(); ++i) {
+				const Event& event = m_evvReplay[i];
+				if (iTarget == NUM_TARGETS ||
+					(event.m_iTarget == iTarget && event.m_iEvent == ivEvents[j]))
+					dvSample.push_back(m_dvLatency[i] * 1000.0);
+			}
+			if (dvSample.empty())
+				continue;
+
+			std::sort(dvSample.begin(), dvSample.end());
+			fprintf(pf, "%-10s %-8s %7d %9.3f %9.3f %9.3f %9.3f\n",
+				iTarget == NUM_TARGETS ? "all" : s_szTargetNames[iTarget],
+				iTarget == NUM_TARGETS ? "all" : eventName(ivEvents[j]),
+				(int)dvSample.size(),
+				percentile(dvSample, 0.50), percentile(dvSample, 0.90),
+				percentile(dvSample, 0.99), dvSample.back());
+
+			if (iTarget == NUM_TARGETS)
+				break;
+		}
+	}
+}
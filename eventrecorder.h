@@ -0,0 +1,106 @@
+#ifndef EVENTRECORDER_H_INCLUDED
+#define EVENTRECORDER_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Fl_Widget;
+
+// EventRecorder logs the mouse events delivered to the graph widget,
+// the modeler view and the timeline widgets, with timestamps, and can
+// feed such a log back into the same widgets. During replay every event
+// is handled and the resulting redraw is flushed synchronously, and the
+// time this takes is reported as per-event latency percentiles.
+//
+// Log format: a header holding the session the events start from (see
+// ModelerUI::saveSession()), then one event per line:
+//   session <bytes>
+//   <the session, that many bytes>
+//   <seconds since start> <target> <fltk event> <x> <y> <button> <state> <value>
+// Slider targets only use <value>; the others only use x, y, button and
+// state. Logs without the header replay from whatever state the
+// application is in.
+class EventRecorder
+{
+public:
+	enum Target
+	{
+		GRAPH_WIDGET = 0,
+		MODELER_VIEW,
+		INDICATOR_WINDOW,
+		TIME_SLIDER,
+		PLAY_START_SLIDER,
+		PLAY_END_SLIDER,
+		NUM_TARGETS
+	};
+
+	// Fetch the global EventRecorder instance
+	static EventRecorder* Instance();
+
+	// The widgets events are replayed into
+	void target(Target target, Fl_Widget* pwndWidget);
+
+	// strSession is written to the log's header
+	bool startRecording(const char* szFileName, const std::string& strSession = "");
+	void stopRecording();
+	bool recording() const { return m_pfRecord != NULL; }
+	bool replaying() const { return m_bReplaying; }
+
+	// Called from the widgets' handle() functions and slider callbacks.
+	// Does nothing unless recording.
+	void record(Target target, int iEvent);
+	void recordValue(Target target, double dValue);
+
+	// Replay a log. With bPaced the recorded gaps between events are
+	// kept, otherwise events are fed back-to-back. The latency report
+	// is printed to stdout, and also written to szReportFile if given.
+	// When done the application's windows are hidden so Fl::run()
+	// returns.
+	// Events are only fed back once control returns to Fl::run(), so the
+	// caller restores the log's session() before the first one.
+	bool startReplay(const char* szFileName, bool bPaced, const char* szReportFile = NULL);
+	// the header of the log being replayed; empty if it has none
+	const std::string& session() const { return m_strSession; }
+	void report(FILE* pf) const;
+
+private:
+	EventRecorder();
+	EventRecorder(const EventRecorder&) {}
+	EventRecorder& operator=(const EventRecorder&) { return *this; }
+
+	struct Event
+	{
+		double m_dTime;
+		int m_iTarget;
+		int m_iEvent;
+		int m_iX, m_iY;
+		int m_iButton;
+		int m_iState;
+		double m_dValue;
+	};
+
+	static EventRecorder* m_instance;
+	static void cb_replay(void* p);
+	void replayNext();
+	void writeEvent(const Event& event);
+	void finishReplay();
+
+	Fl_Widget* m_pwndvTargets[NUM_TARGETS];
+
+	FILE* m_pfRecord;
+	double m_dRecordStart;
+
+	bool m_bReplaying;
+	bool m_bPaced;
+	std::string m_strReport;
+	std::string m_strSession;
+	std::vector<Event> m_evvReplay;
+	int m_iReplayNext;
+	// handling latency (seconds) of each replayed event, same order
+	std::vector<double> m_dvLatency;
+};
+
+#endif // EVENTRECORDER_H_INCLUDED
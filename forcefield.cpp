@@ -0,0 +1,192 @@
+#pragma warning(disable : 4786)
+
+#include <math.h>
+#include <string.h>
+
+#include "forcefield.h"
+#include "hash.h"
+
+void ConstantForce::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	const float fx = force[0], fy = force[1], fz = force[2];
+	for (int i = 0; i < in.n; i++) {
+		float inv = 1.0f / in.mass[i];
+		ax[i] += fx * inv;
+		ay[i] += fy * inv;
+		az[i] += fz * inv;
+	}
+}
+
+unsigned long long ConstantForce::hash(unsigned long long h) const
+{
+	return hashValue(force, hashBytes("ConstantForce", 13, h));
+}
+
+void Gravity::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	const float gx = acceleration[0], gy = acceleration[1], gz = acceleration[2];
+	for (int i = 0; i < in.n; i++) {
+		ax[i] += gx;
+		ay[i] += gy;
+		az[i] += gz;
+	}
+}
+
+unsigned long long Gravity::hash(unsigned long long h) const
+{
+	return hashValue(acceleration, hashBytes("Gravity", 7, h));
+}
+
+void LinearDrag::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	const float k = coefficient;
+	for (int i = 0; i < in.n; i++) {
+		float s = -k / in.mass[i];
+		ax[i] += s * in.vx[i];
+		ay[i] += s * in.vy[i];
+		az[i] += s * in.vz[i];
+	}
+}
+
+unsigned long long LinearDrag::hash(unsigned long long h) const
+{
+	return hashValue(coefficient, hashBytes("LinearDrag", 10, h));
+}
+
+void Damping::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	const float k = coefficient;
+	for (int i = 0; i < in.n; i++) {
+		ax[i] -= k * in.vx[i];
+		ay[i] -= k * in.vy[i];
+		az[i] -= k * in.vz[i];
+	}
+}
+
+unsigned long long Damping::hash(unsigned long long h) const
+{
+	return hashValue(coefficient, hashBytes("Damping", 7, h));
+}
+
+void PointAttractor::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	const float cx = center[0], cy = center[1], cz = center[2];
+	const float s = strength, e2 = softening * softening;
+	for (int i = 0; i < in.n; i++) {
+		float dx = cx - in.px[i], dy = cy - in.py[i], dz = cz - in.pz[i];
+		float r2 = dx * dx + dy * dy + dz * dz + e2;
+		// s * d / |d|^3
+		float f = s / (r2 * sqrtf(r2));
+		ax[i] += f * dx;
+		ay[i] += f * dy;
+		az[i] += f * dz;
+	}
+}
+
+unsigned long long PointAttractor::hash(unsigned long long h) const
+{
+	h = hashBytes("PointAttractor", 14, h);
+	h = hashValue(center, h);
+	h = hashValue(strength, h);
+	return hashValue(softening, h);
+}
+
+Vortex::Vortex(const Vec3f& c, const Vec3f& a, float s, float soft)
+	: center(c), axis(a), strength(s), softening(soft)
+{
+	axis.normalize();
+}
+
+void Vortex::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	const float cx = center[0], cy = center[1], cz = center[2];
+	const float kx = axis[0], ky = axis[1], kz = axis[2];
+	const float s = strength, e2 = softening * softening;
+	for (int i = 0; i < in.n; i++) {
+		float rx = in.px[i] - cx, ry = in.py[i] - cy, rz = in.pz[i] - cz;
+		// distance from the axis
+		float along = rx * kx + ry * ky + rz * kz;
+		rx -= along * kx; ry -= along * ky; rz -= along * kz;
+		float r2 = rx * rx + ry * ry + rz * rz + e2;
+		// tangent = axis x r, magnitude |r|, so scale by s / |r|^2
+		float f = s / r2;
+		ax[i] += f * (ky * rz - kz * ry);
+		ay[i] += f * (kz * rx - kx * rz);
+		az[i] += f * (kx * ry - ky * rx);
+	}
+}
+
+unsigned long long Vortex::hash(unsigned long long h) const
+{
+	h = hashBytes("Vortex", 6, h);
+	h = hashValue(center, h);
+	h = hashValue(axis, h);
+	h = hashValue(strength, h);
+	return hashValue(softening, h);
+}
+
+ForceField::~ForceField()
+{
+	clear();
+}
+
+ForceKernel* ForceField::add(ForceKernel* kernel, const char* name)
+{
+	kernels.push_back(kernel);
+	names.push_back(name ? name : "");
+	return kernel;
+}
+
+ForceKernel* ForceField::find(const char* name) const
+{
+	for (int i = 0; i < kernels.size(); i++) {
+		if (names[i] == name)
+			return kernels[i];
+	}
+	return NULL;
+}
+
+bool ForceField::remove(const char* name)
+{
+	for (int i = 0; i < kernels.size(); i++) {
+		if (names[i] == name) {
+			delete kernels[i];
+			kernels.erase(kernels.begin() + i);
+			names.erase(names.begin() + i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ForceField::clear()
+{
+	for (int i = 0; i < kernels.size(); i++)
+		delete kernels[i];
+	kernels.clear();
+	names.clear();
+}
+
+void ForceField::prepare(const ParticleState& s, ThreadPool* pool)
+{
+	for (int k = 0; k < kernels.size(); k++)
+		kernels[k]->prepare(s, pool);
+}
+
+void ForceField::evaluate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	if (in.n == 0)
+		return;
+	memset(ax, 0, in.n * sizeof(float));
+	memset(ay, 0, in.n * sizeof(float));
+	memset(az, 0, in.n * sizeof(float));
+	for (int k = 0; k < kernels.size(); k++)
+		kernels[k]->accumulate(in, ax, ay, az);
+}
+
+unsigned long long ForceField::hash(unsigned long long h) const
+{
+	for (int k = 0; k < kernels.size(); k++)
+		h = kernels[k]->hash(h);
+	return h;
+}
@@ -0,0 +1,135 @@
+#ifndef FORCEFIELD_H
+#define FORCEFIELD_H
+
+#pragma warning(disable : 4786)
+
+#include <string>
+#include <vector>
+#include "vec.h"
+
+class ParticleState;
+class ThreadPool;
+
+// The particle state a force kernel reads: n particles as component
+// arrays (see ParticleState). Integrators point this at whichever
+// intermediate state they are evaluating.
+struct ForceInput {
+	const float* px; const float* py; const float* pz;
+	const float* vx; const float* vy; const float* vz;
+	const float* mass;
+	int n;
+	int first;							// index of particle 0 in the whole state
+};
+
+// A force kernel adds its acceleration for a whole batch of particles
+// to ax, ay, az in one loop. There is one virtual call per kernel per
+// batch, none per particle.
+//
+// Kernels that need the whole state at once, such as interactions
+// between particles, do that work in prepare(), which is called with
+// the state at the start of every step, before it is split into
+// batches; accumulate() then looks up its batch by in.first.
+//
+// hash() folds the kernel's type and parameters into h; bakes are
+// cached under the hash of everything that shapes the simulation.
+class ForceKernel {
+public:
+	virtual ~ForceKernel() {}
+	virtual void prepare(const ParticleState& /*s*/, ThreadPool* /*pool*/) {}
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const = 0;
+	virtual unsigned long long hash(unsigned long long h) const = 0;
+};
+
+// Constant force: a = f / mass
+class ConstantForce : public ForceKernel {
+public:
+	ConstantForce(const Vec3f& f) : force(f) {}
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+	Vec3f force;
+};
+
+// Constant acceleration regardless of mass, e.g. gravity
+class Gravity : public ForceKernel {
+public:
+	Gravity(const Vec3f& g) : acceleration(g) {}
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+	Vec3f acceleration;
+};
+
+// Drag proportional to velocity: a = -k v / mass
+class LinearDrag : public ForceKernel {
+public:
+	LinearDrag(float k) : coefficient(k) {}
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+	float coefficient;
+};
+
+// Velocity damping regardless of mass: a = -k v
+class Damping : public ForceKernel {
+public:
+	Damping(float k) : coefficient(k) {}
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+	float coefficient;
+};
+
+// Pulls towards center with strength / distance^2; softening keeps
+// particles passing through the center finite
+class PointAttractor : public ForceKernel {
+public:
+	PointAttractor(const Vec3f& c, float s, float soft = 0.1f)
+		: center(c), strength(s), softening(soft) {}
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+	Vec3f center;
+	float strength;
+	float softening;
+};
+
+// Swirls particles around the line through center along axis, with
+// strength / distance from the axis
+class Vortex : public ForceKernel {
+public:
+	Vortex(const Vec3f& c, const Vec3f& a, float s, float soft = 0.1f);
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+	Vec3f center;
+	Vec3f axis;							// unit length
+	float strength;
+	float softening;
+};
+
+// ForceField is the registry of kernels acting on a particle system. It
+// owns the kernels; names are optional and only used for lookup.
+class ForceField {
+public:
+	ForceField() {}
+	~ForceField();
+
+	// takes ownership of kernel; returns it
+	ForceKernel* add(ForceKernel* kernel, const char* name = NULL);
+	ForceKernel* find(const char* name) const;
+	bool remove(const char* name);
+	void clear();
+	int size() const { return kernels.size(); }
+	ForceKernel* kernel(int i) const { return kernels[i]; }
+
+	// every kernel's prepare(), once per step
+	void prepare(const ParticleState& s, ThreadPool* pool = NULL);
+	// ax, ay, az = total acceleration on in's particles
+	void evaluate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	// all kernels' hashes, in order
+	unsigned long long hash(unsigned long long h) const;
+
+private:
+	ForceField(const ForceField&) {}
+	ForceField& operator=(const ForceField&) { return *this; }
+
+	std::vector<ForceKernel*> kernels;
+	std::vector<std::string> names;
+};
+
+#endif
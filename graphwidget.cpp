@@ -22,9 +22,10 @@
 #include <float.h>
 #include <fstream>
 
-#include "GraphWidget.h"
+#include "graphwidget.h"
+#include "eventrecorder.h"
 
-#include "LinearCurveEvaluator.h"
+#include "linearcurveevaluator.h"
 #include "beziercurveevaluator.h"
 #include "bsplinecurveevaluator.h"
 #include "catmullromcurveevaluator.h"
@@ -339,6 +340,8 @@ void GraphWidget::draw()
 
 int GraphWidget::handle(int event)
 {
+	EventRecorder::Instance()->record(EventRecorder::GRAPH_WIDGET, event);
+
 	switch (event) {
 	case FL_PUSH:
 		m_iMouseX = Fl::event_x();
@@ -1028,54 +1031,61 @@ bool GraphWidget::saveScript(const char* szFileName) const
 
 	ofsFile.open(szFileName, std::ios::out);
 	if (!ofsFile.fail()) {
-		ofsFile << m_fEndTime << std::endl;
-		ofsFile << m_pcrvvCurves.size() << std::endl;
-
-		for (int i = 0; i < m_pcrvvCurves.size(); ++i) {
-			ofsFile << m_ivCurveTypes[i] << std::endl;
-			m_pcrvvCurves[i]->toStream(ofsFile);
-		}
-
+		writeScript(ofsFile);
 		return true;
 	}
 
 	return false;
 }
 
+void GraphWidget::writeScript(std::ostream& os) const
+{
+	::writeScript(os, m_fEndTime, m_pcrvvCurves, m_ivCurveTypes);
+}
+
+unsigned long long GraphWidget::scriptHash() const
+{
+	return ::scriptHash(m_fEndTime, m_pcrvvCurves, m_ivCurveTypes);
+}
+
 bool GraphWidget::loadScript(const char* szFileName)
 {
 	std::ifstream ifsFile;
 
 	ifsFile.open(szFileName, std::ios::in);
-	if (!ifsFile.fail()) {
-		int iCurveCount;
-		float fEndTime;
+	if (!ifsFile.fail())
+		return readScript(ifsFile);
 
-		ifsFile >> fEndTime;
-		if (fEndTime <= 0.0f)
-			return false;
-		endTime(fEndTime);
+	return false;
+}
+
+bool GraphWidget::readScript(std::istream& is)
+{
+	int iCurveCount;
+	float fEndTime;
 
-		ifsFile >> iCurveCount;
+	is >> fEndTime;
+	if (fEndTime <= 0.0f)
+		return false;
+	endTime(fEndTime);
 
-		if (iCurveCount != m_pcrvvCurves.size()) {
+	is >> iCurveCount;
+
+	if (iCurveCount != m_pcrvvCurves.size()) {
 #ifdef _DEBUG
-			assert(0);
+		assert(0);
 #endif // _DEBUG
-			return false;
-		}
-
-		for (int i = 0; i < iCurveCount; ++i) {
-			int iType;
-			ifsFile >> iType;
-			curveType(i, iType);
-			m_pcrvvCurves[i]->fromStream(ifsFile);
-		}
+		return false;
+	}
 
-		return true;
+	for (int i = 0; i < iCurveCount; ++i) {
+		int iType;
+		is >> iType;
+		curveType(i, iType);
+		m_pcrvvCurves[i]->fromStream(is);
 	}
 
-	return false;
+	return true;
 }
 
 Point GraphWidget::windowToGrid( Point p ) {
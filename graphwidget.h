@@ -5,6 +5,7 @@
 #include <FL/Fl_Gl_Window.H>
 #include <FL/Fl_Menu_Button.H>
 #include <FL/Fl_Menu_Item.H>
+#include <iosfwd>
 #include <string>
 #include <vector>
 #ifdef _DEBUG
@@ -108,6 +109,12 @@ public:
 	const Curve* curve(int iCurve) const;
 	bool saveScript(const char* szFileName) const;
 	bool loadScript(const char* szFileName);
+	// the script as saveScript() and loadScript() store it, on a stream
+	void writeScript(std::ostream& os) const;
+	bool readScript(std::istream& is);
+	// hash of the script saveScript() would write: the end time and
+	// every curve
+	unsigned long long scriptHash() const;
 
 	void zoomAll();
 
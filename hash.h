@@ -0,0 +1,41 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// 64 bit FNV-1a, for fingerprinting settings (e.g. which simulation a
+// bake cache belongs to). Not for anything adversarial.
+const unsigned long long HASH_SEED = 14695981039346656037ULL;
+
+inline unsigned long long hashBytes(const void* p, size_t n, unsigned long long h = HASH_SEED)
+{
+	const unsigned char* b = (const unsigned char*)p;
+	for (size_t i = 0; i < n; i++) {
+		h ^= b[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+template <class T>
+inline unsigned long long hashValue(const T& v, unsigned long long h = HASH_SEED)
+{
+	return hashBytes(&v, sizeof(v), h);
+}
+
+// hash of a file's contents; h unchanged if it can't be read
+inline unsigned long long hashFile(const char* szFileName, unsigned long long h = HASH_SEED)
+{
+	FILE* pf = fopen(szFileName, "rb");
+	if (pf == NULL)
+		return h;
+	unsigned char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), pf)) > 0)
+		h = hashBytes(buffer, n, h);
+	fclose(pf);
+	return h;
+}
+
+#endif
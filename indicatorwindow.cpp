@@ -1,5 +1,5 @@
-#include <FL/fl.h>
-#include <FL/fl_draw.h>
+#include <FL/Fl.H>
+#include <FL/fl_draw.H>
 #include <algorithm>
 #include <float.h>
 #ifdef _DEBUG
@@ -7,6 +7,7 @@
 #endif // _DEBUG
 
 #include "indicatorwindow.h"
+#include "eventrecorder.h"
 
 const float IndicatorWindow::ks_fIndicatorNotFound = -FLT_MAX;
 
@@ -54,6 +55,8 @@ void IndicatorWindow::draw()
 
 int IndicatorWindow::handle(int iEvent)
 {
+	EventRecorder::Instance()->record(EventRecorder::INDICATOR_WINDOW, iEvent);
+
 	switch (iEvent) {
 	case FL_PUSH:
 		switch (Fl::event_button()) {
@@ -4,7 +4,7 @@
 #pragma warning(disable : 4786)
 
 #include <vector>
-#include <FL/Fl_Double_Window.h>
+#include <FL/Fl_Double_Window.H>
 
 class IndicatorWindow : public Fl_Double_Window
 {
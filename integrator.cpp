@@ -0,0 +1,426 @@
+#pragma warning(disable : 4786)
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "integrator.h"
+#include "particlestate.h"
+#include "forcefield.h"
+#include "threadpool.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define INTEGRATOR_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC accepts AVX intrinsics in any function
+#define AVX_FUNCTION
+#else
+#define AVX_FUNCTION __attribute__((target("avx")))
+#endif
+#endif
+
+/******************
+ * Array kernels
+ ******************/
+
+// out[i] = a[i] + h * b[i]; out may alias a or b
+
+static void maddScalar(float* out, const float* a, const float* b, float h, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = a[i] + h * b[i];
+}
+
+#ifdef INTEGRATOR_X86
+static void maddSse(float* out, const float* a, const float* b, float h, int n)
+{
+	__m128 vh = _mm_set1_ps(h);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 r = _mm_add_ps(_mm_loadu_ps(a + i), _mm_mul_ps(vh, _mm_loadu_ps(b + i)));
+		_mm_storeu_ps(out + i, r);
+	}
+	for (; i < n; i++)
+		out[i] = a[i] + h * b[i];
+}
+
+AVX_FUNCTION static void maddAvx(float* out, const float* a, const float* b, float h, int n)
+{
+	__m256 vh = _mm256_set1_ps(h);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 r = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_mul_ps(vh, _mm256_loadu_ps(b + i)));
+		_mm256_storeu_ps(out + i, r);
+	}
+	for (; i < n; i++)
+		out[i] = a[i] + h * b[i];
+}
+
+static bool cpuHasAvx()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	// AVX, and the OS saves the YMM registers (OSXSAVE + XCR0 bits 1, 2)
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	return avx && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+	return __builtin_cpu_supports("avx") != 0;
+#endif
+}
+#endif // INTEGRATOR_X86
+
+/******************
+ * Integrator
+ ******************/
+
+static const char* s_schemeNames[Integrator::NUM_SCHEMES] = {
+	"euler", "midpoint", "rk4", "verlet", "dopri5"
+};
+
+static const char* s_simdNames[Integrator::NUM_SIMD] = {
+	"scalar", "sse", "avx"
+};
+
+Integrator::Integrator(Scheme s)
+	: current(s), tol(1e-3f), accepted(0), rejected(0)
+{
+	simd(bestSimd());
+}
+
+const char* Integrator::schemeName(Scheme s)
+{
+	return (s >= 0 && s < NUM_SCHEMES) ? s_schemeNames[s] : "";
+}
+
+Integrator::Scheme Integrator::schemeByName(const char* name)
+{
+	for (int s = 0; s < NUM_SCHEMES; s++) {
+		if (strcmp(name, s_schemeNames[s]) == 0)
+			return (Scheme)s;
+	}
+	return NUM_SCHEMES;
+}
+
+const char* Integrator::simdName(Simd l)
+{
+	return (l >= 0 && l < NUM_SIMD) ? s_simdNames[l] : "";
+}
+
+Integrator::Simd Integrator::bestSimd()
+{
+#ifdef INTEGRATOR_X86
+	static int best = -1;
+	if (best < 0)
+		best = cpuHasAvx() ? SIMD_AVX : SIMD_SSE;
+	return (Simd)best;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+void Integrator::simd(Simd l)
+{
+	if (l > bestSimd())
+		l = bestSimd();
+	level = l;
+	switch (level) {
+#ifdef INTEGRATOR_X86
+	case SIMD_AVX: madd = maddAvx; break;
+	case SIMD_SSE: madd = maddSse; break;
+#endif
+	default: madd = maddScalar; break;
+	}
+}
+
+void Integrator::madd3(float** out, float* const* a, float* const* b, float h, int n)
+{
+	for (int c = 0; c < 3; c++)
+		madd(out[c], a[c], b[c], h, n);
+}
+
+void Integrator::step(ParticleState& s, const ForceField& forces, float dt, ThreadPool* pool)
+{
+	int n = s.size();
+	if (n == 0)
+		return;
+	if (current == DOPRI5) {
+		stepAdaptive(s, forces, dt, pool);
+		return;
+	}
+	// sized here, once, as chunks share the arrays
+	for (int i = 0; i < 15; i++) {
+		if (scratch[i].size() < n)
+			scratch[i].resize(n);
+	}
+
+	if (pool == NULL || pool->threads() == 1 || n <= CHUNK) {
+		stepRange(s, forces, dt, 0, n);
+		return;
+	}
+	pool->forRange(n, CHUNK, [&](int begin, int end) {
+		stepRange(s, forces, dt, begin, end);
+	});
+}
+
+void Integrator::stepRange(ParticleState& s, const ForceField& forces, float dt, int begin, int end)
+{
+	switch (current) {
+	case EULER: euler(s, forces, dt, begin, end); break;
+	case MIDPOINT: midpoint(s, forces, dt, begin, end); break;
+	case VELOCITY_VERLET: velocityVerlet(s, forces, dt, begin, end); break;
+	default: rk4(s, forces, dt, begin, end); break;
+	}
+}
+
+// The schemes below are written over x, v (the state), a (acceleration),
+// xt, vt (an intermediate state) and accX, accV (RK4 sums), each a set
+// of three component arrays, all offset to the first particle of the
+// range.
+
+#define SCHEME_ARRAYS \
+	int n = end - begin; \
+	float* x[3] = { s.px + begin, s.py + begin, s.pz + begin }; \
+	float* v[3] = { s.vx + begin, s.vy + begin, s.vz + begin }; \
+	float* a[3] = { &scratch[0][begin], &scratch[1][begin], &scratch[2][begin] }; \
+	ForceInput in = { x[0], x[1], x[2], v[0], v[1], v[2], s.mass + begin, n, begin }
+
+// the intermediate state, for the schemes that evaluate forces there
+#define MID_ARRAYS \
+	float* xt[3] = { &scratch[3][begin], &scratch[4][begin], &scratch[5][begin] }; \
+	float* vt[3] = { &scratch[6][begin], &scratch[7][begin], &scratch[8][begin] }; \
+	ForceInput mid = { xt[0], xt[1], xt[2], vt[0], vt[1], vt[2], s.mass + begin, n, begin }
+
+void Integrator::euler(ParticleState& s, const ForceField& forces, float dt, int begin, int end)
+{
+	SCHEME_ARRAYS;
+
+	forces.evaluate(in, a[0], a[1], a[2]);
+	madd3(x, x, v, dt, n);
+	madd3(v, v, a, dt, n);
+}
+
+void Integrator::midpoint(ParticleState& s, const ForceField& forces, float dt, int begin, int end)
+{
+	SCHEME_ARRAYS;
+	MID_ARRAYS;
+
+	forces.evaluate(in, a[0], a[1], a[2]);
+	madd3(xt, x, v, 0.5f * dt, n);
+	madd3(vt, v, a, 0.5f * dt, n);
+	forces.evaluate(mid, a[0], a[1], a[2]);
+	madd3(x, x, vt, dt, n);
+	madd3(v, v, a, dt, n);
+}
+
+void Integrator::rk4(ParticleState& s, const ForceField& forces, float dt, int begin, int end)
+{
+	SCHEME_ARRAYS;
+	MID_ARRAYS;
+	float* accX[3] = { &scratch[9][begin], &scratch[10][begin], &scratch[11][begin] };
+	float* accV[3] = { &scratch[12][begin], &scratch[13][begin], &scratch[14][begin] };
+	float h = 0.5f * dt;
+
+	// k1 = (v, a(x, v))
+	forces.evaluate(in, a[0], a[1], a[2]);
+	for (int c = 0; c < 3; c++) {
+		memcpy(accX[c], v[c], n * sizeof(float));
+		memcpy(accV[c], a[c], n * sizeof(float));
+	}
+
+	// k2 at x + dt/2 k1, then k3 at x + dt/2 k2
+	madd3(xt, x, v, h, n);
+	madd3(vt, v, a, h, n);
+	for (int k = 0; k < 2; k++) {
+		forces.evaluate(mid, a[0], a[1], a[2]);
+		madd3(accX, accX, vt, 2.0f, n);
+		madd3(accV, accV, a, 2.0f, n);
+		// next stage; xt is built from vt before vt is replaced
+		if (k == 0) {
+			madd3(xt, x, vt, h, n);
+			madd3(vt, v, a, h, n);
+		}
+	}
+
+	// k4 at x + dt k3
+	madd3(xt, x, vt, dt, n);
+	madd3(vt, v, a, dt, n);
+	forces.evaluate(mid, a[0], a[1], a[2]);
+	madd3(accX, accX, vt, 1.0f, n);
+	madd3(accV, accV, a, 1.0f, n);
+
+	// x += dt/6 (k1 + 2 k2 + 2 k3 + k4)
+	madd3(x, x, accX, dt / 6.0f, n);
+	madd3(v, v, accV, dt / 6.0f, n);
+}
+
+void Integrator::velocityVerlet(ParticleState& s, const ForceField& forces, float dt, int begin, int end)
+{
+	SCHEME_ARRAYS;
+	float* vt[3] = { &scratch[6][begin], &scratch[7][begin], &scratch[8][begin] };
+	float* a0[3] = { &scratch[12][begin], &scratch[13][begin], &scratch[14][begin] };
+
+	// x += v dt + a dt^2 / 2
+	forces.evaluate(in, a0[0], a0[1], a0[2]);
+	madd3(x, x, v, dt, n);
+	madd3(x, x, a0, 0.5f * dt * dt, n);
+
+	// a at the new position; velocity dependent forces see the
+	// Euler predicted velocity
+	madd3(vt, v, a0, dt, n);
+	ForceInput predicted = { x[0], x[1], x[2], vt[0], vt[1], vt[2], s.mass + begin, n, begin };
+	forces.evaluate(predicted, a[0], a[1], a[2]);
+
+	// v += (a0 + a) dt / 2
+	madd3(v, v, a0, 0.5f * dt, n);
+	madd3(v, v, a, 0.5f * dt, n);
+}
+
+/******************
+ * Dormand-Prince
+ ******************/
+
+// The Dormand-Prince 5(4) tableau: row k holds stage k + 1's weights on
+// stages 0 .. k; the last row, the 5th order solution's, is also the
+// last stage (first same as last)
+static const float s_dpA[6][6] = {
+	{ 1.0f / 5 },
+	{ 3.0f / 40, 9.0f / 40 },
+	{ 44.0f / 45, -56.0f / 15, 32.0f / 9 },
+	{ 19372.0f / 6561, -25360.0f / 2187, 64448.0f / 6561, -212.0f / 729 },
+	{ 9017.0f / 3168, -355.0f / 33, 46732.0f / 5247, 49.0f / 176, -5103.0f / 18656 },
+	{ 35.0f / 384, 0, 500.0f / 1113, 125.0f / 192, -2187.0f / 6784, 11.0f / 84 }
+};
+
+// 5th minus 4th order weights of the 7 stages: the error estimate
+static const float s_dpE[7] = {
+	71.0f / 57600, 0, -71.0f / 16695, 71.0f / 1920, -17253.0f / 339200, 22.0f / 525, -1.0f / 40
+};
+
+// position, then 6 stage velocities and 7 stage accelerations
+static const int s_dpArrays = 3 + 6 * 3 + 7 * 3;
+
+void Integrator::stepAdaptive(ParticleState& s, const ForceField& forces, float dt, ThreadPool* pool)
+{
+	if (dt == 0)
+		return;
+	int n = s.size();
+	int chunks = (n + CHUNK - 1) / CHUNK;
+	if (stages.size() < s_dpArrays * n)
+		stages.resize(s_dpArrays * n);
+	// chunks new to this step start from a whole step
+	substep.resize(chunks, 0.0f);
+	chunkAccepted.assign(chunks, 0);
+	chunkRejected.assign(chunks, 0);
+
+	auto stepChunk = [&](int begin, int end) {
+		int c = begin / CHUNK;
+		dopri5(s, forces, dt, c, begin, end, chunkAccepted[c], chunkRejected[c]);
+	};
+	if (pool == NULL || pool->threads() == 1) {
+		for (int begin = 0; begin < n; begin += CHUNK)
+			stepChunk(begin, begin + CHUNK < n ? begin + CHUNK : n);
+	}
+	else
+		pool->forRange(n, CHUNK, stepChunk);
+
+	for (int c = 0; c < chunks; c++) {
+		accepted += chunkAccepted[c];
+		rejected += chunkRejected[c];
+	}
+}
+
+void Integrator::dopri5(ParticleState& s, const ForceField& forces, float dt, int chunk,
+	int begin, int end, int& taken, int& failed)
+{
+	int n = end - begin;
+	int size = s.size();
+	float* x[3] = { s.px + begin, s.py + begin, s.pz + begin };
+	float* v[3] = { s.vx + begin, s.vy + begin, s.vz + begin };
+
+	// stage k's velocity kv[k] and acceleration ka[k]. kv[0] is v, and
+	// xt with kv[6] is the 5th order solution
+	float* xt[3];
+	float* kv[7][3];
+	float* ka[7][3];
+	int next = 0;
+	for (int c = 0; c < 3; c++)
+		xt[c] = &stages[(next++) * size + begin];
+	for (int k = 0; k < 7; k++) {
+		for (int c = 0; c < 3; c++) {
+			kv[k][c] = k == 0 ? v[c] : &stages[(next++) * size + begin];
+			ka[k][c] = &stages[(next++) * size + begin];
+		}
+	}
+
+	ForceInput in = { x[0], x[1], x[2], v[0], v[1], v[2], s.mass + begin, n, begin };
+	forces.evaluate(in, ka[0][0], ka[0][1], ka[0][2]);
+
+	float remaining = dt;
+	float h = substep[chunk] > 0 ? substep[chunk] : fabsf(dt);
+	float shortest = fabsf(dt) / MAX_SUBSTEPS;
+	taken = failed = 0;
+	while (remaining != 0) {
+		bool last = h >= fabsf(remaining);
+		float hs = last ? remaining : (dt > 0 ? h : -h);
+
+		for (int k = 1; k < 7; k++) {
+			const float* row = s_dpA[k - 1];
+			madd3(xt, x, kv[0], hs * row[0], n);
+			madd3(kv[k], v, ka[0], hs * row[0], n);
+			for (int j = 1; j < k; j++) {
+				if (row[j] == 0)
+					continue;
+				madd3(xt, xt, kv[j], hs * row[j], n);
+				madd3(kv[k], kv[k], ka[j], hs * row[j], n);
+			}
+			ForceInput stage = { xt[0], xt[1], xt[2], kv[k][0], kv[k][1], kv[k][2], s.mass + begin, n, begin };
+			forces.evaluate(stage, ka[k][0], ka[k][1], ka[k][2]);
+		}
+
+		// largest error over the chunk, in tolerances
+		float err = 0;
+		for (int c = 0; c < 3; c++) {
+			for (int i = 0; i < n; i++) {
+				float ex = 0, ev = 0;
+				for (int k = 0; k < 7; k++) {
+					ex += s_dpE[k] * kv[k][c][i];
+					ev += s_dpE[k] * ka[k][c][i];
+				}
+				float sx = tol * (1 + std::max(fabsf(x[c][i]), fabsf(xt[c][i])));
+				float sv = tol * (1 + std::max(fabsf(v[c][i]), fabsf(kv[6][c][i])));
+				err = std::max(err, std::max(fabsf(hs * ex) / sx, fabsf(hs * ev) / sv));
+			}
+		}
+
+		// the usual controller for a 5th order step; NaN, from a step
+		// that blew up, shrinks it all the way
+		float factor = 5.0f;
+		if (err != err)
+			factor = 0.2f;
+		else if (err > 0)
+			factor = std::min(5.0f, std::max(0.2f, 0.9f * powf(err, -0.2f)));
+
+		if (err <= 1 || fabsf(hs) <= shortest) {
+			for (int c = 0; c < 3; c++) {
+				memcpy(x[c], xt[c], n * sizeof(float));
+				memcpy(v[c], kv[6][c], n * sizeof(float));
+				memcpy(ka[0][c], ka[6][c], n * sizeof(float));
+			}
+			remaining = last ? 0 : remaining - hs;
+			// a last substep cut short says little about the next one
+			float proposed = fabsf(hs) * factor;
+			if (!last || proposed < h)
+				h = proposed;
+			taken++;
+		}
+		else {
+			h = std::max(fabsf(hs) * factor, shortest);
+			failed++;
+		}
+	}
+	substep[chunk] = h;
+}
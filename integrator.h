@@ -0,0 +1,119 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+
+class ParticleState;
+class ForceField;
+class ThreadPool;
+
+// Integrator advances a whole ParticleState by one time step under a
+// ForceField. All schemes are written as sweeps over the component
+// arrays: one force field evaluation per stage, then y = a + h * b
+// updates, which run 8 (AVX) or 4 (SSE) particles per instruction when
+// the CPU supports it. Scratch arrays are kept between steps.
+//
+// Given a ThreadPool, a step is split into fixed size chunks of particles
+// that are integrated independently. Every particle's update only reads
+// its own entries, so the result is the same for any number of threads.
+//
+// DOPRI5 is adaptive: it splits a step into as many substeps as the
+// tolerance requires, taking the Dormand-Prince pair's embedded 4th
+// order solution as its error estimate. Each chunk picks its own
+// substeps, starting from the size it ended its previous step with, so
+// a calm chunk takes one substep while a stiff one takes many. Chunks
+// are always the same, with or without a pool.
+class Integrator {
+public:
+	enum Scheme {
+		EULER = 0,						// explicit Euler, 1 force evaluation
+		MIDPOINT,						// 2nd order Runge-Kutta, 2 evaluations
+		RK4,							// classic 4th order Runge-Kutta, 4 evaluations
+		VELOCITY_VERLET,				// 2 evaluations, good energy behaviour
+		DOPRI5,							// adaptive 5th order Runge-Kutta, 6 evaluations per substep
+		NUM_SCHEMES
+	};
+
+	enum Simd {
+		SIMD_NONE = 0,
+		SIMD_SSE,
+		SIMD_AVX,
+		NUM_SIMD
+	};
+
+	Integrator(Scheme s = RK4);
+
+	void scheme(Scheme s) { current = s; }
+	Scheme scheme() const { return current; }
+	static const char* schemeName(Scheme s);
+	// returns NUM_SCHEMES if name is not a scheme
+	static Scheme schemeByName(const char* name);
+
+	// Instruction set for the array updates; defaults to the best the
+	// CPU supports, and requests above that are lowered
+	void simd(Simd level);
+	Simd simd() const { return level; }
+	static Simd bestSimd();
+	static const char* simdName(Simd level);
+
+	// DOPRI5's error bound per substep, relative to 1 + the magnitude of
+	// each position and velocity component
+	void tolerance(float t) { tol = t > 0 ? t : 1e-6f; }
+	float tolerance() const { return tol; }
+
+	void step(ParticleState& s, const ForceField& forces, float dt, ThreadPool* pool = NULL);
+
+	// DOPRI5 substeps, summed over chunks, since the last reset
+	int acceptedSteps() const { return accepted; }
+	int rejectedSteps() const { return rejected; }
+	void resetStepCounts() { accepted = rejected = 0; }
+	// DOPRI5's substep size for each chunk, which the next step starts
+	// from; part of the state to restore to resume a simulation exactly
+	const std::vector<float>& substepSizes() const { return substep; }
+	void substepSizes(const std::vector<float>& sizes) { substep = sizes; }
+
+	// particles per chunk; a multiple of the widest SIMD width so chunk
+	// boundaries never change which particles take the scalar tail
+	enum { CHUNK = 4096 };
+
+private:
+	typedef void (*Madd_f)(float* out, const float* a, const float* b, float h, int n);
+
+	// the schemes, on particles [begin, end)
+	void stepRange(ParticleState& s, const ForceField& forces, float dt, int begin, int end);
+	void euler(ParticleState& s, const ForceField& forces, float dt, int begin, int end);
+	void midpoint(ParticleState& s, const ForceField& forces, float dt, int begin, int end);
+	void rk4(ParticleState& s, const ForceField& forces, float dt, int begin, int end);
+	void velocityVerlet(ParticleState& s, const ForceField& forces, float dt, int begin, int end);
+	void stepAdaptive(ParticleState& s, const ForceField& forces, float dt, ThreadPool* pool);
+	// on chunk c; returns its substeps taken and rejected
+	void dopri5(ParticleState& s, const ForceField& forces, float dt, int c, int begin, int end,
+		int& taken, int& failed);
+
+	// out = a + h * b on all three components
+	void madd3(float** out, float* const* a, float* const* b, float h, int n);
+
+	Scheme current;
+	Simd level;
+	Madd_f madd;
+
+	// scratch: accelerations, intermediate positions and velocities,
+	// RK4 accumulators; x, y, z each
+	std::vector<float> scratch[15];
+
+	// substeps shorter than dt / MAX_SUBSTEPS are accepted whatever
+	// their error, so a step always ends
+	enum { MAX_SUBSTEPS = 1024 };
+
+	// DOPRI5: tolerance, stage arrays, each chunk's next substep size
+	// and counts in the last step, and the counts' sums
+	float tol;
+	std::vector<float> stages;
+	std::vector<float> substep;
+	std::vector<int> chunkAccepted, chunkRejected;
+	int accepted, rejected;
+};
+
+#endif
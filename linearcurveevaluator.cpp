@@ -1,4 +1,4 @@
-#include "LinearCurveEvaluator.h"
+#include "linearcurveevaluator.h"
 #include <assert.h>
 
 void LinearCurveEvaluator::evaluateCurve(const std::vector<Point>& ptvCtrlPts, 
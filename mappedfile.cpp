@@ -0,0 +1,107 @@
+#pragma warning(disable : 4786)
+
+#include <algorithm>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mappedfile.h"
+
+MappedFile::MappedFile()
+	: base(NULL), length(0), mtime(0)
+{
+#ifdef WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* szFileName)
+{
+	close();
+#ifdef WIN32
+	file = CreateFileA(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER liSize;
+	if (!GetFileSizeEx(file, &liSize) || liSize.QuadPart == 0 ||
+		(unsigned long long)liSize.QuadPart > (size_t)-1) {
+		close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		close();
+		return false;
+	}
+	base = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (base == NULL) {
+		close();
+		return false;
+	}
+	length = (size_t)liSize.QuadPart;
+	FILETIME ftWrite;
+	if (GetFileTime(file, NULL, NULL, &ftWrite))
+		mtime = ((unsigned long long)ftWrite.dwHighDateTime << 32) | ftWrite.dwLowDateTime;
+#else
+	int fd = ::open(szFileName, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// the mapping keeps the file alive
+	::close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	base = (const unsigned char*)p;
+	length = st.st_size;
+	mtime = (unsigned long long)st.st_mtime;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef WIN32
+	if (base)
+		UnmapViewOfFile(base);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+#else
+	if (base)
+		munmap((void*)base, length);
+#endif
+	base = NULL;
+	length = 0;
+	mtime = 0;
+}
+
+void MappedFile::swap(MappedFile& other)
+{
+	std::swap(base, other.base);
+	std::swap(length, other.length);
+	std::swap(mtime, other.mtime);
+#ifdef WIN32
+	std::swap(file, other.file);
+	std::swap(mapping, other.mapping);
+#endif
+}
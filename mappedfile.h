@@ -0,0 +1,40 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#pragma warning(disable : 4786)
+
+#include <stddef.h>
+
+// A whole file mapped read-only into memory. Pages are read from disk
+// when first touched, so a large file costs only what is looked at.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char* szFileName);
+	void close();
+	bool isOpen() const { return base != NULL; }
+
+	const unsigned char* data() const { return base; }
+	size_t size() const { return length; }
+	// the file's last write time when opened, in the platform's units;
+	// only good for telling versions of a file apart
+	unsigned long long modified() const { return mtime; }
+
+	void swap(MappedFile& other);
+
+private:
+	MappedFile(const MappedFile&) {}
+	MappedFile& operator=(const MappedFile&) { return *this; }
+
+	const unsigned char* base;
+	size_t length;
+	unsigned long long mtime;
+#ifdef WIN32
+	void* file;							// HANDLEs
+	void* mapping;
+#endif
+};
+
+#endif
@@ -384,10 +384,21 @@ inline void swap(Mat3<T>& a, Mat3<T>& b) {
 //	swap( a.v[2], b.v[2] );
 }
 
+// Rotation by angle (radians) about the axis (x, y, z), same as glRotate
 template <class T>
 inline Mat4<T> Mat4<T>::createRotation( T angle, float x, float y, float z ) {
 	Mat4<T> rot;
 
+	T len = (T)sqrt( x*x + y*y + z*z );
+	if( len == 0 )
+		return rot;
+	T ax = x / len, ay = y / len, az = z / len;
+	T c = (T)cos( angle ), s = (T)sin( angle ), t = 1 - c;
+
+	rot[0][0] = t*ax*ax + c;    rot[0][1] = t*ax*ay - s*az; rot[0][2] = t*ax*az + s*ay;
+	rot[1][0] = t*ax*ay + s*az; rot[1][1] = t*ay*ay + c;    rot[1][2] = t*ay*az - s*ax;
+	rot[2][0] = t*ax*az - s*ay; rot[2][1] = t*ay*az + s*ax; rot[2][2] = t*az*az + c;
+
 	return rot;
 }
 
@@ -395,6 +406,8 @@ template <class T>
 inline Mat4<T> Mat4<T>::createTranslation( T x, T y, T z ) {
 	Mat4<T> trans;
 
+	trans[0][3] = x; trans[1][3] = y; trans[2][3] = z;
+
 	return trans;
 }
 
@@ -402,6 +415,8 @@ template <class T>
 inline Mat4<T> Mat4<T>::createScale( T sx, T sy, T sz ) {
 	Mat4<T> scale;
 
+	scale[0][0] = sx; scale[1][1] = sy; scale[2][2] = sz;
+
 	return scale;
 }
 
@@ -0,0 +1,557 @@
+#pragma warning(disable : 4786)
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "modelcollider.h"
+#include "particlestate.h"
+#include "threadpool.h"
+#include "integrator.h"
+#include "hash.h"
+
+namespace {
+
+enum { LEAF_SIZE = 4, STACK_DEPTH = 64 };
+
+// particles are put back this far outside the surface they hit
+const float SKIN = 1e-3f;
+
+// 3x4 affine matrices, row major: a[r * 4 + c], translation in column 3
+
+void fromGl(const float m[16], float a[12])
+{
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++)
+			a[r * 4 + c] = m[c * 4 + r];
+	}
+}
+
+void multiply(const float a[12], const float b[12], float out[12])
+{
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++) {
+			float v = a[r * 4] * b[c] + a[r * 4 + 1] * b[4 + c] + a[r * 4 + 2] * b[8 + c];
+			out[r * 4 + c] = (c == 3) ? v + a[r * 4 + 3] : v;
+		}
+	}
+}
+
+bool invert(const float a[12], float out[12])
+{
+	// inverse of the linear part by cofactors, then the translation
+	float c00 = a[5] * a[10] - a[6] * a[9];
+	float c01 = a[6] * a[8] - a[4] * a[10];
+	float c02 = a[4] * a[9] - a[5] * a[8];
+	float det = a[0] * c00 + a[1] * c01 + a[2] * c02;
+	if (fabsf(det) < 1e-12f)
+		return false;
+	float inv = 1.0f / det;
+	out[0] = c00 * inv;
+	out[1] = (a[2] * a[9] - a[1] * a[10]) * inv;
+	out[2] = (a[1] * a[6] - a[2] * a[5]) * inv;
+	out[4] = c01 * inv;
+	out[5] = (a[0] * a[10] - a[2] * a[8]) * inv;
+	out[6] = (a[2] * a[4] - a[0] * a[6]) * inv;
+	out[8] = c02 * inv;
+	out[9] = (a[1] * a[8] - a[0] * a[9]) * inv;
+	out[10] = (a[0] * a[5] - a[1] * a[4]) * inv;
+	for (int r = 0; r < 3; r++)
+		out[r * 4 + 3] = -(out[r * 4] * a[3] + out[r * 4 + 1] * a[7] + out[r * 4 + 2] * a[11]);
+	return true;
+}
+
+void transform(const float a[12], const float p[3], float out[3])
+{
+	for (int r = 0; r < 3; r++)
+		out[r] = a[r * 4] * p[0] + a[r * 4 + 1] * p[1] + a[r * 4 + 2] * p[2] + a[r * 4 + 3];
+}
+
+void expand(float b[6], const float p[3])
+{
+	for (int c = 0; c < 3; c++) {
+		if (p[c] < b[c]) b[c] = p[c];
+		if (p[c] > b[c + 3]) b[c + 3] = p[c];
+	}
+}
+
+void empty(float b[6])
+{
+	b[0] = b[1] = b[2] = FLT_MAX;
+	b[3] = b[4] = b[5] = -FLT_MAX;
+}
+
+void merge(float b[6], const float other[6])
+{
+	expand(b, other);
+	expand(b, other + 3);
+}
+
+bool overlaps(const float a[6], const float b[6])
+{
+	return a[0] <= b[3] && a[3] >= b[0] && a[1] <= b[4] && a[4] >= b[1]
+		&& a[2] <= b[5] && a[5] >= b[2];
+}
+
+}
+
+ModelCollider::ModelCollider()
+	: restitution(0.5f), friction(0.2f), count(0), built(0), builtArea(0), refit(false), found(0)
+{
+	for (int i = 0; i < 12; i++)
+		worldFromEye[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+void ModelCollider::begin(const float eye[16])
+{
+	float a[12];
+	fromGl(eye, a);
+	if (!invert(a, worldFromEye)) {
+		for (int i = 0; i < 12; i++)
+			worldFromEye[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+	}
+	count = 0;
+}
+
+ModelCollider::Primitive& ModelCollider::add(int shape, const float mv[16])
+{
+	if (count == prims.size())
+		prims.push_back(Primitive());
+	Primitive& p = prims[count++];
+	p.shape = shape;
+	float eye[12];
+	fromGl(mv, eye);
+	multiply(worldFromEye, eye, p.toWorld);
+	// a primitive squashed flat has no inside; it can't be hit
+	if (!invert(p.toWorld, p.toLocal)) {
+		for (int i = 0; i < 12; i++)
+			p.toLocal[i] = 0;
+	}
+	return p;
+}
+
+void ModelCollider::addSphere(const float mv[16], float r)
+{
+	Primitive& p = add(SPHERE, mv);
+	p.size[0] = r;
+	bound(p);
+}
+
+void ModelCollider::addBox(const float mv[16], float x, float y, float z)
+{
+	Primitive& p = add(BOX, mv);
+	p.size[0] = x; p.size[1] = y; p.size[2] = z;
+	bound(p);
+}
+
+void ModelCollider::addCylinder(const float mv[16], float h, float r1, float r2)
+{
+	Primitive& p = add(CYLINDER, mv);
+	p.size[0] = h; p.size[1] = r1; p.size[2] = r2;
+	bound(p);
+}
+
+void ModelCollider::addTriangle(const float mv[16], const float v[9])
+{
+	// triangles are kept in world space, and tested there
+	Primitive& p = add(TRIANGLE, mv);
+	for (int k = 0; k < 3; k++)
+		transform(p.toWorld, v + 3 * k, p.size + 3 * k);
+	bound(p);
+}
+
+void ModelCollider::bound(Primitive& p) const
+{
+	empty(p.bounds);
+	if (p.shape == TRIANGLE) {
+		for (int k = 0; k < 3; k++)
+			expand(p.bounds, p.size + 3 * k);
+		return;
+	}
+
+	// the corners of the shape's local box, taken to world space
+	float lo[3], hi[3];
+	if (p.shape == SPHERE) {
+		float r = fabsf(p.size[0]);
+		lo[0] = lo[1] = lo[2] = -r;
+		hi[0] = hi[1] = hi[2] = r;
+	} else if (p.shape == BOX) {
+		for (int c = 0; c < 3; c++) {
+			lo[c] = p.size[c] < 0 ? p.size[c] : 0;
+			hi[c] = p.size[c] > 0 ? p.size[c] : 0;
+		}
+	} else {
+		float r = fabsf(p.size[1]) > fabsf(p.size[2]) ? fabsf(p.size[1]) : fabsf(p.size[2]);
+		lo[0] = lo[1] = -r;
+		hi[0] = hi[1] = r;
+		lo[2] = p.size[0] < 0 ? p.size[0] : 0;
+		hi[2] = p.size[0] > 0 ? p.size[0] : 0;
+	}
+	for (int k = 0; k < 8; k++) {
+		float corner[3] = { (k & 1) ? hi[0] : lo[0], (k & 2) ? hi[1] : lo[1], (k & 4) ? hi[2] : lo[2] };
+		float w[3];
+		transform(p.toWorld, corner, w);
+		expand(p.bounds, w);
+	}
+}
+
+void ModelCollider::clear()
+{
+	count = 0;
+	end();
+}
+
+void ModelCollider::end()
+{
+	bool same = count == built;
+	for (int i = 0; same && i < count; i++)
+		same = prims[i].shape == shapes[i];
+
+	refit = false;
+	if (same && count > 0) {
+		refitNodes();
+		// moved parts can stretch boxes over empty space; past twice the
+		// area the hierarchy was built with, a rebuild pays for itself
+		refit = area(nodes[0].bounds) <= 2.0f * builtArea;
+	}
+	if (refit)
+		return;
+
+	order.resize(count);
+	shapes.resize(count);
+	for (int i = 0; i < count; i++) {
+		order[i] = i;
+		shapes[i] = prims[i].shape;
+	}
+	nodes.clear();
+	nodes.reserve(2 * count);
+	if (count > 0)
+		build(0, count);
+	built = count;
+	builtArea = count > 0 ? area(nodes[0].bounds) : 0;
+}
+
+float ModelCollider::area(const float b[6]) const
+{
+	float x = b[3] - b[0], y = b[4] - b[1], z = b[5] - b[2];
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+int ModelCollider::build(int begin, int end)
+{
+	int index = nodes.size();
+	nodes.push_back(Node());
+
+	float bounds[6], centers[6];
+	empty(bounds);
+	empty(centers);
+	for (int k = begin; k < end; k++) {
+		const float* b = prims[order[k]].bounds;
+		float c[3] = { b[0] + b[3], b[1] + b[4], b[2] + b[5] };
+		merge(bounds, b);
+		expand(centers, c);
+	}
+	for (int c = 0; c < 6; c++)
+		nodes[index].bounds[c] = bounds[c];
+
+	if (end - begin <= LEAF_SIZE) {
+		nodes[index].first = begin;
+		nodes[index].count = end - begin;
+		return index;
+	}
+
+	// median split of the centers along their longest extent
+	int axis = 0;
+	for (int c = 1; c < 3; c++) {
+		if (centers[c + 3] - centers[c] > centers[axis + 3] - centers[axis])
+			axis = c;
+	}
+	int mid = (begin + end) / 2;
+	const std::vector<Primitive>& p = prims;
+	std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+		[&](int a, int b) {
+			return p[a].bounds[axis] + p[a].bounds[axis + 3] < p[b].bounds[axis] + p[b].bounds[axis + 3];
+		});
+	build(begin, mid);					// lands at index + 1
+	int right = build(mid, end);
+	nodes[index].first = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+void ModelCollider::refitNodes()
+{
+	// children come after their parent, so one backwards sweep suffices
+	for (int i = nodes.size() - 1; i >= 0; i--) {
+		Node& n = nodes[i];
+		empty(n.bounds);
+		if (n.count > 0) {
+			for (int k = n.first; k < n.first + n.count; k++)
+				merge(n.bounds, prims[order[k]].bounds);
+		} else {
+			merge(n.bounds, nodes[i + 1].bounds);
+			merge(n.bounds, nodes[n.first].bounds);
+		}
+	}
+}
+
+unsigned long long ModelCollider::hash(unsigned long long h) const
+{
+	h = hashBytes("ModelCollider", 13, h);
+	h = hashValue(restitution, h);
+	return hashValue(friction, h);
+}
+
+bool ModelCollider::intersect(const Primitive& p, const float a[3], const float b[3],
+	float& t, float n[3]) const
+{
+	if (p.shape == TRIANGLE) {
+		// Moller-Trumbore; shells are thin, so either side counts
+		const float* v = p.size;
+		float e1[3], e2[3], d[3], q[3], pv[3], s[3];
+		for (int c = 0; c < 3; c++) {
+			e1[c] = v[3 + c] - v[c];
+			e2[c] = v[6 + c] - v[c];
+			d[c] = b[c] - a[c];
+			s[c] = a[c] - v[c];
+		}
+		pv[0] = d[1] * e2[2] - d[2] * e2[1];
+		pv[1] = d[2] * e2[0] - d[0] * e2[2];
+		pv[2] = d[0] * e2[1] - d[1] * e2[0];
+		float det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+		if (fabsf(det) < 1e-12f)
+			return false;
+		float inv = 1.0f / det;
+		float u = (s[0] * pv[0] + s[1] * pv[1] + s[2] * pv[2]) * inv;
+		if (u < 0 || u > 1)
+			return false;
+		q[0] = s[1] * e1[2] - s[2] * e1[1];
+		q[1] = s[2] * e1[0] - s[0] * e1[2];
+		q[2] = s[0] * e1[1] - s[1] * e1[0];
+		float w = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+		if (w < 0 || u + w > 1)
+			return false;
+		t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+		if (t < 0 || t > 1)
+			return false;
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		if (n[0] * d[0] + n[1] * d[1] + n[2] * d[2] > 0) {
+			n[0] = -n[0]; n[1] = -n[1]; n[2] = -n[2];
+		}
+		return true;
+	}
+
+	// everything else is tested in the primitive's own space
+	float la[3], lb[3], d[3], ln[3];
+	transform(p.toLocal, a, la);
+	transform(p.toLocal, b, lb);
+	for (int c = 0; c < 3; c++)
+		d[c] = lb[c] - la[c];
+
+	if (p.shape == SPHERE) {
+		float r = p.size[0];
+		float cq = la[0] * la[0] + la[1] * la[1] + la[2] * la[2] - r * r;
+		if (cq <= 0)
+			return false;
+		float aq = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+		float bq = la[0] * d[0] + la[1] * d[1] + la[2] * d[2];
+		float disc = bq * bq - aq * cq;
+		if (aq == 0 || disc < 0)
+			return false;
+		t = (-bq - sqrtf(disc)) / aq;
+		if (t < 0 || t > 1)
+			return false;
+		for (int c = 0; c < 3; c++)
+			ln[c] = la[c] + t * d[c];
+	} else if (p.shape == BOX) {
+		float enter = -FLT_MAX, leave = FLT_MAX;
+		int axis = -1;
+		float side = 0;
+		for (int c = 0; c < 3; c++) {
+			float lo = p.size[c] < 0 ? p.size[c] : 0;
+			float hi = p.size[c] > 0 ? p.size[c] : 0;
+			if (d[c] == 0) {
+				if (la[c] < lo || la[c] > hi)
+					return false;
+				continue;
+			}
+			float t0 = (lo - la[c]) / d[c], t1 = (hi - la[c]) / d[c];
+			float s = -1;
+			if (t0 > t1) {
+				std::swap(t0, t1);
+				s = 1;
+			}
+			if (t0 > enter) {
+				enter = t0;
+				axis = c;
+				side = s;
+			}
+			if (t1 < leave)
+				leave = t1;
+		}
+		// enter < 0: the path starts inside
+		if (axis < 0 || enter > leave || enter < 0 || enter > 1)
+			return false;
+		t = enter;
+		ln[0] = ln[1] = ln[2] = 0;
+		ln[axis] = side;
+	} else {
+		float h = p.size[0], r1 = p.size[1], r2 = p.size[2];
+		if (h == 0)
+			return false;
+		float k = (r2 - r1) / h;
+		float zlo = h < 0 ? h : 0, zhi = h > 0 ? h : 0;
+		float ra = r1 + k * la[2];
+		if (la[2] >= zlo && la[2] <= zhi && ra >= 0
+			&& la[0] * la[0] + la[1] * la[1] <= ra * ra)
+			return false;
+
+		t = FLT_MAX;
+		// the side: x^2 + y^2 = (r1 + k z)^2
+		float aq = d[0] * d[0] + d[1] * d[1] - k * k * d[2] * d[2];
+		float bq = 2.0f * (la[0] * d[0] + la[1] * d[1] - k * d[2] * ra);
+		float cq = la[0] * la[0] + la[1] * la[1] - ra * ra;
+		float roots[2];
+		int nRoots = 0;
+		if (fabsf(aq) > 1e-12f) {
+			float disc = bq * bq - 4.0f * aq * cq;
+			if (disc >= 0) {
+				float sq = sqrtf(disc);
+				roots[0] = (-bq - sq) / (2.0f * aq);
+				roots[1] = (-bq + sq) / (2.0f * aq);
+				nRoots = 2;
+			}
+		} else if (bq != 0) {
+			roots[0] = -cq / bq;
+			nRoots = 1;
+		}
+		for (int i = 0; i < nRoots; i++) {
+			float s = roots[i];
+			float z = la[2] + s * d[2];
+			if (s < 0 || s > 1 || s >= t || z < zlo || z > zhi || r1 + k * z < 0)
+				continue;
+			t = s;
+			ln[0] = la[0] + s * d[0];
+			ln[1] = la[1] + s * d[1];
+			ln[2] = -k * (r1 + k * z);
+		}
+		// the caps
+		if (d[2] != 0) {
+			float capZ[2] = { 0, h }, capR[2] = { r1, r2 };
+			for (int i = 0; i < 2; i++) {
+				float s = (capZ[i] - la[2]) / d[2];
+				if (s < 0 || s > 1 || s >= t)
+					continue;
+				float x = la[0] + s * d[0], y = la[1] + s * d[1];
+				if (x * x + y * y > capR[i] * capR[i])
+					continue;
+				t = s;
+				ln[0] = ln[1] = 0;
+				// outwards: away from the other cap
+				ln[2] = ((i == 0) == (h > 0)) ? -1.0f : 1.0f;
+			}
+		}
+		if (t > 1)
+			return false;
+	}
+
+	// normals go back by the transpose of the inverse
+	const float* m = p.toLocal;
+	for (int c = 0; c < 3; c++)
+		n[c] = m[c] * ln[0] + m[4 + c] * ln[1] + m[8 + c] * ln[2];
+	return true;
+}
+
+bool ModelCollider::trace(const float a[3], const float b[3], float& t, float n[3]) const
+{
+	if (count == 0)
+		return false;
+	float path[6];
+	empty(path);
+	expand(path, a);
+	expand(path, b);
+
+	bool hit = false;
+	t = FLT_MAX;
+	int stack[STACK_DEPTH];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (!overlaps(node.bounds, path))
+			continue;
+		if (node.count == 0) {
+			int self = &node - &nodes[0];
+			stack[top++] = node.first;
+			stack[top++] = self + 1;
+			continue;
+		}
+		for (int k = node.first; k < node.first + node.count; k++) {
+			const Primitive& p = prims[order[k]];
+			if (!overlaps(p.bounds, path))
+				continue;
+			float s, ns[3];
+			if (intersect(p, a, b, s, ns) && s < t) {
+				t = s;
+				n[0] = ns[0]; n[1] = ns[1]; n[2] = ns[2];
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
+
+void ModelCollider::collide(ParticleState& s, const float* x0, const float* y0, const float* z0,
+	ThreadPool* pool)
+{
+	int n = s.size();
+	found = 0;
+	if (count == 0 || n == 0)
+		return;
+	const int chunk = Integrator::CHUNK;
+	chunkHits.assign((n + chunk - 1) / chunk, 0);
+	if (pool) {
+		pool->forRange(n, chunk, [&](int begin, int end) {
+			collideRange(s, x0, y0, z0, begin, end);
+		});
+	} else {
+		for (int begin = 0; begin < n; begin += chunk)
+			collideRange(s, x0, y0, z0, begin, begin + chunk < n ? begin + chunk : n);
+	}
+	for (int k = 0; k < chunkHits.size(); k++)
+		found += chunkHits[k];
+}
+
+void ModelCollider::collideRange(ParticleState& s, const float* x0, const float* y0, const float* z0,
+	int begin, int end)
+{
+	int hits = 0;
+	for (int i = begin; i < end; i++) {
+		float a[3] = { x0[i], y0[i], z0[i] };
+		float b[3] = { s.px[i], s.py[i], s.pz[i] };
+		float t, n[3];
+		if (!trace(a, b, t, n))
+			continue;
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len == 0)
+			continue;
+		n[0] /= len; n[1] /= len; n[2] /= len;
+
+		// stop at the surface; the rest of the step's motion is lost
+		s.px[i] = a[0] + t * (b[0] - a[0]) + SKIN * n[0];
+		s.py[i] = a[1] + t * (b[1] - a[1]) + SKIN * n[1];
+		s.pz[i] = a[2] + t * (b[2] - a[2]) + SKIN * n[2];
+
+		float v[3] = { s.vx[i], s.vy[i], s.vz[i] };
+		float vn = v[0] * n[0] + v[1] * n[1] + v[2] * n[2];
+		if (vn < 0) {
+			for (int c = 0; c < 3; c++)
+				v[c] = (v[c] - vn * n[c]) * (1.0f - friction) - restitution * vn * n[c];
+			s.vx[i] = v[0]; s.vy[i] = v[1]; s.vz[i] = v[2];
+		}
+		hits++;
+	}
+	chunkHits[begin / Integrator::CHUNK] = hits;
+}
@@ -0,0 +1,115 @@
+#ifndef MODELCOLLIDER_H
+#define MODELCOLLIDER_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+
+class ParticleState;
+class ThreadPool;
+
+// ModelCollider makes particles bounce off the model: it collects the
+// spheres, boxes, cylinders and triangles the model draws each frame
+// (modelerdraw passes them on while recordColliders() is set), in world
+// space, and tests particle paths against them.
+//
+// Every primitive keeps its full transform, so scaled spheres, sheared
+// boxes and cones are tested exactly: a particle's path is taken into
+// the primitive's own space, where the shape is simple, and the hit and
+// its normal are taken back. The test is continuous: the path from a
+// particle's position before a step to its position after it is checked,
+// so fast particles can't tunnel through thin parts. Only paths entering
+// a solid count, so particles emitted inside one leave it freely.
+//
+// The primitives sit in a bounding volume hierarchy. Primitives drawn in
+// the same order as the last frame are the same primitives moved, e.g.
+// by joint angles changing, and the hierarchy is only refit: its boxes
+// are recomputed bottom up and its structure kept. It is rebuilt when
+// the primitives change, or when refitting has let it grow loose.
+class ModelCollider {
+public:
+	enum Shape {
+		SPHERE = 0,						// radius
+		BOX,							// from the origin to x, y, z
+		CYLINDER,						// z = 0 .. h, radius r1 at 0, r2 at h
+		TRIANGLE						// three vertices
+	};
+
+	ModelCollider();
+
+	// Starts collecting a frame's primitives. eye is the modelview matrix
+	// (column major, as glGetFloatv returns it) while it only holds the
+	// camera, so the world to eye transform.
+	void begin(const float eye[16]);
+	// A primitive drawn under modelview matrix mv, with the arguments of
+	// the modelerdraw function that drew it
+	void addSphere(const float mv[16], float r);
+	void addBox(const float mv[16], float x, float y, float z);
+	void addCylinder(const float mv[16], float h, float r1, float r2);
+	void addTriangle(const float mv[16], const float v[9]);
+	// Finishes the frame's primitives and refits or rebuilds the hierarchy
+	void end();
+	// Drops all primitives
+	void clear();
+
+	int size() const { return count; }
+	// whether the last end() refit the hierarchy rather than rebuilt it
+	bool refitted() const { return refit; }
+
+	// Particles whose path from x0, y0, z0 to their position enters a
+	// primitive are stopped at the surface, their velocity reflected:
+	// the normal part scaled by restitution, the tangential part reduced
+	// by friction
+	void collide(ParticleState& s, const float* x0, const float* y0, const float* z0,
+		ThreadPool* pool = NULL);
+	// particles that hit something in the last collide()
+	int hits() const { return found; }
+
+	float restitution;
+	float friction;						// 0: slides freely, 1: stops
+
+	unsigned long long hash(unsigned long long h) const;
+
+private:
+	struct Primitive {
+		int shape;
+		float size[9];					// the shape's arguments
+		float toWorld[12];				// 3x4, row major
+		float toLocal[12];
+		float bounds[6];				// world min, max
+	};
+
+	struct Node {
+		float bounds[6];
+		int first;						// leaf: first index; inner: right child
+		int count;						// primitives in a leaf; 0 for inner nodes
+	};
+
+	Primitive& add(int shape, const float mv[16]);
+	void bound(Primitive& p) const;
+
+	int build(int begin, int end);
+	void refitNodes();
+	float area(const float b[6]) const;
+
+	// first entry into primitive p along a + t (b - a), t in [0, 1]
+	bool intersect(const Primitive& p, const float a[3], const float b[3], float& t, float n[3]) const;
+	// nearest hit of any primitive
+	bool trace(const float a[3], const float b[3], float& t, float n[3]) const;
+	void collideRange(ParticleState& s, const float* x0, const float* y0, const float* z0,
+		int begin, int end);
+
+	float worldFromEye[12];
+	std::vector<Primitive> prims;
+	int count;							// primitives this frame
+	int built;							// primitive count the hierarchy was built for
+	std::vector<int> shapes;			// shape sequence the hierarchy was built for
+	std::vector<int> order;				// primitive indices, leaf by leaf
+	std::vector<Node> nodes;
+	float builtArea;					// root surface area when built
+	bool refit;
+	int found;
+	std::vector<int> chunkHits;
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include "modelerview.h"
 #include "modelerui.h"
 #include "camera.h"
+#include "eventrecorder.h"
+#include "particleoptions.h"
 
 #include <FL/Fl_Value_Slider.H>
 #include <FL/Fl_Box.H>
@@ -12,6 +14,7 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <sstream>
 
 // CLASS ModelerControl METHODS
 
@@ -103,7 +106,7 @@ ModelerApplication::~ModelerApplication()
     delete m_ui;
 }
 
-int ModelerApplication::Run()
+int ModelerApplication::Run(int argc, char** argv)
 {
 	if (m_numControls == -1)
 	{
@@ -113,17 +116,133 @@ int ModelerApplication::Run()
 
     // Just tell FLTK to go for it.
    	Fl::visual( FL_RGB | FL_DOUBLE );
+
+	// movie export worker, started by BatchDriver::exportMovie()
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--render-frames") == 0)
+			return RenderFrames(argc, argv);
+	}
+
 	m_ui->show();
-	Fl::add_timeout(0, ModelerApplication::RedrawLoop, NULL);
 
-	// Automatically load animator.ani and animator.ani.cam if they exist
-	m_ui->autoLoadNPlay();
+	const char* szRecord = NULL;
+	const char* szReplay = NULL;
+	const char* szReport = NULL;
+	const char* szBakeCache = NULL;
+	bool bPaced = true;
+	// the particle system is set up from the same options as a batch run,
+	// so the two make the same bakes and share the cache
+	ParticleOptions options;
+	for (int i = 1; i < argc; ++i) {
+		int iTaken = options.parse(argc, argv, i, ps);
+		if (iTaken > 0)
+			i += iTaken - 1;
+		else if (iTaken < 0)
+			;	// reported; the rest still starts
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			szRecord = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			szReplay = argv[++i];
+		else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+			szReport = argv[++i];
+		else if (strcmp(argv[i], "--replay-fast") == 0)
+			bPaced = false;
+		else if (strcmp(argv[i], "--bake-cache") == 0 && i + 1 < argc)
+			szBakeCache = argv[++i];
+		else if (strcmp(argv[i], "--bake-interpolation") == 0 && i + 1 < argc && ps) {
+			BakePlayback::Interpolation mode = BakePlayback::byName(argv[++i]);
+			if (mode == BakePlayback::NUM_INTERPOLATIONS)
+				fprintf(stderr, "ERROR: unknown interpolation %s\n", argv[i]);
+			else
+				ps->setBakeInterpolation(mode);
+		}
+	}
+	options.apply(ps);
+
+	// Automatically load animator.ani and animator.ani.cam if they exist;
+	// after the options, so what it plays is simulated under them. A
+	// replay starts from the session in its log instead, still.
+	if (szReplay == NULL)
+		m_ui->autoLoadNPlay();
+
+	// bakes persist across sessions in the cache; it is reused if the
+	// particle settings and animation still match, and rewritten when a
+	// simulation stops
+	if (szBakeCache && ps && ps->openBakeCache(szBakeCache, m_ui->scriptHash()))
+		printf("loaded %d baked frames from %s\n", ps->bakedFrameCount(), szBakeCache);
+
+	EventRecorder* per = EventRecorder::Instance();
+	if (szReplay) {
+		if (!per->startReplay(szReplay, bPaced, szReport))
+			fprintf(stderr, "ERROR: can't open event log %s\n", szReplay);
+		else if (!per->session().empty()) {
+			// before Fl::run() feeds the first event
+			std::istringstream issSession(per->session());
+			if (!m_ui->loadSession(issSession))
+				fprintf(stderr, "ERROR: can't restore the session in %s\n", szReplay);
+		}
+	}
+	else if (szRecord) {
+		std::ostringstream ossSession;
+		m_ui->saveSession(ossSession);
+		if (!per->startRecording(szRecord, ossSession.str()))
+			fprintf(stderr, "ERROR: can't write event log %s\n", szRecord);
+	}
 
-	return Fl::run();
+	int iResult = Fl::run();
+	per->stopRecording();
+	return iResult;
+}
+
+int ModelerApplication::RenderFrames(int argc, char** argv)
+{
+	const char* szScript = NULL;
+	const char* szBake = NULL;
+	const char* szMovie = NULL;
+	int iFirst = 0, iLast = -1;
+	int iWidth = 0, iHeight = 0;
+	float fStart = 0.0f;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--render-frames") == 0 && i + 2 < argc) {
+			iFirst = atoi(argv[++i]);
+			iLast = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+			iWidth = atoi(argv[++i]);
+			iHeight = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+			szScript = argv[++i];
+		else if (strcmp(argv[i], "--bake") == 0 && i + 1 < argc)
+			szBake = argv[++i];
+		else if (strcmp(argv[i], "--movie") == 0 && i + 1 < argc)
+			szMovie = argv[++i];
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+			m_ui->fps(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc)
+			fStart = (float)atof(argv[++i]);
+	}
+
+	if (szScript == NULL || szMovie == NULL) {
+		fprintf(stderr, "ERROR: --render-frames needs --script and --movie\n");
+		return 1;
+	}
+	if (szBake && (ps == NULL || !ps->loadBakeFile(szBake))) {
+		fprintf(stderr, "ERROR: can't load bake %s\n", szBake);
+		return 1;
+	}
+	if (!m_ui->renderMovieFrames(szScript, szMovie, iFirst, iLast, fStart, iWidth, iHeight)) {
+		fprintf(stderr, "ERROR: can't load animation script %s\n", szScript);
+		return 1;
+	}
+	return 0;
 }
 
 double ModelerApplication::GetControlValue(int controlNumber)
 {
+	if (m_pfControlValues)
+		return m_pfControlValues[controlNumber];
     return m_ui->controlValue(controlNumber);
 }
 
@@ -189,6 +308,8 @@ void ModelerApplication::ValueChangedCallback()
 			// otherwise, we sync the psystem
 			// to the ui
 			else if (m_ui->simulate()) {
+				// the bake is of the animation as it is now
+				ps->setBakeCacheSalt(m_ui->scriptHash());
 				ps->startSimulation(currTime);
 			} else {
 				ps->stopSimulation(currTime);
@@ -198,16 +319,7 @@ void ModelerApplication::ValueChangedCallback()
 	}
 
 	// update camera position
-	m_ui->m_pwndModelerView->m_camera->update(currTime);
+	m_ui->updateCamera(currTime);
 
 	m_ui->redrawModelerView();
 }
-
-void ModelerApplication::RedrawLoop(void*)
-{
-	if (ModelerApplication::Instance()->m_animating)
-		ModelerApplication::Instance()->m_ui->redrawModelerView();
-
-	// 1/50 second update is good enough
-	Fl::add_timeout(0.025, ModelerApplication::RedrawLoop, NULL);
-}
\ No newline at end of file
@@ -45,12 +45,17 @@ public:
               const ModelerControl controls[], 
               unsigned numControls); 
 
-    // Starts the application, returns when application is closed
-	int  Run();
+    // Starts the application, returns when application is closed.
+	// Understands --record <log>, --replay <log>, --replay-fast and
+	// --report <file> (see EventRecorder).
+	int  Run(int argc = 0, char** argv = NULL);
 
     // Get and set slider values.
     double GetControlValue(int controlNumber);
     void   SetControlValue(int controlNumber, double value);
+	// Values for GetControlValue() to return instead of the sliders', e.g.
+	// to pose the model without a UI; NULL goes back to the sliders
+	void SetControlValues(const float* pfValues) { m_pfControlValues = pfValues; }
 
 	// Get and set particle system
 	ParticleSystem *GetParticleSystem();
@@ -67,7 +72,7 @@ public:
 
 private:
 	// Private for singleton
-	ModelerApplication() : m_numControls(-1) { ps = 0; }
+	ModelerApplication() : m_numControls(-1), m_pfControlValues(NULL) { ps = 0; }
 	ModelerApplication(const ModelerApplication&) {}
 	ModelerApplication& operator=(const ModelerApplication&) {}
 	
@@ -76,9 +81,12 @@ private:
 
 	ModelerUI *m_ui;
 	int					  m_numControls;
+	const float*		  m_pfControlValues;	// see SetControlValues()
 
     static void ValueChangedCallback();
-	static void RedrawLoop(void*);
+
+	// --render-frames worker mode of Run()
+	int RenderFrames(int argc, char** argv);
 
 	// Just a flag for updates
 	bool m_animating;
@@ -1,8 +1,11 @@
 #include "modelerdraw.h"
+#include "modelcollider.h"
 #include <FL/gl.h>
 #include <GL/glu.h>
 #include <cstdio>
+#include <cstring>
 #include <math.h>
+#include <vector>
 
 // For texture mapping
 #define checkImageWidth 64
@@ -85,6 +88,8 @@ ModelerDrawState::ModelerDrawState() : m_drawMode(NORMAL), m_quality(MEDIUM)
     m_shininess = 0.5;
     
     m_rayFile = NULL;
+	m_collider = NULL;
+	m_posing = false;
 }
 
 // CLASS ModelerDrawState METHODS
@@ -94,6 +99,110 @@ ModelerDrawState* ModelerDrawState::Instance()
     return (m_instance) ? (m_instance) : m_instance = new ModelerDrawState();
 }
 
+// ****************************************************************************
+// Transforms, and posing without OpenGL
+// ****************************************************************************
+
+// The pose's matrix stack, each column major as OpenGL keeps them
+struct PoseMatrix { GLfloat m[16]; };
+static std::vector<PoseMatrix> poseStack;
+
+// true between beginPose() and endPose(), when nothing is drawn
+static bool _posing()
+{
+	return ModelerDrawState::Instance()->m_posing;
+}
+
+// the top of the pose's stack = top * b, as glMultMatrixf(b) does
+static void _pose_multiply(const GLfloat b[16])
+{
+	GLfloat* a = poseStack.back().m;
+	GLfloat r[16];
+	for (int j = 0; j < 4; j++)
+		for (int i = 0; i < 4; i++)
+			r[4 * j + i] = a[i] * b[4 * j] + a[4 + i] * b[4 * j + 1] +
+				a[8 + i] * b[4 * j + 2] + a[12 + i] * b[4 * j + 3];
+	memcpy(a, r, sizeof(r));
+}
+
+void beginPose()
+{
+	PoseMatrix identity = { { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } };
+	poseStack.assign(1, identity);
+	ModelerDrawState::Instance()->m_posing = true;
+}
+
+void endPose()
+{
+	ModelerDrawState::Instance()->m_posing = false;
+	poseStack.clear();
+}
+
+void pushMatrix()
+{
+	if (_posing())
+		poseStack.push_back(poseStack.back());
+	else
+		glPushMatrix();
+}
+
+void popMatrix()
+{
+	if (!_posing())
+		glPopMatrix();
+	else if (poseStack.size() > 1)
+		poseStack.pop_back();
+}
+
+void translate(double x, double y, double z)
+{
+	if (!_posing()) {
+		glTranslated(x, y, z);
+		return;
+	}
+	GLfloat t[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, (GLfloat)x, (GLfloat)y, (GLfloat)z, 1 };
+	_pose_multiply(t);
+}
+
+void rotate(double degrees, double x, double y, double z)
+{
+	if (!_posing()) {
+		glRotated(degrees, x, y, z);
+		return;
+	}
+	double length = sqrt(x * x + y * y + z * z);
+	if (length == 0.0)
+		return;
+	x /= length; y /= length; z /= length;
+	double a = degrees * PI / 180.0;
+	double c = cos(a), s = sin(a), d = 1.0 - c;
+	// the matrix glRotated() documents
+	GLfloat r[16] = {
+		(GLfloat)(x * x * d + c), (GLfloat)(y * x * d + z * s), (GLfloat)(x * z * d - y * s), 0,
+		(GLfloat)(x * y * d - z * s), (GLfloat)(y * y * d + c), (GLfloat)(y * z * d + x * s), 0,
+		(GLfloat)(x * z * d + y * s), (GLfloat)(y * z * d - x * s), (GLfloat)(z * z * d + c), 0,
+		0, 0, 0, 1 };
+	_pose_multiply(r);
+}
+
+void scale(double x, double y, double z)
+{
+	if (!_posing()) {
+		glScaled(x, y, z);
+		return;
+	}
+	GLfloat m[16] = { (GLfloat)x, 0, 0, 0, 0, (GLfloat)y, 0, 0, 0, 0, (GLfloat)z, 0, 0, 0, 0, 1 };
+	_pose_multiply(m);
+}
+
+void getModelView(GLfloat mv[16])
+{
+	if (_posing())
+		memcpy(mv, poseStack.back().m, 16 * sizeof(GLfloat));
+	else
+		glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+}
+
 // ****************************************************************************
 // Modeler functions for your use
 // ****************************************************************************
@@ -101,6 +210,9 @@ ModelerDrawState* ModelerDrawState::Instance()
 
 void setAmbientColor(float r, float g, float b)
 {
+	if (_posing())
+		return;
+
     ModelerDrawState *mds = ModelerDrawState::Instance();
     
     mds->m_ambientColor[0] = (GLfloat)r;
@@ -114,6 +226,9 @@ void setAmbientColor(float r, float g, float b)
 
 void setDiffuseColor(float r, float g, float b)
 {
+	if (_posing())
+		return;
+
     ModelerDrawState *mds = ModelerDrawState::Instance();
     
     mds->m_diffuseColor[0] = (GLfloat)r;
@@ -129,6 +244,9 @@ void setDiffuseColor(float r, float g, float b)
 
 void setSpecularColor(float r, float g, float b)
 {	
+	if (_posing())
+		return;
+
     ModelerDrawState *mds = ModelerDrawState::Instance();
     
     mds->m_specularColor[0] = (GLfloat)r;
@@ -142,6 +260,9 @@ void setSpecularColor(float r, float g, float b)
 
 void setShininess(float s)
 {
+	if (_posing())
+		return;
+
     ModelerDrawState *mds = ModelerDrawState::Instance();
     
     mds->m_shininess = (GLfloat)s;
@@ -186,6 +307,30 @@ bool openRayFile(const char rayFileName[])
         return false;
 }
 
+void recordColliders(ModelCollider* pCollider)
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+	if (mds->m_collider)
+		mds->m_collider->end();
+	mds->m_collider = pCollider;
+	if (pCollider) {
+		GLfloat eye[16];
+		getModelView(eye);
+		pCollider->begin(eye);
+	}
+}
+
+// The current modelview, or the pose's, for the collider; NULL if none
+// is recording
+static const GLfloat* _collider_modelview(GLfloat mv[16])
+{
+	if (ModelerDrawState::Instance()->m_collider == NULL)
+		return NULL;
+	getModelView(mv);
+	return mv;
+}
+
 void _setupOpenGl()
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
@@ -221,6 +366,13 @@ void closeRayFile()
 void drawSphere(double r)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
+	GLfloat mv[16];
+
+	// a posed model collides too, so batch bakes see it
+	if (_collider_modelview(mv))
+		mds->m_collider->addSphere(mv, (float)r);
+	if (_posing())
+		return;
 
 	_setupOpenGl();
     
@@ -258,6 +410,12 @@ void drawSphere(double r)
 
 void drawTextureSphere(double r)
 {
+	// posed, it is only a collider
+	if (_posing()) {
+		drawSphere(r);
+		return;
+	}
+
 	glEnable(GL_DEPTH_TEST);
 	makeCheckImages();
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -285,6 +443,12 @@ void drawTextureSphere(double r)
 void drawBox( double x, double y, double z )
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
+	GLfloat mv[16];
+
+	if (_collider_modelview(mv))
+		mds->m_collider->addBox(mv, (float)x, (float)y, (float)z);
+	if (_posing())
+		return;
 
 	_setupOpenGl();
     
@@ -344,6 +508,14 @@ void drawBox( double x, double y, double z )
 
 void drawTextureBox( double x, double y, double z )
 {
+	GLfloat mv[16];
+
+	// drawn here rather than by drawBox(), so recorded here
+	if (_collider_modelview(mv))
+		ModelerDrawState::Instance()->m_collider->addBox(mv, (float)x, (float)y, (float)z);
+	if (_posing())
+		return;
+
 	glEnable(GL_DEPTH_TEST);
 	makeCheckImages();
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -423,6 +595,12 @@ void drawCylinder( double h, double r1, double r2 )
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
     int divisions;
+	GLfloat mv[16];
+
+	if (_collider_modelview(mv))
+		mds->m_collider->addCylinder(mv, (float)h, (float)r1, (float)r2);
+	if (_posing())
+		return;
 
 	_setupOpenGl();
     
@@ -502,6 +680,12 @@ void drawCylinder( double h, double r1, double r2 )
 
 void drawTextureCylinder(double h, double r1, double r2)
 {
+	// posed, it is only a collider
+	if (_posing()) {
+		drawCylinder(h, r1, r2);
+		return;
+	}
+
 	glEnable(GL_DEPTH_TEST);
 	makeCheckImages();
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -531,6 +715,15 @@ void drawTriangle( double x1, double y1, double z1,
                    double x3, double y3, double z3 )
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
+	GLfloat mv[16];
+
+	if (_collider_modelview(mv)) {
+		float v[9] = { (float)x1, (float)y1, (float)z1, (float)x2, (float)y2, (float)z2,
+			(float)x3, (float)y3, (float)z3 };
+		mds->m_collider->addTriangle(mv, v);
+	}
+	if (_posing())
+		return;
 
 	_setupOpenGl();
 
@@ -566,6 +759,9 @@ void drawTriangle( double x1, double y1, double z1,
 
 void drawTorus(float R, float r)
 {
+	if (_posing())
+		return;
+
 	ModelerDrawState *mds = ModelerDrawState::Instance();
 
 	_setupOpenGl();
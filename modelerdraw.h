@@ -8,6 +8,8 @@
 #include <FL/gl.h>
 #include <cstdio>
 
+class ModelCollider;
+
 
 enum DrawModeSetting_t 
 { NONE=0, NORMAL, WIREFRAME, FLATSHADE, };
@@ -24,6 +26,8 @@ public:
 	static ModelerDrawState* Instance();
 
 	FILE* m_rayFile;
+	ModelCollider* m_collider;	// see recordColliders()
+	bool m_posing;				// see beginPose()
 
 	DrawModeSetting_t m_drawMode;
 	QualitySetting_t  m_quality;
@@ -71,6 +75,36 @@ bool openRayFile(const char rayFileName[]);
 // Closes the current .ray file if one exists
 void closeRayFile();
 
+// Passes the spheres, boxes, cylinders and triangles drawn from here on
+// to pCollider (see ModelCollider), until called again; NULL stops.
+// Call it while the modelview matrix holds only the camera, or while
+// posing, when the model's primitives are recorded in pose space.
+void recordColliders(ModelCollider* pCollider);
+
+////////////////
+// Transforms //
+////////////////
+
+// glPushMatrix(), glPopMatrix(), glTranslated(), glRotated() (degrees)
+// and glScaled() on the modelview matrix; draw the model's hierarchy
+// with these so that it can be posed.
+void pushMatrix();
+void popMatrix();
+void translate(double x, double y, double z);
+void rotate(double degrees, double x, double y, double z);
+void scale(double x, double y, double z);
+// The current modelview matrix, column major as glGetFloatv returns it
+void getModelView(GLfloat mv[16]);
+
+// Posing runs the model's drawing code without drawing, and without an
+// OpenGL context: from beginPose() to endPose() the transforms above
+// apply to a matrix stack of their own, starting at the identity, and
+// the colours and primitives below draw nothing, though the primitives
+// still reach recordColliders(). This finds where the model puts
+// things, such as its particle emitters and colliders, for any pose.
+void beginPose();
+void endPose();
+
 /////////////////////////////
 // Raytraceable Primitives //
 /////////////////////////////
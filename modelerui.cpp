@@ -19,12 +19,34 @@
 
 #ifdef _DEBUG
 #include <assert.h>
-#endif _DEBUG
+#endif // _DEBUG
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
 #include <string>
-#include <FL/fl_ask.h>
+#include <FL/fl_ask.H>
 
 #include "modelerui.h"
 #include "camera.h"
+#include "redrawscheduler.h"
+#include "eventrecorder.h"
+
+// VS2013 has no snprintf; _snprintf differs only in not terminating a
+// truncated string, which the callers here do themselves
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+// The extension of strFileName's last path component, dot included, as
+// _splitpath() gives it; empty if there is none
+static std::string fileExtension(const std::string& strFileName)
+{
+	std::string::size_type iDot = strFileName.rfind('.');
+	std::string::size_type iSlash = strFileName.find_last_of("/\\:");
+	if (iDot == std::string::npos || (iSlash != std::string::npos && iDot < iSlash))
+		return std::string();
+	return strFileName.substr(iDot);
+}
 
 using namespace std;
 
@@ -33,6 +55,8 @@ float cat = 0.5;
 inline void ModelerUI::cb_cat_i(Fl_Slider*, void*)
 {
 	cat = m_psldrTension->value();
+	// the tension changes every catmull-rom curve
+	m_pwndGraphWidget->invalidateAllCurves();
 }
 
 void ModelerUI::cb_cat(Fl_Slider* o, void* v)
@@ -65,9 +89,7 @@ inline void ModelerUI::cb_saveAniScript_i(Fl_Menu_*, void*)
 		string strFileName = szFileName;
 
 		// Append the default extension
-		char szExt[_MAX_EXT];
-		_splitpath(strFileName.c_str(), NULL, NULL, NULL, szExt);
-		if (strlen(szExt) == 0)
+		if (fileExtension(strFileName).empty())
 			strFileName += ".ani";
 
 		if (m_pwndGraphWidget->saveScript(strFileName.c_str())) {
@@ -94,9 +116,7 @@ inline void ModelerUI::cb_saveBMPFile_i(Fl_Menu_*, void*)
 		string strFileName = szFileName;
 
 		// Append the default extension
-		char szExt[_MAX_EXT];
-		_splitpath(strFileName.c_str(), NULL, NULL, NULL, szExt);
-		if (strlen(szExt) == 0)
+		if (fileExtension(strFileName).empty())
 			strFileName += ".bmp";
 
 		m_pwndModelerView->saveBMP(strFileName.c_str());
@@ -114,13 +134,7 @@ inline void ModelerUI::cb_saveMovie_i(Fl_Menu_*, void*)
 	char *szFileName = fl_file_chooser("Save Movie As", "*.bmp", NULL);
 
 	if (szFileName) {
-		m_strMovieFileName = szFileName;
-
-		// Remove the .bmp part
-		char szExt[_MAX_EXT];
-		_splitpath(m_strMovieFileName.c_str(), NULL, NULL, NULL, szExt);
-		if (!stricmp(szExt, ".bmp"))
-			m_strMovieFileName = m_strMovieFileName.substr(0, m_strMovieFileName.length() - 4);
+		movieFileName(szFileName);
 
 		m_bSaveMovie = true;
 		m_iMovieFrameNum = 0;
@@ -459,6 +473,7 @@ void ModelerUI::cb_removeAllCamKeyFrames(Fl_Button* o, void* v)
 
 inline void ModelerUI::cb_playStartSlider_i(Fl_Slider*, void*) 
 {
+	EventRecorder::Instance()->recordValue(EventRecorder::PLAY_START_SLIDER, m_psldrPlayStart->value());
 	playStartTime(m_psldrPlayStart->value());
 }
 
@@ -469,6 +484,7 @@ void ModelerUI::cb_playStartSlider(Fl_Slider* o, void* v)
 
 inline void ModelerUI::cb_playEndSlider_i(Fl_Slider*, void*) 
 {
+	EventRecorder::Instance()->recordValue(EventRecorder::PLAY_END_SLIDER, m_psldrPlayEnd->value());
 	playEndTime(m_psldrPlayEnd->value());
 }
 
@@ -479,6 +495,7 @@ void ModelerUI::cb_playEndSlider(Fl_Slider* o, void* v)
 
 inline void ModelerUI::cb_timeSlider_i(Fl_Slider*, void*) 
 {
+	EventRecorder::Instance()->recordValue(EventRecorder::TIME_SLIDER, m_psldrTimeSlider->value());
 	currTime(m_psldrTimeSlider->value());
 }
 
@@ -647,15 +664,16 @@ void ModelerUI::currTime(float fTime)
 	m_psldrTimeSlider->value(fTime);
 	m_pwndModelerView->t = fTime;
 	
-	m_pwndGraphWidget->redraw();
-	m_pwndIndicatorWnd->redraw();
-	m_psldrTimeSlider->redraw();
+	RedrawScheduler* prs = RedrawScheduler::Instance();
+	prs->invalidate(m_pwndGraphWidget);
+	prs->invalidate(m_pwndIndicatorWnd);
+	prs->invalidate(m_psldrTimeSlider);
 
 	char szTime[64];
-	_snprintf(szTime, 64, "%.2f", fTime);
+	snprintf(szTime, 64, "%.2f", fTime);
 	szTime[63] = 0;
 	m_poutTime->value(szTime);
-	m_poutTime->redraw();
+	prs->invalidate(m_poutTime);
 	
 	if (m_pwndIndicatorWnd->floatingIndicatorSnapped()) {
 		m_pbtRemoveCamKeyFrame->activate();
@@ -716,6 +734,11 @@ float ModelerUI::endTime() const
 	return m_pwndGraphWidget->endTime();
 }
 
+unsigned long long ModelerUI::scriptHash() const
+{
+	return m_pwndGraphWidget->scriptHash();
+}
+
 void ModelerUI::playStartTime(float fTime)
 {
 	if (fTime >= 0.0f && fTime <= endTime()) {
@@ -730,7 +753,7 @@ void ModelerUI::playStartTime(float fTime)
 	}
 
 	char szTime[64];
-	_snprintf(szTime, 64, "%.2f", fTime);
+	snprintf(szTime, 64, "%.2f", fTime);
 	szTime[63] = 0;
 	m_poutPlayStart->value(szTime);
 	m_poutPlayStart->redraw();
@@ -755,7 +778,7 @@ void ModelerUI::playEndTime(float fTime)
 	}
 
 	char szTime[64];
-	_snprintf(szTime, 64, "%.2f", fTime);
+	snprintf(szTime, 64, "%.2f", fTime);
 	szTime[63] = 0;
 	m_poutPlayEnd->value(szTime);
 	m_poutPlayEnd->redraw();
@@ -778,10 +801,44 @@ float ModelerUI::controlValue(int iControl) const
 	}
 	else {
 		// curve mode
-		return m_pwndGraphWidget->curve(iControl)->evaluateCurveAt(m_pwndGraphWidget->currTime());
+		return pose(m_pwndGraphWidget->currTime()).m_fvControls[iControl];
 	}
 }
 
+const Pose& ModelerUI::pose(float fTime) const
+{
+	// any curve edit (including camera keyframes) bumps the revision
+	if (m_iPoseCacheRevision != Curve::revision()) {
+		m_pcPoseCache.clear();
+		m_iPoseCacheRevision = Curve::revision();
+	}
+
+	const Pose* ppose = m_pcPoseCache.find(fTime);
+	if (ppose == NULL) {
+		float fKeyTime = m_pcPoseCache.keyTime(fTime);
+		Pose pose;
+		pose.m_fvControls.resize(m_iCurrControlCount);
+		for (int i = 0; i < m_iCurrControlCount; ++i)
+			pose.m_fvControls[i] = m_pwndGraphWidget->curve(i)->evaluateCurveAt(fKeyTime);
+		pose.m_bHasCamera = m_pwndModelerView->m_curve_camera->evaluateKeyframes(fKeyTime, pose.m_fvCamera);
+		ppose = m_pcPoseCache.insert(fTime, pose);
+	}
+	return *ppose;
+}
+
+void ModelerUI::updateCamera(float fTime)
+{
+	Camera* pcam = m_pwndModelerView->m_camera;
+	if (pcam != m_pwndModelerView->m_curve_camera) {
+		pcam->update(fTime);
+		return;
+	}
+
+	const Pose& posCurr = pose(fTime);
+	if (posCurr.m_bHasCamera)
+		pcam->applyKeyframes(posCurr.m_fvCamera);
+}
+
 void ModelerUI::controlValue(int iControl, float fVal) 
 {
 	valueSlider(iControl)->value(fVal);
@@ -813,16 +870,61 @@ void ModelerUI::simulate(bool bSimulate)
 
 void ModelerUI::redrawModelerView()
 {
-	m_pwndModelerView->redraw();
+	RedrawScheduler::Instance()->invalidate(m_pwndModelerView);
 	// save the frame
 	if (m_bSaveMovie) {
-		char szFrameNum[128];
-		_snprintf(szFrameNum, 128, "%d", m_iMovieFrameNum++);
-		std::string strFileName = m_strMovieFileName;
-		strFileName += szFrameNum;
-		strFileName += ".bmp";
-		m_pwndModelerView->saveBMP(strFileName.c_str());
+		m_pwndModelerView->saveBMP(movieFrameFileName(m_iMovieFrameNum++).c_str());
+	}
+}
+
+void ModelerUI::movieFileName(const char* szFileName)
+{
+	m_strMovieFileName = szFileName;
+
+	// Remove the .bmp part, in any case
+	std::string strExt = fileExtension(m_strMovieFileName);
+	std::transform(strExt.begin(), strExt.end(), strExt.begin(), ::tolower);
+	if (strExt == ".bmp")
+		m_strMovieFileName = m_strMovieFileName.substr(0, m_strMovieFileName.length() - 4);
+}
+
+std::string ModelerUI::movieFrameFileName(int iFrameNum) const
+{
+	char szFrameNum[128];
+	snprintf(szFrameNum, 128, "%d", iFrameNum);
+	std::string strFileName = m_strMovieFileName;
+	strFileName += szFrameNum;
+	strFileName += ".bmp";
+	return strFileName;
+}
+
+bool ModelerUI::renderMovieFrames(const char* szScript, const char* szMovieFileName,
+								  int iFirstFrame, int iLastFrame, float fStartTime,
+								  int iWidth, int iHeight)
+{
+	if (!openAniScript(szScript))
+		return false;
+	movieFileName(szMovieFileName);
+
+	// only the view is needed; its GL context is private to this process
+	if (iWidth > 0 && iHeight > 0)
+		m_pwndModelerWnd->size(iWidth, iHeight);
+	m_pwndModelerWnd->show();
+	Fl::check();
+
+	// frames come from the bake, never from a live simulation
+	simulate(false);
+	playStartTime(0.0f);
+	playEndTime(endTime());
+
+	for (int iFrame = iFirstFrame; iFrame <= iLastFrame; ++iFrame) {
+		currTime(fStartTime + (float)iFrame / (float)m_iFps);
+		m_pwndModelerView->drawFrame();
+		m_pwndModelerView->saveBMP(movieFrameFileName(iFrame).c_str());
 	}
+
+	m_pwndModelerWnd->hide();
+	return true;
 }
 
 void ModelerUI::indicatorRangeMarkerRange(float fMin, float fMax)
@@ -884,7 +986,8 @@ m_iCurrControlCount(0),
 m_pcbfValueChangedCallback(NULL),
 m_iFps(30),
 m_bAnimating(false),
-m_bSaveMovie(false)
+m_bSaveMovie(false),
+m_iPoseCacheRevision(-1)
 {
 	// setup all the callback functions...
 	m_pmiOpenAniScript->callback((Fl_Callback*)cb_openAniScript);
@@ -925,6 +1028,15 @@ m_bSaveMovie(false)
 	m_pwndMainWnd->callback((Fl_Callback*)cb_hide);
 	m_pwndMainWnd->when(FL_HIDE);
 
+	// widgets that recorded sessions are replayed into
+	EventRecorder* per = EventRecorder::Instance();
+	per->target(EventRecorder::GRAPH_WIDGET, m_pwndGraphWidget);
+	per->target(EventRecorder::MODELER_VIEW, m_pwndModelerView);
+	per->target(EventRecorder::INDICATOR_WINDOW, m_pwndIndicatorWnd);
+	per->target(EventRecorder::TIME_SLIDER, m_psldrTimeSlider);
+	per->target(EventRecorder::PLAY_START_SLIDER, m_psldrPlayStart);
+	per->target(EventRecorder::PLAY_END_SLIDER, m_psldrPlayEnd);
+
 	m_poutTime->value("0.00");
 	m_poutPlayStart->value("0.00");
 	m_poutPlayEnd->value("20.00");
@@ -985,11 +1097,13 @@ void ModelerUI::addControl(const char* szName, float fMin, float fMax, float fSt
 void ModelerUI::replaceModelerView(ModelerView* pwndNewModelerView)
 {
 	m_pwndModelerWnd->remove(*m_pwndModelerView);
+	RedrawScheduler::Instance()->forget(m_pwndModelerView);
 	delete m_pwndModelerView;
 
 	m_pwndModelerView = pwndNewModelerView;
 	m_pwndModelerView->resize(0, 0, m_pwndModelerWnd->w(), m_pwndModelerWnd->h());
 	m_pwndModelerWnd->add_resizable(*m_pwndModelerView);
+	EventRecorder::Instance()->target(EventRecorder::MODELER_VIEW, m_pwndModelerView);
 }
 
 bool ModelerUI::openAniScript(const char* szFileName)
@@ -1001,10 +1115,7 @@ bool ModelerUI::openAniScript(const char* szFileName)
 		string strCamKeyframeFileName = szFileName;
 		strCamKeyframeFileName += ".cam";
 		m_pwndModelerView->m_curve_camera->loadKeyframes(strCamKeyframeFileName.c_str());
-		// sychronize the indicator window with the loaded keyframes
-		m_pwndIndicatorWnd->clearIndicators();
-		for (int ikf = 0; ikf < m_pwndModelerView->m_curve_camera->numKeyframes(); ++ikf)
-			m_pwndIndicatorWnd->addIndicator(m_pwndModelerView->m_curve_camera->keyframeTime(ikf));
+		camKeyframesChanged();
 
 		return true;
 	}
@@ -1012,6 +1123,14 @@ bool ModelerUI::openAniScript(const char* szFileName)
 		return false;
 }
 
+void ModelerUI::camKeyframesChanged()
+{
+	// sychronize the indicator window with the loaded keyframes
+	m_pwndIndicatorWnd->clearIndicators();
+	for (int ikf = 0; ikf < m_pwndModelerView->m_curve_camera->numKeyframes(); ++ikf)
+		m_pwndIndicatorWnd->addIndicator(m_pwndModelerView->m_curve_camera->keyframeTime(ikf));
+}
+
 void ModelerUI::autoLoadNPlay()
 {
 	if (openAniScript("animator.ani")) {
@@ -1019,3 +1138,46 @@ void ModelerUI::autoLoadNPlay()
 		animate(true);
 	}
 }
+
+void ModelerUI::saveSession(std::ostream& os) const
+{
+	// enough digits that the floats read back the same
+	std::streamsize iPrecision = os.precision(9);
+
+	const Camera* pcam = m_pwndModelerView->m_camera;
+	os << currTime() << std::endl;
+	os << pcam->getAzimuth() << " " << pcam->getElevation() << " " << pcam->getDolly() << " "
+		<< pcam->getLookAt()[0] << " " << pcam->getLookAt()[1] << " " << pcam->getLookAt()[2] << " "
+		<< pcam->getTwist() << std::endl;
+	m_pwndGraphWidget->writeScript(os);
+	m_pwndModelerView->m_curve_camera->writeKeyframes(os);
+
+	os.precision(iPrecision);
+}
+
+bool ModelerUI::loadSession(std::istream& is)
+{
+	float fTime;
+	float fvCamera[NUM_KEY_CURVES];
+	float fTwist;
+
+	is >> fTime;
+	for (int i = 0; i < NUM_KEY_CURVES; ++i)
+		is >> fvCamera[i];
+	is >> fTwist;
+	if (is.fail() || !m_pwndGraphWidget->readScript(is))
+		return false;
+	endTime(m_pwndGraphWidget->endTime());
+	activeCurvesChanged();
+	// none were set if the session had none
+	m_pwndModelerView->m_curve_camera->readKeyframes(is);
+	camKeyframesChanged();
+
+	currTime(fTime);
+	// after the time, which moves a keyframed camera
+	Camera* pcam = m_pwndModelerView->m_camera;
+	pcam->applyKeyframes(fvCamera);
+	pcam->setTwist(fTwist);
+	m_pwndModelerView->redraw();
+	return true;
+}
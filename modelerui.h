@@ -13,6 +13,7 @@
 #include "modelerapp.h"
 #include "particleSystem.h"
 #include "modeleruiwindows.h"
+#include "posecache.h"
 
 extern float cat;
 
@@ -42,7 +43,27 @@ public:
 	bool simulate() const;
 	void simulate(bool bSimulate);
 	void redrawModelerView();
+	// Movie frame iFrameNum is saved as m_strMovieFileName + iFrameNum + ".bmp"
+	void movieFileName(const char* szFileName);
+	std::string movieFrameFileName(int iFrameNum) const;
+	// Export worker: load szScript, then draw and save movie frames
+	// iFirstFrame .. iLastFrame (frame n at fStartTime + n / fps()) with
+	// only the modeler window open. Particles must come from a bake
+	// already loaded into the particle system.
+	bool renderMovieFrames(const char* szScript, const char* szMovieFileName,
+		int iFirstFrame, int iLastFrame, float fStartTime, int iWidth, int iHeight);
     void autoLoadNPlay();
+	// The state a recorded session starts from, so that its replay acts
+	// on the same animation: the current time, the camera, and the
+	// animation script with its camera keyframes
+	void saveSession(std::ostream& os) const;
+	bool loadSession(std::istream& is);
+	// hash of the animation script, which moves the particle emitters
+	unsigned long long scriptHash() const;
+	// Evaluated controls and camera at fTime, served from the pose cache
+	const Pose& pose(float fTime) const;
+	void updateCamera(float fTime);
+	PoseCache& poseCache() const { return m_pcPoseCache; }
 
 protected:
 
@@ -53,6 +74,7 @@ protected:
 	void activeCurvesChanged();
 	void indicatorRangeMarkerRange(float fMin, float fMax);
 	bool openAniScript(const char* szFileName);
+	void camKeyframesChanged();
 	
 private:
 
@@ -66,6 +88,9 @@ private:
 	std::string m_strMovieFileName;
 	int m_iMovieFrameNum;
 
+	mutable PoseCache m_pcPoseCache;
+	mutable int m_iPoseCacheRevision;
+
 	inline void cb_cat_i(Fl_Slider*, void*);
 	static void cb_cat(Fl_Slider*, void*);
 	inline void cb_openAniScript_i(Fl_Menu_*, void*);
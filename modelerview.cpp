@@ -4,9 +4,11 @@
 #include "modelerapp.h"
 #include "particleSystem.h"
 #include "tga.h"
+#include "redrawscheduler.h"
+#include "eventrecorder.h"
 
 #include <FL/Fl.H>
-#include <FL/Fl_Gl_Window.h>
+#include <FL/Fl_Gl_Window.H>
 #include <FL/gl.h>
 #include <GL/glu.h>
 #include <cstdio>
@@ -32,6 +34,8 @@ ModelerView::~ModelerView()
 }
 int ModelerView::handle(int event)
 {
+	EventRecorder::Instance()->record(EventRecorder::MODELER_VIEW, event);
+
     unsigned eventCoordX = Fl::event_x();
 	unsigned eventCoordY = Fl::event_y();
 	unsigned eventButton = Fl::event_button();
@@ -81,7 +85,8 @@ int ModelerView::handle(int event)
 		return Fl_Gl_Window::handle(event);
 	}
 	
-	redraw();
+	// coalesce drag events into at most one redraw per refresh
+	RedrawScheduler::Instance()->invalidate(this);
 
 	return 1;
 }
@@ -169,6 +174,14 @@ void ModelerView::setBMP(const char *fname)
 	bmp_name = fname;
 }
 
+void ModelerView::drawFrame()
+{
+	make_current();
+	draw();
+	valid(1);
+	glFinish();
+}
+
 void ModelerView::saveBMP(const char* szFileName)
 {
 	int xx = x();
@@ -28,6 +28,9 @@ public:
 
 	void setBMP(const char *fname);
 	void saveBMP(const char* szFileName);
+	// Draw into the back buffer right away, without swapping, so that a
+	// following saveBMP() reads exactly this frame
+	void drawFrame();
 	void endDraw();
 
 	void camera(cam_mode_t mode);
@@ -0,0 +1,444 @@
+#pragma warning(disable : 4786)
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "nbody.h"
+#include "particlestate.h"
+#include "threadpool.h"
+#include "integrator.h"
+#include "hash.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define NBODY_SSE
+#include <xmmintrin.h>
+#endif
+
+// f(begin, end) over [0, n) in ranges of chunk, on the pool if there
+// is one; the ranges are the same either way
+template <class F>
+static void forChunks(ThreadPool* pool, int n, const F& f, int chunk = Integrator::CHUNK)
+{
+	if (pool)
+		pool->forRange(n, chunk, f);
+	else {
+		for (int begin = 0; begin < n; begin += chunk)
+			f(begin, std::min(begin + chunk, n));
+	}
+}
+
+// the low 10 bits of v, spread to every third bit
+static unsigned int spread3(unsigned int v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+NBodyGravity::NBodyGravity()
+	: strength(0.01f), theta(0.5f), softening(0.1f), count(0)
+{
+}
+
+unsigned long long NBodyGravity::hash(unsigned long long h) const
+{
+	h = hashBytes("NBodyGravity", 12, h);
+	h = hashValue(strength, h);
+	h = hashValue(theta, h);
+	return hashValue(softening, h);
+}
+
+void NBodyGravity::prepare(const ParticleState& s, ThreadPool* pool)
+{
+	count = s.size();
+	nodes.clear();
+	if (count == 0)
+		return;
+	for (int c = 0; c < 3; c++)
+		acc[c].resize(count);
+
+	sortParticles(s, pool);
+
+	// the top of the tree here, then each cell left pending is split on
+	// its own, into a tree of its own
+	std::vector<int> pending;
+	split(nodes, 0, 0, TOP_LEVELS, &pending);
+	std::vector<std::vector<Node> > subtrees(pending.size());
+	auto build = [&](int t) {
+		std::vector<Node>& tree = subtrees[t];
+		tree.push_back(nodes[pending[t]]);
+		split(tree, 0, TOP_LEVELS, -1, NULL);
+	};
+	if (pool)
+		pool->run(pending.size(), build);
+	else {
+		for (int t = 0; t < pending.size(); t++)
+			build(t);
+	}
+
+	// Append the subtrees below their roots. Children always come after
+	// their parents, so one backward sweep then sums up the cells that
+	// are not leaves.
+	for (int t = 0; t < subtrees.size(); t++) {
+		const std::vector<Node>& tree = subtrees[t];
+		int offset = nodes.size() - 1;	// tree's node 1 goes here + 1
+		nodes[pending[t]] = tree[0];
+		for (int k = 1; k < tree.size(); k++)
+			nodes.push_back(tree[k]);
+		for (int k = offset + 1; k < nodes.size(); k++) {
+			if (nodes[k].children > 0)
+				nodes[k].child += offset;
+		}
+		if (tree[0].children > 0)
+			nodes[pending[t]].child += offset;
+	}
+	for (int k = nodes.size() - 1; k >= 0; k--) {
+		Node& node = nodes[k];
+		if (node.children == 0)
+			continue;
+		float m = 0, x = 0, y = 0, z = 0;
+		for (int c = node.child; c < node.child + node.children; c++) {
+			const Node& child = nodes[c];
+			m += child.mass;
+			x += child.mass * child.x;
+			y += child.mass * child.y;
+			z += child.mass * child.z;
+		}
+		node.mass = m;
+		if (m > 0) {
+			node.x = x / m; node.y = y / m; node.z = z / m;
+		}
+		else {
+			node.x = node.ox + 0.5f * node.size;
+			node.y = node.oy + 0.5f * node.size;
+			node.z = node.oz + 0.5f * node.size;
+		}
+	}
+
+	// Every group, the largest cells of at most GROUP_SIZE particles,
+	// walks the tree once for the cells and particles that act on all
+	// of its particles; then each of them sums that list
+	groups.clear();
+	std::vector<int> stack(1, 0);
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		int k = stack.back();
+		stack.pop_back();
+		if (node.count <= GROUP_SIZE || node.children == 0)
+			groups.push_back(k);
+		else {
+			for (int c = node.child; c < node.child + node.children; c++)
+				stack.push_back(c);
+		}
+	}
+	auto walk = [&](int begin, int end) {
+		std::vector<float> list[4];
+		for (int g = begin; g < end; g++) {
+			const Node& group = nodes[groups[g]];
+			interactions(group, list);
+			for (int j = group.first; j < group.first + group.count; j++) {
+				float a[3];
+				sum(j, list, a);
+				int i = order[j];
+				for (int c = 0; c < 3; c++)
+					acc[c][i] = strength * a[c];
+			}
+		}
+	};
+	if (pool)
+		pool->forRange(groups.size(), 4, walk);
+	else
+		walk(0, groups.size());
+}
+
+void NBodyGravity::sortParticles(const ParticleState& s, ThreadPool* pool)
+{
+	// the bounding cube, which is the root: each chunk's box, then
+	// their union
+	const float* p[3] = { s.px, s.py, s.pz };
+	int chunks = (count + Integrator::CHUNK - 1) / Integrator::CHUNK;
+	std::vector<float> boxes(6 * chunks);
+	forChunks(pool, count, [&](int begin, int end) {
+		float* box = &boxes[6 * (begin / Integrator::CHUNK)];
+		for (int c = 0; c < 3; c++) {
+			float l = p[c][begin], h = p[c][begin];
+			for (int i = begin + 1; i < end; i++) {
+				l = std::min(l, p[c][i]);
+				h = std::max(h, p[c][i]);
+			}
+			box[c] = l;
+			box[3 + c] = h;
+		}
+	});
+	float lo[3] = { boxes[0], boxes[1], boxes[2] };
+	float hi[3] = { boxes[3], boxes[4], boxes[5] };
+	for (int k = 1; k < chunks; k++) {
+		for (int c = 0; c < 3; c++) {
+			lo[c] = std::min(lo[c], boxes[6 * k + c]);
+			hi[c] = std::max(hi[c], boxes[6 * k + 3 + c]);
+		}
+	}
+	float edge = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+	edge = edge * 1.0001f + 1e-6f;
+	Node root = { 0, 0, 0, 0, lo[0], lo[1], lo[2], edge, 0, count, 0, 0 };
+	nodes.push_back(root);
+
+	keys.resize(count);
+	order.resize(count);
+	float scale = (1 << LEVELS) / edge;
+	forChunks(pool, count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			unsigned int q[3];
+			for (int c = 0; c < 3; c++) {
+				float v = (p[c][i] - lo[c]) * scale;
+				q[c] = v > 0 ? std::min((unsigned int)v, (1u << LEVELS) - 1) : 0;
+			}
+			keys[i] = spread3(q[0]) | (spread3(q[1]) << 1) | (spread3(q[2]) << 2);
+			order[i] = i;
+		}
+	});
+
+	// Three 10 bit radix passes over the 30 bit keys. Each chunk counts
+	// its keys per bucket; a bucket's keys go chunk after chunk, so each
+	// chunk then scatters its own from where its share starts. Stable,
+	// so equal keys keep their particle order.
+	keyScratch.resize(count);
+	orderScratch.resize(count);
+	chunks = (count + SORT_CHUNK - 1) / SORT_CHUNK;
+	buckets.resize(1024 * chunks);
+	for (int shift = 0; shift < 3 * LEVELS; shift += 10) {
+		forChunks(pool, count, [&](int begin, int end) {
+			int* bucket = &buckets[1024 * (begin / SORT_CHUNK)];
+			memset(bucket, 0, 1024 * sizeof(int));
+			for (int i = begin; i < end; i++)
+				bucket[(keys[i] >> shift) & 1023]++;
+		}, SORT_CHUNK);
+		int next = 0;
+		for (int b = 0; b < 1024; b++) {
+			for (int k = 0; k < chunks; k++) {
+				int n = buckets[1024 * k + b];
+				buckets[1024 * k + b] = next;
+				next += n;
+			}
+		}
+		forChunks(pool, count, [&](int begin, int end) {
+			int* bucket = &buckets[1024 * (begin / SORT_CHUNK)];
+			for (int i = begin; i < end; i++) {
+				int to = bucket[(keys[i] >> shift) & 1023]++;
+				keyScratch[to] = keys[i];
+				orderScratch[to] = order[i];
+			}
+		}, SORT_CHUNK);
+		keys.swap(keyScratch);
+		order.swap(orderScratch);
+	}
+
+	for (int c = 0; c < 4; c++)
+		sorted[c].resize(count);
+	forChunks(pool, count, [&](int begin, int end) {
+		for (int j = begin; j < end; j++) {
+			int i = order[j];
+			sorted[0][j] = s.px[i];
+			sorted[1][j] = s.py[i];
+			sorted[2][j] = s.pz[i];
+			sorted[3][j] = s.mass[i];
+		}
+	});
+}
+
+void NBodyGravity::split(std::vector<Node>& tree, int node, int level, int stop,
+	std::vector<int>* pending) const
+{
+	Node cell = tree[node];
+	if (cell.count <= LEAF_SIZE || level == LEVELS) {
+		leaf(tree[node]);
+		return;
+	}
+	if (level == stop) {
+		pending->push_back(node);
+		return;
+	}
+
+	// The cell's keys share their bits above this level's 3; the
+	// children are the runs of each value of those 3 bits
+	int shift = 3 * (LEVELS - 1 - level);
+	const unsigned int* first = &keys[cell.first];
+	const unsigned int* last = first + cell.count;
+	unsigned int prefix = *first & ~((8u << shift) - 1);
+	int bounds[9];
+	bounds[0] = 0;
+	for (int d = 1; d < 8; d++)
+		bounds[d] = std::lower_bound(first, last, prefix | (d << shift)) - first;
+	bounds[8] = cell.count;
+
+	int children = 0;
+	for (int d = 0; d < 8; d++)
+		children += bounds[d + 1] > bounds[d];
+	int child = tree.size();
+	tree[node].child = child;
+	tree[node].children = children;
+	tree.resize(child + children);
+
+	float half = 0.5f * cell.size;
+	int k = child;
+	for (int d = 0; d < 8; d++) {
+		if (bounds[d + 1] == bounds[d])
+			continue;
+		Node& c = tree[k++];
+		c.ox = cell.ox + ((d & 1) ? half : 0);
+		c.oy = cell.oy + ((d & 2) ? half : 0);
+		c.oz = cell.oz + ((d & 4) ? half : 0);
+		c.size = half;
+		c.first = cell.first + bounds[d];
+		c.count = bounds[d + 1] - bounds[d];
+		c.child = c.children = 0;
+	}
+	for (k = child; k < child + children; k++)
+		split(tree, k, level + 1, stop, pending);
+}
+
+void NBodyGravity::leaf(Node& node) const
+{
+	float m = 0, x = 0, y = 0, z = 0;
+	for (int j = node.first; j < node.first + node.count; j++) {
+		float mj = sorted[3][j];
+		m += mj;
+		x += mj * sorted[0][j];
+		y += mj * sorted[1][j];
+		z += mj * sorted[2][j];
+	}
+	node.mass = m;
+	node.child = node.children = 0;
+	if (m > 0) {
+		node.x = x / m; node.y = y / m; node.z = z / m;
+	}
+	else {
+		node.x = node.ox + 0.5f * node.size;
+		node.y = node.oy + 0.5f * node.size;
+		node.z = node.oz + 0.5f * node.size;
+	}
+}
+
+void NBodyGravity::interactions(const Node& group, std::vector<float> list[4]) const
+{
+	// the group's particles' bounding box
+	float lo[3], hi[3];
+	for (int c = 0; c < 3; c++) {
+		lo[c] = hi[c] = sorted[c][group.first];
+		for (int j = group.first + 1; j < group.first + group.count; j++) {
+			lo[c] = std::min(lo[c], sorted[c][j]);
+			hi[c] = std::max(hi[c], sorted[c][j]);
+		}
+	}
+	float theta2 = theta * theta;
+	for (int c = 0; c < 4; c++)
+		list[c].clear();
+
+	// at most 7 cells wait per level
+	int stack[8 * (LEVELS + 2)];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		// the box's distance to the centre of mass
+		const float centre[3] = { node.x, node.y, node.z };
+		float d2 = 0;
+		for (int c = 0; c < 3; c++) {
+			float d = std::max(lo[c] - centre[c], std::max(centre[c] - hi[c], 0.0f));
+			d2 += d * d;
+		}
+		// and, for cells far enough, whether they still overlap the box,
+		// as the group's own cells and their parents do with a wide theta
+		bool far = node.size * node.size < theta2 * d2;
+		if (far) {
+			const float corner[3] = { node.ox, node.oy, node.oz };
+			bool apart = false;
+			for (int c = 0; c < 3; c++)
+				apart = apart || corner[c] > hi[c] || lo[c] > corner[c] + node.size;
+			far = apart;
+		}
+
+		// far enough from every particle of the group: one body
+		if (far) {
+			list[0].push_back(node.x);
+			list[1].push_back(node.y);
+			list[2].push_back(node.z);
+			list[3].push_back(node.mass);
+		}
+		else if (node.children == 0) {
+			for (int c = 0; c < 4; c++)
+				list[c].insert(list[c].end(), &sorted[c][node.first], &sorted[c][node.first] + node.count);
+		}
+		else {
+			for (int c = node.child; c < node.child + node.children; c++)
+				stack[top++] = c;
+		}
+	}
+}
+
+void NBodyGravity::sum(int i, const std::vector<float> list[4], float a[3]) const
+{
+	// A particle's own entry, at distance 0, adds nothing as long as
+	// the softening is not 0
+	float eps2 = std::max(softening * softening, 1e-12f);
+	float x = sorted[0][i], y = sorted[1][i], z = sorted[2][i];
+	int n = list[0].size();
+	const float* lx = n ? &list[0][0] : NULL;
+	const float* ly = n ? &list[1][0] : NULL;
+	const float* lz = n ? &list[2][0] : NULL;
+	const float* lm = n ? &list[3][0] : NULL;
+	float ax = 0, ay = 0, az = 0;
+	int k = 0;
+#ifdef NBODY_SSE
+	__m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y), vz = _mm_set1_ps(z);
+	__m128 veps = _mm_set1_ps(eps2);
+	__m128 half = _mm_set1_ps(0.5f), three = _mm_set1_ps(3.0f);
+	__m128 sx = _mm_setzero_ps(), sy = _mm_setzero_ps(), sz = _mm_setzero_ps();
+	for (; k + 4 <= n; k += 4) {
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(lx + k), vx);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(ly + k), vy);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(lz + k), vz);
+		__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+			_mm_add_ps(_mm_mul_ps(dz, dz), veps));
+		// estimate 1 / sqrt(r2), then one Newton step to full precision
+		__m128 inv = _mm_rsqrt_ps(r2);
+		inv = _mm_mul_ps(_mm_mul_ps(half, inv),
+			_mm_sub_ps(three, _mm_mul_ps(r2, _mm_mul_ps(inv, inv))));
+		__m128 f = _mm_mul_ps(_mm_loadu_ps(lm + k), _mm_mul_ps(inv, _mm_mul_ps(inv, inv)));
+		sx = _mm_add_ps(sx, _mm_mul_ps(f, dx));
+		sy = _mm_add_ps(sy, _mm_mul_ps(f, dy));
+		sz = _mm_add_ps(sz, _mm_mul_ps(f, dz));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, sx);
+	ax = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	_mm_storeu_ps(lanes, sy);
+	ay = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	_mm_storeu_ps(lanes, sz);
+	az = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+	for (; k < n; k++) {
+		float dx = lx[k] - x, dy = ly[k] - y, dz = lz[k] - z;
+		float inv = 1.0f / sqrtf(dx * dx + dy * dy + dz * dz + eps2);
+		float f = lm[k] * inv * inv * inv;
+		ax += f * dx; ay += f * dy; az += f * dz;
+	}
+	a[0] = ax; a[1] = ay; a[2] = az;
+}
+
+void NBodyGravity::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	// nothing prepared for this state, e.g. stepped without prepare()
+	if (in.first + in.n > count)
+		return;
+	const float* a[3] = { &acc[0][in.first], &acc[1][in.first], &acc[2][in.first] };
+	for (int i = 0; i < in.n; i++) {
+		ax[i] += a[0][i];
+		ay[i] += a[1][i];
+		az[i] += a[2][i];
+	}
+}
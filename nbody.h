@@ -0,0 +1,82 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include "forcefield.h"
+
+// NBodyGravity makes every particle attract every other one, with
+// strength * mass / (distance^2 + softening^2): galaxies, swarms.
+//
+// Summing all pairs would take n^2 work, so it is approximated by the
+// Barnes-Hut method. An octree is built over the particles each step;
+// a cell far enough away, whose edge is less than theta times its
+// distance, acts as a single particle of its total mass at its centre
+// of mass. theta = 0 is exact; 0.5 is within a percent or so.
+//
+// As with SphFluid, everything is computed in prepare(). The particles
+// are sorted along a Morton curve, so every cell is a run of them; the
+// bounds, keys and radix sort passes are split over the pool. The
+// top levels of the tree are split serially, and the cells below are
+// built in parallel on the thread pool. Then, also in parallel, groups
+// of nearby particles (cells of up to GROUP_SIZE) walk the tree once for
+// all of them, opening cells by their distance to the group's bounding
+// box, and each particle sums the resulting list of bodies four at a
+// time. The result does not depend on the number of threads.
+class NBodyGravity : public ForceKernel {
+public:
+	NBodyGravity();
+
+	virtual void prepare(const ParticleState& s, ThreadPool* pool);
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+
+	float strength;						// the gravitational constant
+	float theta;						// opening angle
+	float softening;					// keeps close encounters finite
+
+	// cells in the last tree built
+	int cells() const { return nodes.size(); }
+
+private:
+	// A cube of the tree. Its particles are sorted[first .. first + count),
+	// its children (if any) consecutive from nodes[child].
+	struct Node {
+		float x, y, z, mass;			// centre of mass, total mass
+		float ox, oy, oz, size;			// lowest corner, edge
+		int first, count;
+		int child, children;
+	};
+
+	enum {
+		LEVELS = 10,					// Morton bits per axis
+		LEAF_SIZE = 16,					// particles a cell may hold unsplit
+		TOP_LEVELS = 2,					// split serially; up to 64 subtrees below
+		GROUP_SIZE = 64,				// particles sharing a walk, at most
+		SORT_CHUNK = 16384				// particles per radix sort job
+	};
+
+	// Morton keys and order of the particles, and their sorted copies
+	void sortParticles(const ParticleState& s, ThreadPool* pool);
+	// splits tree[node], which is at level; cells reaching level stop
+	// are left to split later and listed in pending
+	void split(std::vector<Node>& tree, int node, int level, int stop,
+		std::vector<int>* pending) const;
+	void leaf(Node& node) const;
+	// the bodies acting on group's particles: x, y, z, mass
+	void interactions(const Node& group, std::vector<float> list[4]) const;
+	// acceleration of sorted particle i by list, without the strength
+	void sum(int i, const std::vector<float> list[4], float a[3]) const;
+
+	int count;							// particles prepared for
+	std::vector<Node> nodes;
+	std::vector<int> groups;			// cells that walk the tree
+	std::vector<unsigned int> keys, keyScratch;
+	std::vector<int> order, orderScratch;	// particle index by curve position
+	std::vector<int> buckets;			// radix sort counts, 1024 per chunk
+	std::vector<float> sorted[4];		// x, y, z, mass in curve order
+	std::vector<float> acc[3];
+};
+
+#endif
@@ -5,28 +5,30 @@
 #include <vector>
 
 #include <FL/Fl.H>
-#include <FL/Fl_Gl_Window.h>
+#include <FL/Fl_Gl_Window.H>
 #include <FL/gl.h>
 #include <GL/glu.h>
 
-class Force;
-
+// A single particle, gathered from / scattered to a ParticleState.
+// Particles are stored as arrays in ParticleState, this is only the
+// per-particle view used where one particle is handled at a time.
 class Particle{
 public:
 	Particle();
 	Particle(float x, float y, float z)
-		:velocity(Vec3f(x, y, z)), position(Vec3f(0, 0, 0)), mass(1.0){};
-	void draw(Camera* cam);
+		:velocity(Vec3f(x, y, z)), position(Vec3f(0, 0, 0)), mass(1.0), age(0.0), lifetime(0.0), id(0), emitter(0){};
 	void update(Vec3f velocity, Vec3f position);
-	bool toofar();
-	void attachForce(Force f);
+	bool toofar() const;
+	static bool toofar(const Vec3f& position);
 	Vec3f velocity;
 	Vec3f position;
 	float mass;
-	std::vector<Force> force;
-	friend class Force;
+	float age;							// seconds since spawned
+	float lifetime;						// dies at this age; <= 0: never
+	unsigned int id;					// emission order, unique in a system
+	int emitter;						// index of its emitter in the system
 
-	static GLuint texID;
+	static GLuint texID;				// drawn by Billboards
 };
 
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma warning(disable : 4786)
 
 #include "particleSystem.h"
+#include "hash.h"
+#include "random.h"
 
 
 #include <stdio.h>
@@ -14,24 +16,47 @@
  * Constructors
  ***************/
 
-class SortCamera {
-public:
-	SortCamera(Camera* cam) : camera(cam) {}
-
-	bool operator()(Particle& x, Particle& y) const {
-		Vec3f cd = camera->getLookAt() - camera->getPos();
-		return ((y.position - x.position) * cd) < 0;
-	}
-
-	Camera* camera;
-};
 
 ParticleSystem::ParticleSystem() 
+	: playback(bake)
 {
 	simulate = false;
 	bake_fps = 30; //bake 30 per seconds
-	max_bake = 10000;
-	number = 10;
+	bake_budget = 256 << 20;
+	cache_salt = 0;
+	interpolation = BakePlayback::NEAREST;
+	shown = &particles;
+	blend_src = GL_SRC_ALPHA;
+	blend_dst = GL_ONE;
+	emitters.push_back(Emitter("default"));
+	forces.add(new EmitterForces(emitters), "emitters");
+	next_id = 0;
+	seed = 0;
+	max_substeps = 8;
+	step_rate = 240;
+	steps = 0;
+	next_frame = 0;
+	checkpoint_interval = 30;
+	checkpoint_bytes = 0;
+	bake_key = 0;
+	setCapacity(20000);
+}
+
+void ParticleSystem::setCapacity(int n)
+{
+	capacity = n;
+	// everything the update writes is sized for a full pool here
+	particles.reserve(n);
+	compacted.reserve(n);
+	alive.reserve(n);
+	between.reserve(n);
+	survivors.reserve(n / Integrator::CHUNK + 2);
+	drawOrder.reserve(n);
+	billboards.reserve(n);
+	for (int c = 0; c < 3; c++) {
+		previous[c].reserve(n);
+		start[c].reserve(n);
+	}
 }
 
 
@@ -52,8 +77,29 @@ ParticleSystem::~ParticleSystem()
 void ParticleSystem::startSimulation(float t)
 {
     
-	bake_start_time = t;
-	last_time = t;
+	//The bake and checkpoints are only picked up from if they were made
+	//under the settings, script included, as they are now
+	unsigned long long key = settingsHash(cache_salt);
+	if (key != bake_key) {
+		bake.clear();
+		eraseCheckpoints(checkpoints.begin(), checkpoints.end());
+		bake_key = key;
+	}
+
+	//Pick up from the last checkpoint at or before t, if there is one,
+	//rather than from the start: the frames after it are simulated again
+	if (!resume(bakeIndex(t))) {
+		bake_start_time = t;
+		steps = 0;
+		next_frame = bakeIndex(t);
+		//Nothing was checkpointed before t, so what was simulated from t
+		//on belongs to another run
+		bake.removeAfter(next_frame - 1);
+		eraseCheckpoints(checkpoints.begin(), checkpoints.end());
+		for (int e = 0; e < emitters.size(); e++) {
+			emitters[e].emitted = false;
+		}
+	}
 	// These values are used by the UI ...
 	// -ve bake_end_time indicates that simulation
 	// is still progressing, and allows the
@@ -75,6 +121,10 @@ void ParticleSystem::stopSimulation(float t)
 	simulate = false;
 	dirty = true;
 
+	if (!cache_file.empty() && !saveBakeCache()) {
+		fprintf(stderr, "ERROR: can't write bake cache %s\n", cache_file.c_str());
+	}
+
 }
 
 /** Reset the simulation */
@@ -88,56 +138,262 @@ void ParticleSystem::resetSimulation(float t)
 /** Compute forces and update particles **/
 void ParticleSystem::computeForcesAndUpdateParticles(float t)
 {
-	int i, bake_index;
 	if (!simulate) {
-		last_time = t;
 		return;
 	}
 
-	if (loadBaked(t)) {
+	// only an exact hit may skip the step; loadBaked() also accepts the
+	// neighbouring frames, which would stall a simulation stepped at
+	// exactly the bake rate on the frame it has just baked. The bake
+	// only keeps positions, so particles stays the last simulated state
+	// and the simulation picks up from there past the end of the bake.
+	if (bake.has(bakeIndex(t))) {
 		return;
 	}
 
-	for (i = 0; i < number; i++) {
-		Particle p;
-		p.mass = 3.0;
-		p.position = init_position;
-		p.velocity = init_velocity;
-		for (int j = 0; j<3; j++) {
-			p.position[j] += 0.1* (rand() % 5 - 2.5);
-			p.velocity[j] += 0.1* (rand() % 5 - 2.5);
+	//Simulate in fixed steps of 1 / step_rate counted from the start,
+	//whatever times this is called at, up to the frame of t. Every frame
+	//on the way emits and is baked, from the steps either side of it, so
+	//the bake only depends on the settings and the emitters' path, not
+	//on how often or when the UI redraws. The model placed the emitters
+	//for t; a frame before it emits from between there and where the
+	//previous frame emitted, as if the model had been drawn for it.
+	int last = bakeIndex(t);
+	for (; next_frame <= last; next_frame++) {
+		// the frame's time, in steps from the start
+		float u = (next_frame / bake_fps - bake_start_time) * step_rate;
+		int k = std::max(0, (int)ceilf(u - 1e-3f));
+		while (steps < k) {
+			stepParticles(1.0f / step_rate);
+			steps++;
+		}
+		// a frame of the way from the previous frame to that of t
+		emitParticles(next_frame, 1.0f / (last - next_frame + 1));
+		bakeFrame(next_frame, k - u);
+		if (checkpoint_interval > 0 &&
+			(next_frame - bakeIndex(bake_start_time)) % checkpoint_interval == 0) {
+			saveCheckpoint(next_frame);
 		}
-		particles.push_back(p);
 	}
+}
 
-	//Compute force on particles one by one
-	std::vector<Particle>::iterator iterator;
-	float dt = t - last_time;
-	for (iterator = particles.begin(); iterator != particles.end();) {
-		if (iterator->toofar()) {
-			iterator = particles.erase(iterator);
-			continue;
+void ParticleSystem::saveCheckpoint(int frame)
+{
+	//Everything the frames after this one are simulated from; the
+	//random numbers are counted by frame, so the frame is their state
+	std::map<int, Checkpoint>::iterator it = checkpoints.find(frame);
+	if (it != checkpoints.end()) {
+		checkpoint_bytes -= it->second.bytes();
+	}
+	Checkpoint& c = checkpoints[frame];
+	c.start_time = bake_start_time;
+	c.steps = steps;
+	c.next_id = next_id;
+	c.particles.copyFrom(particles);
+	for (int i = 0; i < 3; i++) {
+		c.start[i] = start[i];
+	}
+	c.emitters.resize(emitters.size());
+	for (int e = 0; e < emitters.size(); e++) {
+		c.emitters[e].emitted = emitters[e].emitted;
+		c.emitters[e].emittedPosition = emitters[e].emittedPosition;
+		c.emitters[e].emittedDirection = emitters[e].emittedDirection;
+	}
+	c.substeps = integrator.substepSizes();
+	checkpoint_bytes += c.bytes();
+
+	//They count against the bake budget; past it the oldest go, so a
+	//long bake can still be resumed near its end
+	while (checkpoints.size() > 1 && bake.bytes() + checkpoint_bytes > bake_budget) {
+		eraseCheckpoints(checkpoints.begin(), ++checkpoints.begin());
+	}
+}
+
+size_t ParticleSystem::Checkpoint::bytes() const
+{
+	size_t n = sizeof(Checkpoint) + emitters.size() * sizeof(Emitter);
+	n += particles.capacity() * (9 * sizeof(float) + sizeof(unsigned int) + sizeof(unsigned short));
+	for (int i = 0; i < 3; i++) {
+		n += start[i].capacity() * sizeof(float);
+	}
+	return n + substeps.capacity() * sizeof(float);
+}
+
+void ParticleSystem::eraseCheckpoints(std::map<int, Checkpoint>::iterator first,
+	std::map<int, Checkpoint>::iterator last)
+{
+	for (std::map<int, Checkpoint>::iterator it = first; it != last; ++it) {
+		checkpoint_bytes -= it->second.bytes();
+	}
+	checkpoints.erase(first, last);
+}
+
+bool ParticleSystem::resume(int frame)
+{
+	std::map<int, Checkpoint>::iterator it = checkpoints.upper_bound(frame);
+	if (it == checkpoints.begin()) {
+		return false;
+	}
+	--it;
+	int from = it->first;
+	const Checkpoint& c = it->second;
+	bake_start_time = c.start_time;
+	steps = c.steps;
+	next_frame = from + 1;
+	next_id = c.next_id;
+	particles.copyFrom(c.particles);
+	for (int i = 0; i < 3; i++) {
+		start[i] = c.start[i];
+	}
+	//The frames after the checkpoint emit from where it left the
+	//emitters; those added since start from wherever the model puts them
+	for (int e = 0; e < emitters.size(); e++) {
+		emitters[e].emitted = e < c.emitters.size() && c.emitters[e].emitted;
+		if (emitters[e].emitted) {
+			emitters[e].emittedPosition = c.emitters[e].emittedPosition;
+			emitters[e].emittedDirection = c.emitters[e].emittedDirection;
 		}
+	}
+	integrator.substepSizes(c.substeps);
 
-		std::vector<Force> force;
-		std::vector<Force>::iterator forceIterator;
-		for (forceIterator = iterator->force.begin(); forceIterator != iterator->force.end(); forceIterator++) {
-			force.push_back(*forceIterator);
+	//What was simulated after the checkpoint is simulated again, under
+	//the settings as they are now
+	bake.removeAfter(from);
+	eraseCheckpoints(++it, checkpoints.end());
+	return true;
+}
+
+void ParticleSystem::emitParticles(int frame, float w)
+{
+	//Emit into the free slots at the end of the pool, emitter by emitter.
+	//The jitter of the i-th particle of an emitter in a frame only depends
+	//on the seed, the emitter, the frame and i, so any frame emits the
+	//same particles whenever and wherever it is simulated
+	for (int e = 0; e < emitters.size(); e++) {
+		Emitter& source = emitters[e];
+		if (source.emitted) {
+			source.emittedPosition += w * (source.position - source.emittedPosition);
+			source.emittedDirection += w * (source.direction - source.emittedDirection);
+		} else {
+			source.emittedPosition = source.position;
+			source.emittedDirection = source.direction;
+			source.emitted = true;
 		}
-		for (forceIterator = fieldForce.begin(); forceIterator != fieldForce.end(); forceIterator++) {
-			force.push_back(*forceIterator);
+		int emit = capacity - particles.size();
+		if (!source.active || emit <= 0) {
+			continue;
+		}
+		if (emit > source.rate) {
+			emit = source.rate;
+		}
+		for (int i = 0; i < emit; i++) {
+			ParticleRandom jitter(seed, e, frame, i);
+			Particle p;
+			p.mass = source.mass;
+			p.lifetime = source.lifetime;
+			p.id = next_id++;
+			p.emitter = e;
+			p.position = source.emittedPosition;
+			p.velocity = source.speed * source.emittedDirection;
+			for (int j = 0; j<3; j++) {
+				p.position[j] += source.spread * (jitter.below(5) - 2.5);
+				p.velocity[j] += source.spread * (jitter.below(5) - 2.5);
+			}
+			particles.add(p);
 		}
-
-		rungeKuttaMethod(*iterator, force, dt);
-		iterator++;
 	}
+}
 
+void ParticleSystem::stepParticles(float dt)
+{
+	int i;
+
+	//Drop the particles that expired or went too far, then move the rest.
+	//Each pass runs over fixed chunks of particles on the thread pool;
+	//the chunk survivor counts are summed in chunk order, so survivors
+	//keep their order whatever the number of threads.
+	int n = particles.size();
+	const int chunk = Integrator::CHUNK;
+	int chunks = (n + chunk - 1) / chunk;
+	alive.resize(n);
+	survivors.resize(chunks + 1);
+	survivors[0] = 0;
+	pool.forRange(n, chunk, [&](int begin, int end) {
+		int count = 0;
+		for (int i = begin; i < end; i++) {
+			float age = particles.age[i] += dt;
+			float life = particles.lifetime[i];
+			alive[i] = (life <= 0 || age < life) && !Particle::toofar(particles.position(i));
+			count += alive[i];
+		}
+		survivors[begin / chunk + 1] = count;
+	});
+	for (i = 0; i < chunks; i++) {
+		survivors[i + 1] += survivors[i];
+	}
+	if (survivors[chunks] < n) {
+		compacted.resize(survivors[chunks]);
+		pool.forRange(n, chunk, [&](int begin, int end) {
+			compacted.gather(particles, alive, begin, end, survivors[begin / chunk]);
+		});
+		particles.swap(compacted);
+	}
 
+	//Frames between steps are interpolated from here
+	n = particles.size();
+	start[0].assign(particles.px, particles.px + n);
+	start[1].assign(particles.py, particles.py + n);
+	start[2].assign(particles.pz, particles.pz + n);
+
+	//A fluid needs steps short enough for its pressure waves
+	int substeps = 1;
+	SphFluid* sph = getFluid();
+	if (sph && sph->maxStep() > 0 && dt > sph->maxStep()) {
+		substeps = (int)ceilf(dt / sph->maxStep());
+		if (substeps > max_substeps) {
+			substeps = max_substeps;
+		}
+	}
+	bool model = modelCollider.size() > 0;
+	for (i = 0; i < substeps; i++) {
+		//The model is hit by the paths from here to after the step
+		if (model) {
+			previous[0].assign(particles.px, particles.px + n);
+			previous[1].assign(particles.py, particles.py + n);
+			previous[2].assign(particles.pz, particles.pz + n);
+		}
+		forces.prepare(particles, &pool);
+		integrator.step(particles, forces, dt / substeps, &pool);
+		collisions.resolve(particles, grid, &pool);
+		if (model && n > 0) {
+			modelCollider.collide(particles, &previous[0][0], &previous[1][0], &previous[2][0], &pool);
+		}
+	}
+}
 
-	//Bake the particles
-	bakeParticles(t);
-
-	last_time = t;
+void ParticleSystem::bakeFrame(int frame, float behind)
+{
+	if (bake.bytes() + checkpoint_bytes >= bake_budget && !bake.has(frame)) {
+		return;
+	}
+	//On a step, or near enough, the frame is the particles as they are
+	if (behind < 1e-3f) {
+		bake.add(frame, particles);
+		return;
+	}
+	//Else it is behind the last step by that fraction of a step. Only
+	//positions are baked; particles emitted since the step have no
+	//earlier position and stay where they are.
+	between.copyFrom(particles);
+	float s = 1.0f - behind;
+	int n = std::min(particles.size(), (int)start[0].size());
+	float* p[3] = { between.px, between.py, between.pz };
+	for (int c = 0; c < 3; c++) {
+		for (int i = 0; i < n; i++) {
+			p[c][i] = start[c][i] + s * (p[c][i] - start[c][i]);
+		}
+	}
+	bake.add(frame, between);
 }
 
 
@@ -145,9 +401,14 @@ void ParticleSystem::computeForcesAndUpdateParticles(float t)
 void ParticleSystem::drawParticles(float t, Camera* camera)
 {
 
-	if (!loadBaked(t)) {
+	// loadBaked() points shown at the baked particles. While simulating
+	// only an exact baked frame stands in for a step, as in
+	// computeForcesAndUpdateParticles()
+	if ((simulate && !bake.has(bakeIndex(t))) || !loadBaked(t)) {
 		computeForcesAndUpdateParticles(t);
+		shown = &particles;
 	}
+	const ParticleState& state = *shown;
 
 	glEnable(GL_TEXTURE_2D);
 	glEnable(GL_BLEND);
@@ -156,14 +417,18 @@ void ParticleSystem::drawParticles(float t, Camera* camera)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-	std::sort(particles.begin(), particles.end(), SortCamera(camera));
-	
-	// Part of bill boarding
-	std::vector<Particle>::iterator iterator;
-	for (iterator = particles.begin(); iterator != particles.end(); iterator++) {
-		iterator->draw(camera);
+	glBlendFunc(blend_src, blend_dst);
+
+	// back to front, unless the blending makes the order irrelevant;
+	// then the particles mustn't hide each other in the depth buffer
+	// either, but are still hidden by the model
+	if (DepthSort::orderIndependent(blend_src, blend_dst)) {
+		glDepthMask(GL_FALSE);
+		billboards.draw(state, NULL, camera);
+		glDepthMask(GL_TRUE);
+	} else {
+		depthSort.sort(state, camera->getLookAt() - camera->getPos(), drawOrder);
+		billboards.draw(state, &drawOrder, camera);
 	}
 
 	glDisable(GL_BLEND);
@@ -175,87 +440,233 @@ void ParticleSystem::drawParticles(float t, Camera* camera)
   * your data structure for storing baked particles **/
 void ParticleSystem::bakeParticles(float t) 
 {
-	int bake_index = t * bake_fps;
+	int bake_index = bakeIndex(t);
 	//bake particles
-	if (storeBake.size() < max_bake) {
-		storeBake[bake_index] = std::vector<Particle>(particles);
+	if (bake.bytes() + checkpoint_bytes < bake_budget || bake.has(bake_index)) {
+		bake.add(bake_index, particles);
 	}
 }
 
 bool ParticleSystem::loadBaked(float t)
 {
-	int bake_index, i;
-	//search bake
-	bake_index = t * bake_fps;
-	if (storeBake.count(bake_index)) {
-		particles = storeBake[bake_index];
-		return true;
-	}
-	//Or do a local search
-	//Bear within 1 frames
-	for (i = 1; i < 2; i++) {
-		if (storeBake.count(bake_index + i)) {
-			particles = storeBake[bake_index + i];
-			return true;
+	//The baked frame at t, else one within a frame of it, or a blend of
+	//the frames around t; no copy is made
+	const ParticleState* baked = playback.at(t * bake_fps, interpolation);
+	if (baked == NULL) {
+		return false;
+	}
+	shown = baked;
+	return true;
+}
+
+int ParticleSystem::bakeIndex(float t) const
+{
+	// round rather than truncate: t = frame / fps is often a hair below
+	// the frame it was computed from
+	return (int)floor(t * bake_fps + 0.5f);
+}
+
+/** Bake file format (text):
+  *   <bake fps> <frame count>
+  *   then per frame:  <frame index> <particle count>
+  *   then per particle: <position> <id>
+  * Files with the full particle state per line (position, velocity,
+  * mass, age and possibly lifetime) from before baking kept only
+  * positions still load; their particles are numbered in order.
+  */
+bool ParticleSystem::saveBakeFile(const char* szFileName)
+{
+	FILE* pf = fopen(szFileName, "w");
+	if (pf == NULL) {
+		return false;
+	}
+
+	std::vector<int> indices = bake.frameIndices();
+	ParticleState s;
+	fprintf(pf, "%g %d\n", bake_fps, (int)indices.size());
+	for (int f = 0; f < indices.size(); f++) {
+		bake.decode(indices[f], s);
+		fprintf(pf, "%d %d\n", indices[f], s.size());
+		for (int i = 0; i < s.size(); i++) {
+			fprintf(pf, "%.9g %.9g %.9g %u\n", s.px[i], s.py[i], s.pz[i], s.id[i]);
 		}
-		if (storeBake.count(bake_index - i)) {
-			particles = storeBake[bake_index - i];
-			return true;
+	}
+
+	bool ok = !ferror(pf);
+	fclose(pf);
+	return ok;
+}
+
+bool ParticleSystem::loadBakeFile(const char* szFileName)
+{
+	FILE* pf = fopen(szFileName, "r");
+	if (pf == NULL) {
+		return false;
+	}
+
+	// read line by line, as the number of columns varies
+	char line[512];
+	float fps;
+	int frames;
+	if (fgets(line, sizeof(line), pf) == NULL ||
+		sscanf(line, "%f %d", &fps, &frames) != 2 || fps <= 0) {
+		fclose(pf);
+		return false;
+	}
+
+	BakeStore loaded(bake.keyInterval());
+	ParticleState s;
+	bool ok = true;
+	for (int f = 0; f < frames && ok; f++) {
+		int bake_index, count;
+		ok = fgets(line, sizeof(line), pf) != NULL &&
+			sscanf(line, "%d %d", &bake_index, &count) == 2 && count >= 0;
+		s.resize(ok ? count : 0);
+		for (int i = 0; i < s.size() && ok; i++) {
+			float v[2];
+			int columns = fgets(line, sizeof(line), pf) == NULL ? 0 :
+				sscanf(line, "%f %f %f %f %f", &s.px[i], &s.py[i], &s.pz[i], &v[0], &v[1]);
+			ok = columns >= 4;
+			if (columns == 4) {
+				// the fourth column is the id; rescan it as an integer
+				sscanf(line, "%*f %*f %*f %u", &s.id[i]);
+			}
+			else {
+				s.id[i] = i;
+			}
 		}
+		if (ok) {
+			loaded.add(bake_index, s);
+		}
+	}
+	fclose(pf);
+	if (!ok) {
+		return false;
 	}
-	return false;
+
+	bake.swap(loaded);
+	bake_fps = fps;
+	// the file doesn't say what it was made with; taken to be this
+	bake_key = settingsHash(cache_salt);
+	// the checkpoints were of the frames just replaced
+	eraseCheckpoints(checkpoints.begin(), checkpoints.end());
+	if (bake.frameCount() > 0) {
+		// lets the UI grey out the baked range
+		bake_start_time = bake.firstFrame() / bake_fps;
+		bake_end_time = bake.lastFrame() / bake_fps;
+		dirty = true;
+	}
+	return true;
 }
 
-/** Clears out your data structure of baked particles */
-void ParticleSystem::clearBaked()
+bool ParticleSystem::isBaked(int first, int last) const
 {
-	storeBake.clear();
+	for (int f = first; f <= last; f++) {
+		if (!bake.has(f)) {
+			return false;
+		}
+	}
+	return true;
 }
 
-/* Instead of using Euler's method, we use Runge-Kutta technique for more accurate results*/
-void ParticleSystem::rungeKuttaMethod(Particle& p, std::vector<Force>& force, float dt) {
-	std::vector<Force>::iterator forceIterator;
+int ParticleSystem::addEmitter(const Emitter& e)
+{
+	emitters.push_back(e);
+	return emitters.size() - 1;
+}
 
-	Vec3f x1 = p.position;
-	Vec3f v1 = p.velocity;
-	Vec3f a1(0.0, 0.0, 0.0);
-	for (forceIterator = force.begin(); forceIterator != force.end(); forceIterator++) {
-		a1 += forceIterator->getAcceleration(p);
-		a1 += forceIterator->getFeaturedForce();
+int ParticleSystem::findEmitter(const char* szName) const
+{
+	for (int e = 0; e < emitters.size(); e++) {
+		if (emitters[e].name == szName) {
+			return e;
+		}
 	}
+	return -1;
+}
 
-	Vec3f x2 = x1 + 0.5 * v1 * dt;
-	Vec3f v2 = v1 + 0.5 * a1 * dt;
-	Vec3f a2(0.0, 0.0, 0.0);
-	p.position = x2; p.velocity = v2;
-	for (forceIterator = force.begin(); forceIterator != force.end(); forceIterator++) {
-		a2 += forceIterator->getAcceleration(p);
-		a2 += forceIterator->getFeaturedForce();
+SphFluid* ParticleSystem::setFluid(bool on)
+{
+	if (!on) {
+		forces.remove("sph");
+		return NULL;
 	}
+	SphFluid* sph = getFluid();
+	return sph ? sph : (SphFluid*)forces.add(new SphFluid(), "sph");
+}
 
-	Vec3f x3 = x2 + 0.5 * v2 * dt;
-	Vec3f v3 = v2 + 0.5 * a2 * dt;
-	Vec3f a3(0.0, 0.0, 0.0);
-	p.position = x3; p.velocity = v3;
-	for (forceIterator = force.begin(); forceIterator != force.end(); forceIterator++) {
-		a3 += forceIterator->getAcceleration(p);
-		a3 += forceIterator->getFeaturedForce();
+NBodyGravity* ParticleSystem::setGravitation(bool on)
+{
+	if (!on) {
+		forces.remove("nbody");
+		return NULL;
 	}
+	NBodyGravity* nbody = getGravitation();
+	return nbody ? nbody : (NBodyGravity*)forces.add(new NBodyGravity(), "nbody");
+}
 
-	Vec3f x4 = x3 + v3 * dt;
-	Vec3f v4 = v3 + a3 * dt;
-	Vec3f a4(0.0, 0.0, 0.0);
-	p.position = x4; p.velocity = v4;
-	for (forceIterator = force.begin(); forceIterator != force.end(); forceIterator++) {
-		a4 += forceIterator->getAcceleration(p);
-		a4 += forceIterator->getFeaturedForce();
+VectorField* ParticleSystem::setVectorField(const char* szFileName)
+{
+	forces.remove("field");
+	if (szFileName == NULL)
+		return NULL;
+	VectorField* field = new VectorField();
+	if (!field->open(szFileName)) {
+		delete field;
+		return NULL;
 	}
+	return (VectorField*)forces.add(field, "field");
+}
 
-	Vec3f xf = x1 + (dt / 6)*(v1 + 2 * v2 + 2 * v3 + v4);
-	Vec3f vf = v1 + (dt / 6)*(a1 + 2 * a2 + 2 * a3 + a4);
-
-	p.position = x4; p.velocity = v4;
+unsigned long long ParticleSystem::settingsHash(unsigned long long salt) const
+{
+	unsigned long long h = hashValue(salt);
+	h = hashValue(bake_fps, h);
+	for (int e = 0; e < emitters.size(); e++) {
+		h = emitters[e].hash(h);
+	}
+	h = hashValue(seed, h);
+	h = hashValue(capacity, h);
+	h = hashValue(step_rate, h);
+	h = hashValue((int)integrator.scheme(), h);
+	if (integrator.scheme() == Integrator::DOPRI5) {
+		h = hashValue(integrator.tolerance(), h);
+	}
+	h = collisions.hash(h);
+	h = modelCollider.hash(h);
+	return forces.hash(h);
 }
 
+bool ParticleSystem::openBakeCache(const char* szFileName, unsigned long long salt)
+{
+	cache_file = szFileName;
+	cache_salt = salt;
+	float fps;
+	unsigned long long key = settingsHash(salt);
+	if (!bake.open(szFileName, key, fps)) {
+		return false;
+	}
+	bake_fps = fps;
+	bake_key = key;
+	// the checkpoints were of the frames just replaced
+	eraseCheckpoints(checkpoints.begin(), checkpoints.end());
+	if (bake.frameCount() > 0) {
+		// lets the UI grey out the baked range
+		bake_start_time = bake.firstFrame() / bake_fps;
+		bake_end_time = bake.lastFrame() / bake_fps;
+		dirty = true;
+	}
+	return true;
+}
 
+bool ParticleSystem::saveBakeCache()
+{
+	return bake.save(cache_file.c_str(), settingsHash(cache_salt), bake_fps);
+}
 
+/** Clears out your data structure of baked particles */
+void ParticleSystem::clearBaked()
+{
+	bake.clear();
+	eraseCheckpoints(checkpoints.begin(), checkpoints.end());
+}
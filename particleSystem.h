@@ -19,10 +19,26 @@
 #include <FL/gl.h>
 #include "vec.h"
 #include "particle.h"
+#include "particlestate.h"
 #include "force.h"
+#include "forcefield.h"
+#include "integrator.h"
+#include "threadpool.h"
+#include "spatialgrid.h"
+#include "collisions.h"
+#include "sph.h"
+#include "nbody.h"
+#include "vectorfield.h"
+#include "modelcollider.h"
+#include "emitter.h"
+#include "bakestore.h"
+#include "bakeplayback.h"
+#include "depthsort.h"
+#include "billboards.h"
 #include "camera.h"
 #include <vector>
 #include <map>
+#include <string>
 
 class ParticleSystem {
 
@@ -46,6 +62,15 @@ public:
 
 	// This function should compute forces acting on all particles
 	// and update their state (pos and vel) appropriately.
+	// The particles advance in fixed steps (see setStepRate()) up to
+	// the bake frame of t, baking each frame they pass. The emitters
+	// should have just been placed for t; the frames passed emit from
+	// where they were placed for the last one, interpolated.
+	//
+	// Simulating, baking and drawing all run on the calling thread (the
+	// thread pool only splits up a step), and nothing here is locked:
+	// the emitters, bake and checkpoints must only be touched from the
+	// thread that draws.
 	virtual void computeForcesAndUpdateParticles(float t);
 
 	// This function should reset the system to its initial state.
@@ -55,6 +80,10 @@ public:
 	virtual void resetSimulation(float t);
 
 	// This function should start the simulation
+	// It resumes from the last checkpoint at or before t, if any;
+	// otherwise it starts afresh, dropping whatever was baked from t on.
+	// A bake made under other settings (settingsHash() of the cache
+	// salt) is dropped first, checkpoints and all.
 	virtual void startSimulation(float t);
 
 	// This function should stop the simulation
@@ -62,12 +91,59 @@ public:
 
 	// This function should clear out your data structure
 	// of baked particles (without leaking memory).
+	// The checkpoints go with them.
 	virtual void clearBaked();	
 
+	// While simulating, the whole state is checkpointed every
+	// checkpoint interval frames (<= 0: never), counting from the first.
+	// Starting the simulation again at any time then goes back to the
+	// last checkpoint at or before it and simulates on from there,
+	// replacing whatever was baked after the checkpoint: to extend a
+	// bake, or redo its tail after changing settings, only the frames
+	// since the checkpoint are simulated.
+	void setCheckpointInterval(int frames) { checkpoint_interval = frames; }
+	int getCheckpointInterval() const { return checkpoint_interval; }
+	int checkpointCount() const { return checkpoints.size(); }
+
 	// This function load bake from data structure
 	// return true if found, false otherwise
 	virtual bool loadBaked(float t);
 
+	// Save / restore all baked frames, so that a bake can be computed
+	// by a batch run and played back later. Return false on I/O error.
+	bool saveBakeFile(const char* szFileName);
+	bool loadBakeFile(const char* szFileName);
+	int bakedFrameCount() const { return bake.frameCount(); }
+
+	// Baked frames are kept compressed (see BakeStore); baking stops
+	// once they and the checkpoints take up this many bytes. Past it,
+	// a new checkpoint replaces the oldest ones.
+	void setBakeBudget(size_t bytes) { bake_budget = bytes; }
+	size_t bakedBytes() const { return bake.bytes() + checkpoint_bytes; }
+	// How baked particles are shown between baked frames, e.g. when
+	// playing back faster than the bake rate
+	void setBakeInterpolation(BakePlayback::Interpolation mode) { interpolation = mode; }
+	BakePlayback::Interpolation getBakeInterpolation() const { return interpolation; }
+	// true if every frame in first .. last is baked
+	bool isBaked(int first, int last) const;
+
+	// Keep the bake in a cache file, which is rewritten whenever a
+	// simulation stops. The cache is tagged with settingsHash(salt); if
+	// the file holds a bake made with the same settings it is opened for
+	// playback (mapped, not read in) and true is returned. salt stands
+	// for whatever else shapes the particles, such as the animation
+	// moving the emitter.
+	bool openBakeCache(const char* szFileName, unsigned long long salt = 0);
+	bool saveBakeCache();
+	// salt for the next saveBakeCache(), when what it stands for changes
+	void setBakeCacheSalt(unsigned long long salt) { cache_salt = salt; }
+	// hash of the forces, integrator, emission settings and bake rate
+	unsigned long long settingsHash(unsigned long long salt = 0) const;
+
+	// Blending used to draw the particles. Unless it is order independent
+	// (see DepthSort) the particles are drawn back to front.
+	void setBlendFunc(GLenum src, GLenum dst) { blend_src = src; blend_dst = dst; }
+
 	// These accessor fxns are implemented for you
 	float getBakeStartTime() { return bake_start_time; }
 	float getBakeEndTime() { return bake_end_time; }
@@ -77,31 +153,169 @@ public:
 	void setDirty(bool d) { dirty = d; }
 
 	void setFps(int fps) { bake_fps = fps; }
+	// Simulation steps per second. The simulation only advances in
+	// whole steps counted from its start, and frames falling between two
+	// steps are interpolated, so the particles do not depend on when or
+	// how often they are updated: the state after a number of steps is
+	// the same however it was reached.
+	void setStepRate(int hz) { step_rate = hz > 0 ? hz : 1; }
+	int getStepRate() const { return step_rate; }
 	void setMatrix(GLfloat m[]) {
 		for (int i = 0; i<16; i++) { matrix[i] = m[i]; }
 	}
-	void setParticleStart(Vec3f pos, Vec3f vel) {
-		if (simulate) {
-			init_position = pos;
-			init_velocity = vel;
+	// moves the default emitter
+	void setParticleStart(Vec3f pos, Vec3f vel) { setEmitterStart(0, pos, vel); }
+
+	// Emitters, each a named source of particles with its own rate,
+	// speed, spread, lifetime and forces (see Emitter). They all share
+	// the pool and are stepped together. The system starts with one,
+	// "default", at index 0; the model attaches others to any node of its
+	// hierarchy by calling setEmitterStart() while drawing it. Emitters
+	// are never removed, as particles refer to them by index; deactivate
+	// one instead.
+	int addEmitter(const Emitter& e);
+	int findEmitter(const char* szName) const;	// -1 if there is none
+	int emitterCount() const { return emitters.size(); }
+	Emitter& emitter(int i) { return emitters[i]; }
+	// position and emitting direction of emitter i this frame
+	void setEmitterStart(int i, Vec3f pos, Vec3f dir) {
+		if (simulate && i >= 0 && i < emitters.size()) {
+			emitters[i].position = pos;
+			emitters[i].direction = dir;
 		}
 	}
+	// A Force acts as f / mass plus its fixed "featured" acceleration
 	void addFieldForce(Force f) {
-		fieldForce.push_back(f);
+		forces.add(new ConstantForce(f.f));
+		forces.add(new Gravity(f.getFeaturedForce()));
 	}
+	// all forces acting on the particles; add kernels here
+	ForceField& forceField() { return forces; }
+
+	// integration scheme used by computeForcesAndUpdateParticles()
+	Integrator& getIntegrator() { return integrator; }
+
+	// Collisions between particles, resolved after every step; off until
+	// given a radius
+	ParticleCollisions& getCollisions() { return collisions; }
+	// Particles by cell, as of the last collision pass, for anything
+	// else that needs neighbours
+	const SpatialGrid& neighbors() const { return grid; }
+
+	// Primitives of the model the particles bounce off; the model fills
+	// it while drawing (see recordColliders() in modelerdraw.h)
+	ModelCollider& getModelCollider() { return modelCollider; }
 
-	void rungeKuttaMethod(Particle& p, std::vector<Force>& f, float dt);
+	// Fluid mode: the particles interact as an SPH fluid (see SphFluid),
+	// under the other forces as before. Returns the fluid, to tune, or
+	// NULL when turned off. Steps are split as the fluid requires, up
+	// to max_substeps per step.
+	SphFluid* setFluid(bool on);
+	SphFluid* getFluid() const { return (SphFluid*)forces.find("sph"); }
+
+	// Mutual gravitation: every particle attracts every other one (see
+	// NBodyGravity). Returns the force, to tune, or NULL when turned off.
+	NBodyGravity* setGravitation(bool on);
+	NBodyGravity* getGravitation() const { return (NBodyGravity*)forces.find("nbody"); }
+
+	// A volume of vectors pushing the particles (see VectorField), read
+	// from szFileName; NULL turns it off. Returns the field, to place and
+	// tune, or NULL when off or the file can't be opened.
+	VectorField* setVectorField(const char* szFileName);
+	VectorField* getVectorField() const { return (VectorField*)forces.find("field"); }
+
+	// The particles live in a pool of fixed capacity, allocated up front;
+	// emission stops while it is full. A particle dies when it reaches
+	// its lifetime (<= 0: no limit) or goes too far, and its slot is
+	// handed to the next particle emitted.
+	void setCapacity(int n);
+	int getCapacity() const { return capacity; }
+	// lifetime of the default emitter's particles
+	void setLifetime(float seconds) { emitters[0].lifetime = seconds; }
+	float getLifetime() const { return emitters[0].lifetime; }
+	int particleCount() const { return particles.size(); }
+
+	// Emission jitter comes from a counter based generator (see
+	// random.h) keyed by this seed, so equal seeds give equal bakes
+	void setSeed(unsigned int s) { seed = s; }
+	unsigned int getSeed() const { return seed; }
+
+	// Threads used to update the particles (<= 0: one per hardware
+	// thread). Results do not depend on this.
+	void setThreadCount(int n) { pool.threads(n); }
+	int getThreadCount() const { return pool.threads(); }
 
 protected:
+	// frame of the bake that time t falls on
+	int bakeIndex(float t) const;
+	// the parts of a frame: emission, from that fraction of the way from
+	// where each emitter last emitted to where it is, one fixed step, and
+	// baking a frame that is behind the particles by that fraction of a
+	// step
+	void emitParticles(int frame, float w);
+	void stepParticles(float dt);
+	void bakeFrame(int frame, float behind);
+	// the state after emitting and baking frame
+	void saveCheckpoint(int frame);
+	// back to the last checkpoint at or before frame; false if none
+	bool resume(int frame);
+
+	struct Checkpoint {
+		float start_time;
+		int steps;
+		unsigned int next_id;
+		ParticleState particles;
+		std::vector<float> start[3];
+		std::vector<Emitter> emitters;	// where they last emitted from
+		std::vector<float> substeps;	// the integrator's, if adaptive
+
+		// memory taken, for the bake budget
+		size_t bytes() const;
+	};
+	// erase checkpoints first .. last, keeping checkpoint_bytes
+	void eraseCheckpoints(std::map<int, Checkpoint>::iterator first,
+		std::map<int, Checkpoint>::iterator last);
+
 	GLfloat matrix[16];
-	int number;
-	float last_time;
-	std::vector<Particle> particles;
-	std::map<int, std::vector<Particle>> storeBake;
-	std::vector<Force> fieldForce;
-	int max_bake;
-	Vec3f init_position;
-	Vec3f init_velocity;
+	int capacity;
+	std::vector<Emitter> emitters;
+	unsigned int next_id;
+	unsigned int seed;
+	int step_rate;						// simulation steps per second
+	int steps;							// taken since the start
+	int next_frame;						// to emit and bake
+	int checkpoint_interval;			// frames
+	std::map<int, Checkpoint> checkpoints;	// by frame
+	size_t checkpoint_bytes;			// taken by them all
+	unsigned long long bake_key;		// settingsHash() the bake and
+										// checkpoints were made under
+	ParticleState particles;			// simulation state
+	BakeStore bake;
+	BakePlayback playback;
+	BakePlayback::Interpolation interpolation;
+	const ParticleState* shown;			// particles, or baked ones from playback
+	// scratch, kept to avoid per-step allocations
+	std::vector<unsigned char> alive;
+	std::vector<int> survivors;			// running count per update chunk
+	ParticleState compacted;
+	ParticleState between;				// a frame between two steps
+	std::vector<float> start[3];		// positions at the start of the last step
+	std::vector<int> drawOrder;			// back to front, from depthSort
+	DepthSort depthSort;
+	Billboards billboards;
+	GLenum blend_src;
+	GLenum blend_dst;
+	ForceField forces;
+	Integrator integrator;
+	ParticleCollisions collisions;
+	SpatialGrid grid;
+	ModelCollider modelCollider;
+	std::vector<float> previous[3];		// positions before a step
+	ThreadPool pool;
+	int max_substeps;
+	size_t bake_budget;
+	std::string cache_file;
+	unsigned long long cache_salt;
 
 	/** Some baking-related state **/
 	float bake_fps;						// frame rate at which simulation was baked
@@ -0,0 +1,110 @@
+#pragma warning(disable : 4786)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "particleoptions.h"
+#include "particleSystem.h"
+
+ParticleOptions::ParticleOptions() :
+m_fFieldStrength(1.0f)
+{
+	m_fvFieldTransform[0] = 0.0f;
+	m_fvFieldTransform[1] = 0.0f;
+	m_fvFieldTransform[2] = 0.0f;
+	m_fvFieldTransform[3] = 1.0f;
+}
+
+int ParticleOptions::parse(int argc, char** argv, int i, ParticleSystem* pps)
+{
+	const char* szOption = argv[i];
+
+	if (strcmp(szOption, "--fluid") == 0) {
+		if (pps)
+			pps->setFluid(true);
+		return 1;
+	}
+	if (strcmp(szOption, "--nbody") == 0) {
+		if (pps)
+			pps->setGravitation(true);
+		return 1;
+	}
+
+	// the rest take values
+	int iValues;
+	if (strcmp(szOption, "--field-transform") == 0)
+		iValues = 4;
+	else if (strcmp(szOption, "--integrator") == 0 || strcmp(szOption, "--tolerance") == 0 ||
+		strcmp(szOption, "--threads") == 0 || strcmp(szOption, "--collide") == 0 ||
+		strcmp(szOption, "--seed") == 0 || strcmp(szOption, "--field") == 0 ||
+		strcmp(szOption, "--field-strength") == 0)
+		iValues = 1;
+	else
+		return 0;
+
+	if (i + iValues >= argc) {
+		fprintf(stderr, "ERROR: %s needs %d value%s\n", szOption, iValues,
+			iValues > 1 ? "s" : "");
+		return -1;
+	}
+	const char* szValue = argv[i + 1];
+
+	if (strcmp(szOption, "--integrator") == 0) {
+		Integrator::Scheme scheme = Integrator::schemeByName(szValue);
+		if (scheme == Integrator::NUM_SCHEMES) {
+			fprintf(stderr, "ERROR: unknown integrator %s\n", szValue);
+			return -1;
+		}
+		if (pps)
+			pps->getIntegrator().scheme(scheme);
+	}
+	else if (strcmp(szOption, "--tolerance") == 0) {
+		if (pps)
+			pps->getIntegrator().tolerance((float)atof(szValue));
+	}
+	else if (strcmp(szOption, "--threads") == 0) {
+		if (pps)
+			pps->setThreadCount(atoi(szValue));
+	}
+	else if (strcmp(szOption, "--collide") == 0) {
+		if (pps)
+			pps->getCollisions().radius((float)atof(szValue));
+	}
+	else if (strcmp(szOption, "--seed") == 0) {
+		if (pps)
+			pps->setSeed((unsigned int)strtoul(szValue, NULL, 10));
+	}
+	else if (strcmp(szOption, "--field") == 0) {
+		if (pps && pps->setVectorField(szValue) == NULL) {
+			fprintf(stderr, "ERROR: can't open vector field %s\n", szValue);
+			return -1;
+		}
+	}
+	else if (strcmp(szOption, "--field-strength") == 0)
+		m_fFieldStrength = (float)atof(szValue);
+	else {
+		for (int c = 0; c < 4; c++)
+			m_fvFieldTransform[c] = (float)atof(argv[i + 1 + c]);
+	}
+	return 1 + iValues;
+}
+
+void ParticleOptions::apply(ParticleSystem* pps) const
+{
+	// the field's box is scaled about its origin, then moved
+	VectorField* pvf = pps ? pps->getVectorField() : NULL;
+	if (pvf) {
+		float s = m_fvFieldTransform[3];
+		pvf->setTransform(Mat4f::createTranslation(m_fvFieldTransform[0], m_fvFieldTransform[1],
+			m_fvFieldTransform[2]) * Mat4f::createScale(s, s, s));
+		pvf->strength = m_fFieldStrength;
+	}
+}
+
+const char* ParticleOptions::usage()
+{
+	return "[--integrator euler|midpoint|rk4|verlet|dopri5] [--tolerance <t>] [--threads <n>] "
+		"[--collide <radius>] [--fluid] [--nbody] [--seed <n>] [--field <volume> "
+		"[--field-strength <s>] [--field-transform <x> <y> <z> <scale>]]";
+}
@@ -0,0 +1,40 @@
+#ifndef PARTICLEOPTIONS_H_INCLUDED
+#define PARTICLEOPTIONS_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+class ParticleSystem;
+
+// The command line options that set up the particle system. The UI and
+// --batch both read them here, so a simulation run either way is made
+// under the same settings and hits the same bake cache entries:
+//   [--integrator euler|midpoint|rk4|verlet|dopri5] [--tolerance <t>]
+//   [--threads <n>] [--collide <radius>] [--fluid] [--nbody] [--seed <n>]
+//   [--field <volume> [--field-strength <s>]
+//                     [--field-transform <x> <y> <z> <scale>]]
+// See batchdriver.h for what each does.
+class ParticleOptions
+{
+public:
+	ParticleOptions();
+
+	// If argv[i] is one of the options, apply it to pps (which may be
+	// NULL) and return how many arguments it took, itself included.
+	// Returns 0 for any other argument, and -1, having said why, for an
+	// option whose value is missing or can't be used.
+	int parse(int argc, char** argv, int i, ParticleSystem* pps);
+	// Place and scale the vector field opened by --field; done once all
+	// options are read, as --field-transform may come before --field
+	void apply(ParticleSystem* pps) const;
+
+	// the options as a usage message shows them
+	static const char* usage();
+
+private:
+	// where the vector field's box goes (x, y, z, scale) and how hard it
+	// pushes
+	float m_fvFieldTransform[4];
+	float m_fFieldStrength;
+};
+
+#endif // PARTICLEOPTIONS_H_INCLUDED
@@ -0,0 +1,152 @@
+#pragma warning(disable : 4786)
+
+#include <string.h>
+#include <algorithm>
+
+#include "particlestate.h"
+
+ParticleState::ParticleState()
+	: count(0), allocated(0)
+{
+	bind();
+}
+
+ParticleState::ParticleState(const ParticleState& other)
+	: count(0), allocated(0)
+{
+	bind();
+	copyFrom(other);
+}
+
+ParticleState& ParticleState::operator=(const ParticleState& other)
+{
+	if (this != &other)
+		copyFrom(other);
+	return *this;
+}
+
+void ParticleState::bind()
+{
+	float** arrays[NUM_ARRAYS] = { &px, &py, &pz, &vx, &vy, &vz, &mass, &age, &lifetime };
+	for (int a = 0; a < NUM_ARRAYS; a++)
+		*arrays[a] = data[a].empty() ? NULL : &data[a][0];
+	id = ids.empty() ? NULL : &ids[0];
+	emitter = emitters.empty() ? NULL : &emitters[0];
+}
+
+void ParticleState::grow(int n)
+{
+	if (n <= allocated)
+		return;
+	for (int a = 0; a < NUM_ARRAYS; a++)
+		data[a].resize(n);
+	ids.resize(n);
+	emitters.resize(n);
+	allocated = n;
+	bind();
+}
+
+void ParticleState::reserve(int n)
+{
+	grow(n);
+}
+
+void ParticleState::resize(int n)
+{
+	grow(n);
+	count = n;
+}
+
+int ParticleState::add(const Particle& p)
+{
+	// geometric growth, so add() is amortized constant time
+	if (count == allocated)
+		grow(allocated < 16 ? 16 : 2 * allocated);
+	set(count, p);
+	return count++;
+}
+
+Particle ParticleState::get(int i) const
+{
+	Particle p;
+	p.position = position(i);
+	p.velocity = velocity(i);
+	p.mass = mass[i];
+	p.age = age[i];
+	p.lifetime = lifetime[i];
+	p.id = id[i];
+	p.emitter = emitter[i];
+	return p;
+}
+
+void ParticleState::set(int i, const Particle& p)
+{
+	setPosition(i, p.position);
+	setVelocity(i, p.velocity);
+	mass[i] = p.mass;
+	age[i] = p.age;
+	lifetime[i] = p.lifetime;
+	id[i] = p.id;
+	emitter[i] = (unsigned short)p.emitter;
+}
+
+void ParticleState::compact(const std::vector<unsigned char>& alive)
+{
+	float* arrays[NUM_ARRAYS] = { px, py, pz, vx, vy, vz, mass, age, lifetime };
+	int n = 0;
+	for (int i = 0; i < count; i++) {
+		if (!alive[i])
+			continue;
+		if (n != i) {
+			for (int a = 0; a < NUM_ARRAYS; a++)
+				arrays[a][n] = arrays[a][i];
+			id[n] = id[i];
+			emitter[n] = emitter[i];
+		}
+		n++;
+	}
+	count = n;
+}
+
+int ParticleState::gather(const ParticleState& src, const std::vector<unsigned char>& alive,
+	int begin, int end, int to)
+{
+	const float* from[NUM_ARRAYS] = {
+		src.px, src.py, src.pz, src.vx, src.vy, src.vz, src.mass, src.age, src.lifetime
+	};
+	float* arrays[NUM_ARRAYS] = { px, py, pz, vx, vy, vz, mass, age, lifetime };
+	for (int i = begin; i < end; i++) {
+		if (!alive[i])
+			continue;
+		for (int a = 0; a < NUM_ARRAYS; a++)
+			arrays[a][to] = from[a][i];
+		id[to] = src.id[i];
+		emitter[to] = src.emitter[i];
+		to++;
+	}
+	return to;
+}
+
+void ParticleState::copyFrom(const ParticleState& other)
+{
+	resize(other.count);
+	if (count == 0)
+		return;
+	size_t bytes = count * sizeof(float);
+	for (int a = 0; a < NUM_ARRAYS; a++)
+		memcpy(&data[a][0], &other.data[a][0], bytes);
+	memcpy(id, other.id, count * sizeof(unsigned int));
+	memcpy(emitter, other.emitter, count * sizeof(unsigned short));
+}
+
+void ParticleState::swap(ParticleState& other)
+{
+	for (int a = 0; a < NUM_ARRAYS; a++)
+		data[a].swap(other.data[a]);
+	ids.swap(other.ids);
+	emitters.swap(other.emitters);
+	std::swap(count, other.count);
+	std::swap(allocated, other.allocated);
+	bind();
+	other.bind();
+}
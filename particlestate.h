@@ -0,0 +1,84 @@
+#ifndef PARTICLESTATE_H
+#define PARTICLESTATE_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include "vec.h"
+#include "particle.h"
+
+// ParticleState stores a set of particles as a structure of arrays: one
+// contiguous float array per component of position and velocity, plus
+// mass, age and lifetime, and an id and emitter per particle. Nothing
+// is allocated per particle, so copying a whole frame (for a bake, or
+// restoring one) is one memcpy per array, and loops over a single
+// component stream through memory.
+//
+// Arrays only grow; clear() keeps their capacity so a system that has
+// reached its working size stops allocating. reserve() up front to never
+// allocate while stepping.
+class ParticleState {
+public:
+	ParticleState();
+	ParticleState(const ParticleState& other);
+	ParticleState& operator=(const ParticleState& other);
+
+	int size() const { return count; }
+	bool empty() const { return count == 0; }
+	void clear() { count = 0; }
+	void resize(int n);
+	void reserve(int n);
+
+	// appends a particle and returns its index
+	int add(const Particle& p);
+	// gather / scatter one particle
+	Particle get(int i) const;
+	void set(int i, const Particle& p);
+
+	Vec3f position(int i) const { return Vec3f(px[i], py[i], pz[i]); }
+	Vec3f velocity(int i) const { return Vec3f(vx[i], vy[i], vz[i]); }
+	void setPosition(int i, const Vec3f& p) { px[i] = p[0]; py[i] = p[1]; pz[i] = p[2]; }
+	void setVelocity(int i, const Vec3f& v) { vx[i] = v[0]; vy[i] = v[1]; vz[i] = v[2]; }
+
+	// Keep only particles whose alive[i] is nonzero, preserving order
+	void compact(const std::vector<unsigned char>& alive);
+	// Copy the particles of src in [begin, end) whose alive[i] is nonzero
+	// to this state from index to on, preserving order; returns the index
+	// after the last one copied. Does not resize, so disjoint ranges can
+	// be gathered from several threads.
+	int gather(const ParticleState& src, const std::vector<unsigned char>& alive,
+		int begin, int end, int to);
+
+	void copyFrom(const ParticleState& other);
+	// exchanges contents without copying
+	void swap(ParticleState& other);
+
+	// component arrays, size() elements each
+	float* px; float* py; float* pz;
+	float* vx; float* vy; float* vz;
+	float* mass;
+	float* age;
+	float* lifetime;
+	// ids ascend through the arrays: particles are appended in emission
+	// order and every removal keeps order
+	unsigned int* id;
+	// index of the emitter that made each particle
+	unsigned short* emitter;
+
+	int capacity() const { return allocated; }
+
+private:
+	enum { NUM_ARRAYS = 9 };
+
+	void grow(int n);
+	void bind();
+
+	int count;
+	int allocated;
+	// backing store for the component pointers above
+	std::vector<float> data[NUM_ARRAYS];
+	std::vector<unsigned int> ids;
+	std::vector<unsigned short> emitters;
+};
+
+#endif
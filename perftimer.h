@@ -0,0 +1,30 @@
+#ifndef PERFTIMER_H_INCLUDED
+#define PERFTIMER_H_INCLUDED
+
+// High resolution wall clock for latency and throughput measurements.
+// (std::chrono::high_resolution_clock only ticks every ~1 ms on VC12.)
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Seconds since an arbitrary, fixed origin
+inline double perfSeconds()
+{
+#ifdef WIN32
+	static LARGE_INTEGER liFrequency = { 0 };
+	if (liFrequency.QuadPart == 0)
+		QueryPerformanceFrequency(&liFrequency);
+	LARGE_INTEGER liNow;
+	QueryPerformanceCounter(&liNow);
+	return (double)liNow.QuadPart / (double)liFrequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+#endif // PERFTIMER_H_INCLUDED
@@ -1,4 +1,4 @@
-#include "Point.h"
+#include "point.h"
 
 Point::Point(void)
 	:x(0.0),
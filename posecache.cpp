@@ -0,0 +1,100 @@
+#pragma warning(disable : 4786)
+
+#include <math.h>
+
+#include "posecache.h"
+
+PoseCache::PoseCache(unsigned int uiBudgetBytes, int iKeysPerSecond) :
+m_uiBudgetBytes(uiBudgetBytes),
+m_uiBytes(0),
+m_iKeysPerSecond(iKeysPerSecond > 0 ? iKeysPerSecond : 1000),
+m_iHits(0),
+m_iMisses(0),
+m_iEvictions(0)
+{
+}
+
+int PoseCache::key(float t) const
+{
+	return (int)floor(t * (float)m_iKeysPerSecond + 0.5f);
+}
+
+float PoseCache::keyTime(float t) const
+{
+	return (float)key(t) / (float)m_iKeysPerSecond;
+}
+
+const Pose* PoseCache::find(float t)
+{
+	std::map<int, entry_list::iterator>::iterator it = m_index.find(key(t));
+	if (it == m_index.end()) {
+		++m_iMisses;
+		return NULL;
+	}
+
+	// move to the front of the LRU list; splice keeps the iterator valid
+	m_lru.splice(m_lru.begin(), m_lru, it->second);
+	++m_iHits;
+	return &it->second->m_pose;
+}
+
+const Pose* PoseCache::insert(float t, const Pose& pose)
+{
+	int iKey = key(t);
+
+	std::map<int, entry_list::iterator>::iterator it = m_index.find(iKey);
+	if (it != m_index.end()) {
+		m_uiBytes -= entryBytes(it->second->m_pose);
+		m_lru.erase(it->second);
+		m_index.erase(it);
+	}
+
+	Entry entry;
+	entry.m_iKey = iKey;
+	entry.m_pose = pose;
+	m_lru.push_front(entry);
+	m_index[iKey] = m_lru.begin();
+	m_uiBytes += entryBytes(pose);
+
+	evict();
+
+	return &m_lru.front().m_pose;
+}
+
+void PoseCache::clear()
+{
+	m_lru.clear();
+	m_index.clear();
+	m_uiBytes = 0;
+}
+
+void PoseCache::budget(unsigned int uiBudgetBytes)
+{
+	m_uiBudgetBytes = uiBudgetBytes;
+	evict();
+}
+
+void PoseCache::resetStats()
+{
+	m_iHits = m_iMisses = m_iEvictions = 0;
+}
+
+unsigned int PoseCache::entryBytes(const Pose& pose) const
+{
+	// list node + map node + the control vector's heap block
+	return sizeof(Entry) + 4 * sizeof(void*) +
+		sizeof(std::pair<int, entry_list::iterator>) + 4 * sizeof(void*) +
+		pose.m_fvControls.size() * sizeof(float);
+}
+
+void PoseCache::evict()
+{
+	// never evict the entry that was just inserted
+	while (m_uiBytes > m_uiBudgetBytes && m_lru.size() > 1) {
+		Entry& entry = m_lru.back();
+		m_uiBytes -= entryBytes(entry.m_pose);
+		m_index.erase(entry.m_iKey);
+		m_lru.pop_back();
+		++m_iEvictions;
+	}
+}
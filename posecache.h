@@ -0,0 +1,80 @@
+#ifndef POSECACHE_H_INCLUDED
+#define POSECACHE_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include "camera.h"
+
+// A fully evaluated frame: every control curve plus the keyframed
+// camera parameters (AZIMUTH .. LOOKAT_Z, see camera.h).
+struct Pose
+{
+	std::vector<float> m_fvControls;
+	float m_fvCamera[NUM_KEY_CURVES];
+	bool m_bHasCamera;
+};
+
+// PoseCache is an LRU cache of evaluated poses keyed by quantized time,
+// so that scrubbing back and forth over the timeline doesn't re-evaluate
+// every curve at every slider position. Entries are evicted least
+// recently used first once the memory budget is exceeded. The owner is
+// responsible for calling clear() when the curves change (see
+// Curve::revision()).
+class PoseCache
+{
+public:
+	PoseCache(unsigned int uiBudgetBytes = 8 * 1024 * 1024, int iKeysPerSecond = 1000);
+
+	// Returns the cached pose for t, or NULL on a miss
+	const Pose* find(float t);
+	// Stores the pose for t and returns the cached copy
+	const Pose* insert(float t, const Pose& pose);
+	void clear();
+
+	// Time keys are t quantized to 1 / keysPerSecond. Poses should be
+	// evaluated at keyTime(t) so that a cached value only depends on
+	// its key and not on which t happened to fill it.
+	int key(float t) const;
+	float keyTime(float t) const;
+	int keysPerSecond() const { return m_iKeysPerSecond; }
+
+	void budget(unsigned int uiBudgetBytes);
+	unsigned int budget() const { return m_uiBudgetBytes; }
+	unsigned int bytes() const { return m_uiBytes; }
+	int size() const { return m_index.size(); }
+
+	// statistics
+	int hits() const { return m_iHits; }
+	int misses() const { return m_iMisses; }
+	int evictions() const { return m_iEvictions; }
+	void resetStats();
+
+protected:
+	struct Entry
+	{
+		int m_iKey;
+		Pose m_pose;
+	};
+	typedef std::list<Entry> entry_list;
+
+	unsigned int entryBytes(const Pose& pose) const;
+	void evict();
+
+	// most recently used at the front
+	entry_list m_lru;
+	std::map<int, entry_list::iterator> m_index;
+
+	unsigned int m_uiBudgetBytes;
+	unsigned int m_uiBytes;
+	int m_iKeysPerSecond;
+
+	int m_iHits;
+	int m_iMisses;
+	int m_iEvictions;
+};
+
+#endif // POSECACHE_H_INCLUDED
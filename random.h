@@ -0,0 +1,59 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as
+// 1, 2, 3", SC 2011), a counter based generator: the random bits are a
+// keyed bijection of a 128 bit counter, so any number in the sequence is
+// computed directly from its position, with no state to share or carry
+// between calls. Whatever is derived from (key, counter) comes out the
+// same on every run, thread and machine.
+inline void philox4x32(unsigned int c[4], unsigned int k0, unsigned int k1)
+{
+	for (int round = 0; round < 10; round++) {
+		unsigned long long p0 = (unsigned long long)0xD2511F53u * c[0];
+		unsigned long long p1 = (unsigned long long)0xCD9E8D57u * c[2];
+		unsigned int hi0 = (unsigned int)(p0 >> 32), lo0 = (unsigned int)p0;
+		unsigned int hi1 = (unsigned int)(p1 >> 32), lo1 = (unsigned int)p1;
+		c[0] = hi1 ^ c[1] ^ k0;
+		c[1] = lo1;
+		c[2] = hi0 ^ c[3] ^ k1;
+		c[3] = lo0;
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+}
+
+// The random numbers of one particle: the key is the seed and the
+// emitter, the counter the frame, the particle's index within the
+// frame, and a block number that next() steps through, four numbers a
+// block.
+class ParticleRandom {
+public:
+	ParticleRandom(unsigned int seed, unsigned int emitter, unsigned int f, unsigned int i)
+		: k0(seed), k1(emitter), frame(f), index(i), block(0), used(4) {}
+
+	unsigned int next()
+	{
+		if (used == 4) {
+			bits[0] = frame;
+			bits[1] = index;
+			bits[2] = block++;
+			bits[3] = 0;
+			philox4x32(bits, k0, k1);
+			used = 0;
+		}
+		return bits[used++];
+	}
+	// in [0, 1), from the top 24 bits
+	float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+	// in [0, n)
+	int below(int n) { return (int)(((unsigned long long)next() * (unsigned int)n) >> 32); }
+
+private:
+	unsigned int k0, k1;
+	unsigned int frame, index, block;
+	unsigned int bits[4];
+	int used;
+};
+
+#endif
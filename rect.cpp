@@ -1,4 +1,4 @@
-#include "Rect.h"
+#include "rect.h"
 
 #include <algorithm>
 
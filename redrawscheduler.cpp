@@ -0,0 +1,88 @@
+#pragma warning(disable : 4786)
+
+#include <FL/Fl.H>
+#include <FL/Fl_Widget.H>
+
+#include "redrawscheduler.h"
+
+RedrawScheduler* RedrawScheduler::m_instance = NULL;
+
+RedrawScheduler* RedrawScheduler::Instance()
+{
+	return (m_instance) ? (m_instance) : (m_instance = new RedrawScheduler());
+}
+
+RedrawScheduler::RedrawScheduler() :
+m_bTimerArmed(false),
+m_iRefreshRate(60),
+m_iFlushCount(0),
+m_iRedrawCount(0)
+{
+}
+
+void RedrawScheduler::refreshRate(int iHz)
+{
+	if (iHz > 0)
+		m_iRefreshRate = iHz;
+}
+
+void RedrawScheduler::invalidate(Fl_Widget* pwndWidget)
+{
+	if (pwndWidget == NULL)
+		return;
+
+	int i;
+	for (i = 0; i < m_pwndvWidgets.size(); ++i) {
+		if (m_pwndvWidgets[i] == pwndWidget)
+			break;
+	}
+	if (i == m_pwndvWidgets.size()) {
+		m_pwndvWidgets.push_back(pwndWidget);
+		m_bvDirty.push_back(false);
+	}
+	m_bvDirty[i] = true;
+
+	// arm a single one-shot timer; everything that gets invalidated
+	// before it fires is redrawn in the same pass
+	if (!m_bTimerArmed) {
+		m_bTimerArmed = true;
+		Fl::add_timeout(1.0 / (double)m_iRefreshRate, cb_flush, (void*)this);
+	}
+}
+
+void RedrawScheduler::forget(Fl_Widget* pwndWidget)
+{
+	for (int i = 0; i < m_pwndvWidgets.size(); ++i) {
+		if (m_pwndvWidgets[i] == pwndWidget) {
+			m_pwndvWidgets.erase(m_pwndvWidgets.begin() + i);
+			m_bvDirty.erase(m_bvDirty.begin() + i);
+			return;
+		}
+	}
+}
+
+void RedrawScheduler::flush()
+{
+	if (m_bTimerArmed) {
+		Fl::remove_timeout(cb_flush, (void*)this);
+		m_bTimerArmed = false;
+	}
+
+	++m_iFlushCount;
+	for (int i = 0; i < m_pwndvWidgets.size(); ++i) {
+		if (m_bvDirty[i]) {
+			m_bvDirty[i] = false;
+			m_pwndvWidgets[i]->redraw();
+			++m_iRedrawCount;
+		}
+	}
+}
+
+void RedrawScheduler::cb_flush(void* p)
+{
+	// the timer is one-shot: it is not re-armed here, so the event
+	// loop goes idle until the next invalidate()
+	RedrawScheduler* prs = (RedrawScheduler*)p;
+	prs->m_bTimerArmed = false;
+	prs->flush();
+}
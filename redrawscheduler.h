@@ -0,0 +1,52 @@
+#ifndef REDRAWSCHEDULER_H_INCLUDED
+#define REDRAWSCHEDULER_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+
+class Fl_Widget;
+
+// The RedrawScheduler collects redraw requests from the UI and the
+// modeler view and flushes them together from a single one-shot timer.
+// Any number of invalidations that arrive within one refresh interval
+// cause at most one redraw() per widget, and when nothing is invalid
+// no timer is armed at all, so an idle session costs no CPU.
+class RedrawScheduler
+{
+public:
+	// Fetch the global RedrawScheduler instance
+	static RedrawScheduler* Instance();
+
+	// Mark a widget dirty; it will be redrawn on the next flush
+	void invalidate(Fl_Widget* pwndWidget);
+	// Drop a widget (e.g. before it is deleted) without redrawing it
+	void forget(Fl_Widget* pwndWidget);
+	// Redraw everything that is dirty right now
+	void flush();
+
+	bool pending() const { return m_bTimerArmed; }
+	void refreshRate(int iHz);
+	int refreshRate() const { return m_iRefreshRate; }
+
+	// Number of flushes and of widget redraws issued so far
+	int flushCount() const { return m_iFlushCount; }
+	int redrawCount() const { return m_iRedrawCount; }
+
+private:
+	RedrawScheduler();
+	RedrawScheduler(const RedrawScheduler&) {}
+	RedrawScheduler& operator=(const RedrawScheduler&) { return *this; }
+
+	static RedrawScheduler* m_instance;
+	static void cb_flush(void* p);
+
+	std::vector<Fl_Widget*> m_pwndvWidgets;
+	std::vector<bool> m_bvDirty;
+	bool m_bTimerArmed;
+	int m_iRefreshRate;
+	int m_iFlushCount;
+	int m_iRedrawCount;
+};
+
+#endif // REDRAWSCHEDULER_H_INCLUDED
@@ -1,11 +1,17 @@
 #include <cmath>
 #include <string>
+#include <cstdio>
 #include <float.h>
 
-#include "FL/fl.h"
-#include "FL/fl_draw.h"
+#include "FL/Fl.H"
+#include "FL/fl_draw.H"
 #include "rulerwindow.h"
 
+// VS2013 only has _snprintf, whose output snprintDecimal() terminates
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
 RulerWindow::RulerWindow(int x, int y, int w, int h, const char* label) :
 Fl_Double_Window(x, y, w, h, label), 
 m_byType(RW_HORIZONTAL),
@@ -45,7 +51,7 @@ static void snprintDecimal(char* szBuffer, const int iBufferCount, const int iMa
 	std::string strNumber;
 
 	// Print the magnitude part
-	_snprintf(szBuffer, iBufferCount, "%d", iMag);
+	snprintf(szBuffer, iBufferCount, "%d", iMag);
 	szBuffer[iBufferCount - 1] = '\0';
 
 	strMag = szBuffer;
@@ -1,7 +1,7 @@
 #ifndef RULERWINDOWS_H_INCLUDED
 #define RULERWINDOWS_H_INCLUDED
 
-#include "FL/Fl_Double_Window.h"
+#include "FL/Fl_Double_Window.H"
 #define RW_HORIZONTAL 0
 #define RW_VERTICAL 1
 
@@ -8,8 +8,9 @@
 #include <math.h>
 
 #include "modelerglobals.h"
-#include "metaball.h"
+#include "Metaball.h"
 #include "particleSystem.h"
+#include "batchdriver.h"
 
 #define PI 3.14159265
 
@@ -18,12 +19,20 @@ class SampleModel : public ModelerView
 {
 public:
 	SampleModel(int x, int y, int w, int h, char *label) :
-		ModelerView(x, y, w, h, label)
+		ModelerView(x, y, w, h, label), metaBalls(NULL)
 	{ 
 	
 	}
+	virtual ~SampleModel() { delete metaBalls; }
 	virtual void draw();
 	static SampleModel *instance;
+
+	// Places the particle system's emitters for the control values
+	// pfControls without drawing anything: the model is posed (see
+	// beginPose()), so each emitter is placed by the same spawnParticles()
+	// call, under the same transforms, as when the model is drawn. The
+	// posed model is recorded as the particles' collider as well.
+	void poseEmitters(const float* pfControls);
 private:
 	int iterator = 0;
 	bool animate = false;
@@ -69,9 +78,15 @@ private:
 
 	void drawShell();
 
-	void spawnParticles(Mat4<float> cameraTransform);
+	void drawModel();
+
+	void spawnParticles(Mat4<float> cameraTransform, const char* szEmitter);
 	Mat4<float> getModelViewMatrix();
 	Mat4f cameraMatrix;
+
+	// The metaball skin doesn't depend on time or on any control, so its
+	// scalar field is evaluated once and reused for every frame.
+	MetaBalls *metaBalls;
 };
 
 SampleModel *SampleModel::instance = NULL;
@@ -100,7 +115,7 @@ Mat4<float> SampleModel::getModelViewMatrix() {
 	**
 	*******************************/
 	GLfloat m[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, m);
+	getModelView(m);
 	Mat4f matMV(m[0], m[1], m[2], m[3],
 		m[4], m[5], m[6], m[7],
 		m[8], m[9], m[10], m[11],
@@ -116,8 +131,9 @@ Mat4<float> SampleModel::getModelViewMatrix() {
 // call this function!
 //
 // SpawnParticles takes the camera transformation matrix as a 
-// parameter.  More on this later.
-void SampleModel::spawnParticles(Mat4<float> cameraTransform) {
+// parameter.  More on this later.  szEmitter names the particle
+// system's emitter that is attached here.
+void SampleModel::spawnParticles(Mat4<float> cameraTransform, const char* szEmitter) {
 	/****************************************************************
 	**
 	**	THIS FUNCTION WILL ADD A NEW PARTICLE TO OUR WORLD
@@ -184,7 +200,7 @@ void SampleModel::spawnParticles(Mat4<float> cameraTransform) {
 	**  can finally add it to our system!
 	**
 	***************************************************************/
-	ps->setParticleStart(Vec3f(Loc[0], Loc[1], Loc[2]), velocity);
+	ps->setEmitterStart(ps->findEmitter(szEmitter), Vec3f(Loc[0], Loc[1], Loc[2]), velocity);
 }
 
 // We are going to override (is that the right word?) the draw()
@@ -208,15 +224,57 @@ void SampleModel::draw()
 	*****************************************************/
 	cameraMatrix = getModelViewMatrix();
 
+	// the particles collide with what is drawn of the model, from here
+	// to the end of the model
+	ParticleSystem *ps = ModelerApplication::Instance()->GetParticleSystem();
+	if (ps != NULL)
+		recordColliders(&ps->getModelCollider());
+
+	drawModel();
+	recordColliders(NULL);
+
+	/***********************************************
+	**
+	**	NOW WE WILL ACTUALLY BEGIN DRAWING THE MODEL
+	**
+	**	Draw your model up to the node where you would like
+	**	particles to spawn from.
+	**
+	**  FYI:  As you call glRotate, glScale, or glTranslate,
+	**  OpenGL is multiplying new transformations into the
+	**  MODELVIEW matrix.
+	**
+	********************************************/
+	// If particle system exists, draw it
+	if (ps != NULL) {
+		ps->computeForcesAndUpdateParticles(t);
+		ps->drawParticles(t, m_camera);
+	}
+	
+	/*************************************************
+	**
+	**	NOW DO ANY CLOSING CODE
+	**
+	**	Don't forget that animator requires you to call
+	**  endDraw().
+	**	
+	**************************************************/
+	endDraw();
+}
+
+// The model's hierarchy, from the camera on; drawn by draw(), and posed
+// by poseEmitters()
+void SampleModel::drawModel()
+{
 	// draw the sample model
 	setAmbientColor(.1f, .1f, .1f);
 
-	//glPushMatrix();
+	//pushMatrix();
 
-	//glPopMatrix();
+	//popMatrix();
 
-	glPushMatrix(); // push identity
-	glTranslated(VAL(XPOS), VAL(YPOS), VAL(ZPOS)); // values set by the sliders
+	pushMatrix(); // push identity
+	translate(VAL(XPOS), VAL(YPOS), VAL(ZPOS)); // values set by the sliders
 
 	if (VAL(NINJATURTLE))
 		setDiffuseColor(COLOR_GREEN);
@@ -224,7 +282,7 @@ void SampleModel::draw()
 		setDiffuseColor(.940f, .816f, .811f);
 
 	if (animate)
-		glRotated(animHeadAngle, 0.0, 1.0, 0.0);
+		rotate(animHeadAngle, 0.0, 1.0, 0.0);
 	if (VAL(EYEBANDANA))
 		drawEyeBandana();
 
@@ -245,23 +303,23 @@ void SampleModel::draw()
 	if (!VAL(NINJATURTLE))
 		setDiffuseColor(.940f, .816f, .811f);
 	drawRightHandJoint();
-	glPushMatrix();
+	pushMatrix();
 	if (animate)
-		glRotated(animUpperArmAngle, 1.0, 0, 0);
+		rotate(animUpperArmAngle, 1.0, 0, 0);
 	drawUpperRightHand();
 	drawLowerRightHand();
 	drawRightHand();
-	glPopMatrix();
+	popMatrix();
 
 
 	drawLeftHandJoint();
-	glPushMatrix();
+	pushMatrix();
 	if (animate)
-		glRotated(-animUpperArmAngle, 1.0, 0, 0);
+		rotate(-animUpperArmAngle, 1.0, 0, 0);
 	drawUpperLeftHand();
 	drawLowerLeftHand();
 	drawLeftHand();
-	glPopMatrix();
+	popMatrix();
 
 	drawRightLegJoint();
 	drawLeftLegJoint();
@@ -279,52 +337,41 @@ void SampleModel::draw()
 	else
 		drawTail(); // handle the positioning and hierachical modeling of the tail
 
-	if (VAL(METABALLSKIN)) {
-		MetaBalls mb;
-		mb.setUpGrid();
-		mb.setUpMetaballs();
-		mb.evalScalarField();
-		mb.draw();
+	// the metaballs are drawn directly with OpenGL, and place nothing
+	if (VAL(METABALLSKIN) && !ModelerDrawState::Instance()->m_posing) {
+		if (metaBalls == NULL) {
+			metaBalls = new MetaBalls();
+			metaBalls->setUpGrid();
+			metaBalls->setUpMetaballs();
+			metaBalls->evalScalarField();
+		}
+		metaBalls->draw();
 	}
 
-	glPopMatrix();
+	popMatrix();
+}
 
-	/***********************************************
-	**
-	**	NOW WE WILL ACTUALLY BEGIN DRAWING THE MODEL
-	**
-	**	Draw your model up to the node where you would like
-	**	particles to spawn from.
-	**
-	**  FYI:  As you call glRotate, glScale, or glTranslate,
-	**  OpenGL is multiplying new transformations into the
-	**  MODELVIEW matrix.
-	**
-	********************************************/
-	// If particle system exists, draw it
+void SampleModel::poseEmitters(const float* pfControls)
+{
+	ModelerApplication::Instance()->SetControlValues(pfControls);
+	beginPose();
+	cameraMatrix = getModelViewMatrix();
+	// the posed model is what the particles collide with, as in draw()
 	ParticleSystem *ps = ModelerApplication::Instance()->GetParticleSystem();
-	if (ps != NULL) {
-		ps->computeForcesAndUpdateParticles(t);
-		ps->drawParticles(t, m_camera);
-	}
-	
-	/*************************************************
-	**
-	**	NOW DO ANY CLOSING CODE
-	**
-	**	Don't forget that animator requires you to call
-	**  endDraw().
-	**	
-	**************************************************/
-	endDraw();
+	if (ps != NULL)
+		recordColliders(&ps->getModelCollider());
+	drawModel();
+	recordColliders(NULL);
+	endPose();
+	ModelerApplication::Instance()->SetControlValues(NULL);
 }
 
 void SampleModel::drawEyeBandana() {
 	setDiffuseColor(COLOR_RED);
-	glPushMatrix();
-	glTranslated(0, UPPER_TORSO_RADIUS + HEAD_RADIUS + 0.3, 0);
+	pushMatrix();
+	translate(0, UPPER_TORSO_RADIUS + HEAD_RADIUS + 0.3, 0);
 	drawTorus(0.3, 0.5);
-	glPopMatrix();
+	popMatrix();
 	if (VAL(NINJATURTLE))
 		setDiffuseColor(COLOR_GREEN);
 	else
@@ -332,107 +379,107 @@ void SampleModel::drawEyeBandana() {
 }
 
 void SampleModel::drawHead() {
-	glPushMatrix();
-	glTranslated(0, UPPER_TORSO_RADIUS + HEAD_RADIUS, 0);
+	pushMatrix();
+	translate(0, UPPER_TORSO_RADIUS + HEAD_RADIUS, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(HEAD_RADIUS);
 	else drawSphere(HEAD_RADIUS);
-	glPopMatrix();
+	popMatrix();
 }
 
 void SampleModel::drawFace() {
-	glPushMatrix();
+	pushMatrix();
 	
 	// eyes
-	glTranslated(0.2, UPPER_TORSO_RADIUS + HEAD_RADIUS + 0.3, 0.7);
+	translate(0.2, UPPER_TORSO_RADIUS + HEAD_RADIUS + 0.3, 0.7);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.1);
 	else drawSphere(0.1);
-	glTranslated(-0.4, 0, 0);
+	translate(-0.4, 0, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.1);
 	else drawSphere(0.1);
 
 	// nose
 	setDiffuseColor(.940f, .816f, .811f);
-	glTranslated( 0.2, -0.3, 0.1);
+	translate( 0.2, -0.3, 0.1);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.1);
 	else drawSphere(0.1);
 
-	glPopMatrix();
+	popMatrix();
 
 	// mouth
-	glPushMatrix();
+	pushMatrix();
 
 	setDiffuseColor(1.0f, 0.0f, 0.0f);
-	glTranslated(-0.25, UPPER_TORSO_RADIUS + 0.3, 0.7);
-	glRotated(20, 1.0, 0.0, 0.0);
-	glTranslated(0.0, 0.0, -0.05);
+	translate(-0.25, UPPER_TORSO_RADIUS + 0.3, 0.7);
+	rotate(20, 1.0, 0.0, 0.0);
+	translate(0.0, 0.0, -0.05);
 	if (VAL(TEXTURESKIN))
 		drawTextureBox(0.5,0.3,0);
 	else drawBox(0.5,0.3,0);
 
-	glPopMatrix();
+	popMatrix();
 }
 
 void SampleModel::drawNeck() {
-	glPushMatrix();
-	glTranslated(0, UPPER_TORSO_RADIUS + 0.1, 0);
-	glScaled(0.4, 0.6, 0.4);
-	glTranslated(-0.5, -0.5, -0.5);
+	pushMatrix();
+	translate(0, UPPER_TORSO_RADIUS + 0.1, 0);
+	scale(0.4, 0.6, 0.4);
+	translate(-0.5, -0.5, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureBox(1, 1, 1);
 	else drawBox(1, 1, 1);
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawUpperTorso() {
-	glPushMatrix();
+	pushMatrix();
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(UPPER_TORSO_RADIUS);
 	else drawSphere(UPPER_TORSO_RADIUS); // center at (0, 0, 0)
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawLowerTorso() {
-	glPushMatrix();
-	glTranslated(0, -UPPER_TORSO_RADIUS, 0); // move down
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.4);
+	pushMatrix();
+	translate(0, -UPPER_TORSO_RADIUS, 0); // move down
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.4);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(LOWER_TORSO_HEIGHT, 0.9, 0.8);
 	else drawCylinder(LOWER_TORSO_HEIGHT, 0.9, 0.8);
 
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawRightHandJoint() {
-	glPushMatrix();
-	glTranslated(UPPER_TORSO_RADIUS, 0.6, 0);
-	glRotated(20, 0.0, 0.0, 1.0);
-	glRotated(90, 0.0, 1.0, 0.0);
-	glTranslated(0, 0, -0.2);
+	pushMatrix();
+	translate(UPPER_TORSO_RADIUS, 0.6, 0);
+	rotate(20, 0.0, 0.0, 1.0);
+	rotate(90, 0.0, 1.0, 0.0);
+	translate(0, 0, -0.2);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.4, 0.2, 0.2);
 	else drawCylinder(0.4, 0.2, 0.2);
-	glPopMatrix();
+	popMatrix();
 
-	glPushMatrix();
-	glTranslated(UPPER_TORSO_RADIUS + 0.2, 0.8, 0);
+	pushMatrix();
+	translate(UPPER_TORSO_RADIUS + 0.2, 0.8, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.4);
 	else drawSphere(0.4);
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawUpperRightHand() {
-	glPushMatrix();
-	glTranslated(UPPER_TORSO_RADIUS + 0.2, 0.8, 0);
-	glRotated(VAL(RIGHTARMZ), 0, 0, 1.0);
-	glRotated(VAL(RIGHTARMY), 0, -1.0, 0);
-	glTranslated(0.3, -0.6, 0);
-	glRotated(20, 0.0, 0.0, 1.0);
-	glRotated(90, 1.0, 0.0, 0.0);
+	pushMatrix();
+	translate(UPPER_TORSO_RADIUS + 0.2, 0.8, 0);
+	rotate(VAL(RIGHTARMZ), 0, 0, 1.0);
+	rotate(VAL(RIGHTARMY), 0, -1.0, 0);
+	translate(0.3, -0.6, 0);
+	rotate(20, 0.0, 0.0, 1.0);
+	rotate(90, 1.0, 0.0, 0.0);
 	
-	glTranslated(0, 0, -0.5);
-	glRotated(VAL(RIGHTARMX), -1.0, 0, 0);
+	translate(0, 0, -0.5);
+	rotate(VAL(RIGHTARMX), -1.0, 0, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(1, 0.25, 0.25);
 	else drawCylinder(1, 0.25, 0.25);
@@ -440,21 +487,21 @@ void SampleModel::drawUpperRightHand() {
 void SampleModel::drawLowerRightHand() {
 
 	// Undo transformations
-	glTranslated(0, 0, 0.5);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	glRotated(-20, 0.0, 0.0, 1.0);
-	glTranslated(-0.3, 0.6, 0);
-	glTranslated(-UPPER_TORSO_RADIUS - 0.2, -0.8, 0);
+	translate(0, 0, 0.5);
+	rotate(-90, 1.0, 0.0, 0.0);
+	rotate(-20, 0.0, 0.0, 1.0);
+	translate(-0.3, 0.6, 0);
+	translate(-UPPER_TORSO_RADIUS - 0.2, -0.8, 0);
 
-	glTranslated(UPPER_TORSO_RADIUS + 0.7, -0.3, 0);
+	translate(UPPER_TORSO_RADIUS + 0.7, -0.3, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.2);
 	else drawSphere(0.2);
-	glRotated(VAL(RIGHTELBOWX), -1.0, 0, 0);
-	glRotated(VAL(RIGHTELBOWY), 0, 1.0, 0);
-	glTranslated(0, -0.7, 0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.6);
+	rotate(VAL(RIGHTELBOWX), -1.0, 0, 0);
+	rotate(VAL(RIGHTELBOWY), 0, 1.0, 0);
+	translate(0, -0.7, 0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.6);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(1.2, 0.25, 0.15);
 	else drawCylinder(1.2, 0.25, 0.15);
@@ -463,54 +510,54 @@ void SampleModel::drawLowerRightHand() {
 void SampleModel::drawRightHand() {
 	
 	// Undo transformations
-	glTranslated(0, 0, 0.6);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0.7, 0);
-	glTranslated(-UPPER_TORSO_RADIUS - 0.7, 0.3, 0);
-
-	glTranslated(UPPER_TORSO_RADIUS + 0.7, -1.7, 0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.1);
-	glRotated(VAL(RIGHTHANDX), -1.0, 0, 0);
+	translate(0, 0, 0.6);
+	rotate(-90, 1.0, 0.0, 0.0);
+	translate(0, 0.7, 0);
+	translate(-UPPER_TORSO_RADIUS - 0.7, 0.3, 0);
+
+	translate(UPPER_TORSO_RADIUS + 0.7, -1.7, 0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.1);
+	rotate(VAL(RIGHTHANDX), -1.0, 0, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.4, 0.10, 0.05);
 	else drawCylinder(0.4, 0.10, 0.05);
 
-	glPushMatrix();
-	glTranslated(0.0, 0.0, 0.8);
-	spawnParticles(cameraMatrix);
-	glPopMatrix();
+	pushMatrix();
+	translate(0.0, 0.0, 0.8);
+	spawnParticles(cameraMatrix, "default");
+	popMatrix();
 
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawLeftHandJoint() {
-	glPushMatrix();
-	glTranslated(-UPPER_TORSO_RADIUS, 0.6, 0);
-	glRotated(20, 0.0, 0.0, -1.0);
-	glRotated(90, 0.0, 1.0, 0.0);
-	glTranslated(0, 0, -0.2);
+	pushMatrix();
+	translate(-UPPER_TORSO_RADIUS, 0.6, 0);
+	rotate(20, 0.0, 0.0, -1.0);
+	rotate(90, 0.0, 1.0, 0.0);
+	translate(0, 0, -0.2);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.4, 0.2, 0.2);
 	else drawCylinder(0.4, 0.2, 0.2);
-	glPopMatrix();
+	popMatrix();
 
-	glPushMatrix();
-	glTranslated(-UPPER_TORSO_RADIUS - 0.2, 0.8, 0);
+	pushMatrix();
+	translate(-UPPER_TORSO_RADIUS - 0.2, 0.8, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.4);
 	else drawSphere(0.4);
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawUpperLeftHand() {
-	glPushMatrix();
-	glTranslated(-UPPER_TORSO_RADIUS - 0.2, 0.8, 0);
-	glRotated(VAL(LEFTARMZ), 0, 0, 1.0);
-	glRotated(VAL(LEFTARMY), 0, 1.0, 0);
-	glTranslated(-0.3, -0.6, 0);
-	glRotated(20, 0.0, 0.0, -1.0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
-	glRotated(VAL(LEFTARMX), 1.0, 0, 0);
+	pushMatrix();
+	translate(-UPPER_TORSO_RADIUS - 0.2, 0.8, 0);
+	rotate(VAL(LEFTARMZ), 0, 0, 1.0);
+	rotate(VAL(LEFTARMY), 0, 1.0, 0);
+	translate(-0.3, -0.6, 0);
+	rotate(20, 0.0, 0.0, -1.0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
+	rotate(VAL(LEFTARMX), 1.0, 0, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(1, 0.25, 0.25);
 	else drawCylinder(1, 0.25, 0.25);
@@ -518,21 +565,21 @@ void SampleModel::drawUpperLeftHand() {
 void SampleModel::drawLowerLeftHand() {
 
 	// Undo Transformations
-	glTranslated(0, 0, 0.5);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	glRotated(-20, 0.0, 0.0, -1.0);
-	glTranslated(0.3, 0.6, 0);
-	glTranslated(UPPER_TORSO_RADIUS + 0.2, -0.8, 0);
+	translate(0, 0, 0.5);
+	rotate(-90, 1.0, 0.0, 0.0);
+	rotate(-20, 0.0, 0.0, -1.0);
+	translate(0.3, 0.6, 0);
+	translate(UPPER_TORSO_RADIUS + 0.2, -0.8, 0);
 
-	glTranslated(-UPPER_TORSO_RADIUS - 0.7, -0.3, 0);
+	translate(-UPPER_TORSO_RADIUS - 0.7, -0.3, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.2);
 	else drawSphere(0.2);
-	glRotated(VAL(LEFTELBOWX), -1.0, 0, 0);
-	glRotated(VAL(LEFTELBOWY), 0, 1.0, 0);
-	glTranslated(0, -0.7, 0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.6);
+	rotate(VAL(LEFTELBOWX), -1.0, 0, 0);
+	rotate(VAL(LEFTELBOWY), 0, 1.0, 0);
+	translate(0, -0.7, 0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.6);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(1.2, 0.25, 0.15);
 	else drawCylinder(1.2, 0.25, 0.15);
@@ -540,78 +587,84 @@ void SampleModel::drawLowerLeftHand() {
 void SampleModel::drawLeftHand() {
 	
 	// Undo Transformations
-	glTranslated(0, 0, 0.6);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0.7, 0);
-	glTranslated(UPPER_TORSO_RADIUS + 0.7, 0.3, 0);
-
-	glTranslated(-UPPER_TORSO_RADIUS - 0.7, -1.7, 0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.1);
-	glRotated(VAL(LEFTHANDX), -1.0, 0, 0);
+	translate(0, 0, 0.6);
+	rotate(-90, 1.0, 0.0, 0.0);
+	translate(0, 0.7, 0);
+	translate(UPPER_TORSO_RADIUS + 0.7, 0.3, 0);
+
+	translate(-UPPER_TORSO_RADIUS - 0.7, -1.7, 0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.1);
+	rotate(VAL(LEFTHANDX), -1.0, 0, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.4, 0.10, 0.05);
 	else drawCylinder(0.4, 0.10, 0.05);
-	glPopMatrix();
+
+	pushMatrix();
+	translate(0.0, 0.0, 0.8);
+	spawnParticles(cameraMatrix, "left hand");
+	popMatrix();
+
+	popMatrix();
 }
 void SampleModel::drawRightLegJoint() {
-	glPushMatrix();
-	glTranslated(0.5, -UPPER_TORSO_RADIUS - 0.4, 0);
-	glRotated(48, 0.0, 0.0, 1.0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.3);
+	pushMatrix();
+	translate(0.5, -UPPER_TORSO_RADIUS - 0.4, 0);
+	rotate(48, 0.0, 0.0, 1.0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.3);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.7, 0.2, 0.2);
 	else drawCylinder(0.7, 0.2, 0.2);
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawUpperRightLeg() {
-	glPushMatrix();
-	glTranslated(0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT, 0);
-	glRotated(VAL(RIGHTKNEE), -1.0, 0.0, 0.0);
-	glRotated(VAL(RIGHTLEGX), -1.0, 0, 0);
-	glRotated(VAL(RIGHTLEGZ), 0.0, 0, 1.0);
+	pushMatrix();
+	translate(0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT, 0);
+	rotate(VAL(RIGHTKNEE), -1.0, 0.0, 0.0);
+	rotate(VAL(RIGHTLEGX), -1.0, 0, 0);
+	rotate(VAL(RIGHTLEGZ), 0.0, 0, 1.0);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.3);
 	else drawSphere(0.3);
 
 	if (animate) {
-		glRotated(-animUpperLegAngle, 1.0, 0, 0);
+		rotate(-animUpperLegAngle, 1.0, 0, 0);
 		SETVAL(RIGHTKNEE, 0);
 	}
 
-	glTranslated(0, -0.7, 0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.6);
+	translate(0, -0.7, 0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.6);
 	if (VAL(TEXTURESKIN)) {
 		drawTextureCylinder(1.2, 0.35, 0.35);
-		glTranslated(0, 0, 1.25);
+		translate(0, 0, 1.25);
 		drawTextureSphere(0.3);
 	}
 	else {
 		drawCylinder(1.2, 0.35, 0.35);
-		glTranslated(0, 0, 1.25);
+		translate(0, 0, 1.25);
 		drawSphere(0.3);
 	}
 }
 void SampleModel::drawLowerRightLeg(){
 	if (animate) {
-		glRotated(animLowerLegAngle, 1.0, 0, 0);
+		rotate(animLowerLegAngle, 1.0, 0, 0);
 		SETVAL(RIGHTKNEE, 0);
 	}
 	
 	//Undo transformations
-	glTranslated(0, 0, -1.25);
-	glTranslated(0, 0, 0.6);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0.7, 0);
-	glRotated(-VAL(RIGHTKNEE), -1.0, 0.0, 0.0);
-	glTranslated(-0.9, UPPER_TORSO_RADIUS + LOWER_TORSO_HEIGHT, 0);
-
-	glTranslated(0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT - 0.7 - 0.7 - 0.7, 0);
-	glRotated(VAL(RIGHTKNEE) * 2, 1.0, 0.0, 0.0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.7);
+	translate(0, 0, -1.25);
+	translate(0, 0, 0.6);
+	rotate(-90, 1.0, 0.0, 0.0);
+	translate(0, 0.7, 0);
+	rotate(-VAL(RIGHTKNEE), -1.0, 0.0, 0.0);
+	translate(-0.9, UPPER_TORSO_RADIUS + LOWER_TORSO_HEIGHT, 0);
+
+	translate(0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT - 0.7 - 0.7 - 0.7, 0);
+	rotate(VAL(RIGHTKNEE) * 2, 1.0, 0.0, 0.0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.7);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(1.4, 0.35, 0.25);
 	else drawCylinder(1.4, 0.35, 0.25);
@@ -619,188 +672,188 @@ void SampleModel::drawLowerRightLeg(){
 void SampleModel::drawRightFoot() {
 	
 	if (animate) {
-		glRotated(animLowerLegAngle, 1.0, 0, 0);
+		rotate(animLowerLegAngle, 1.0, 0, 0);
 		SETVAL(RIGHTKNEE, 0);
 	}
 
 	// Undo transformations
-	glTranslated(0, 0, 0.7);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	glRotated(-VAL(RIGHTKNEE) * 2, 1.0, 0.0, 0.0);
-	glTranslated(-0.9, UPPER_TORSO_RADIUS + LOWER_TORSO_HEIGHT + 0.7 + 0.7 + 0.7, 0);
-
-	glTranslated(0.9 + 0.2, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT - 0.7 - 0.7 - 1.3, 0.4);
-	glTranslated(0, 0, -VAL(RIGHTKNEE) / 50);
-	glRotated(30, 0.0, 1.0, 0.0);
-	glTranslated(0, 0, -0.3);
+	translate(0, 0, 0.7);
+	rotate(-90, 1.0, 0.0, 0.0);
+	rotate(-VAL(RIGHTKNEE) * 2, 1.0, 0.0, 0.0);
+	translate(-0.9, UPPER_TORSO_RADIUS + LOWER_TORSO_HEIGHT + 0.7 + 0.7 + 0.7, 0);
+
+	translate(0.9 + 0.2, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT - 0.7 - 0.7 - 1.3, 0.4);
+	translate(0, 0, -VAL(RIGHTKNEE) / 50);
+	rotate(30, 0.0, 1.0, 0.0);
+	translate(0, 0, -0.3);
 	
 
 	if (animate)
-		glRotated(animRightFootAngle, 1.0, 0, 0);
+		rotate(animRightFootAngle, 1.0, 0, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.25, 0.1);
 	else drawCylinder(0.6, 0.25, 0.1);
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawLeftLegJoint() {
-	glPushMatrix();
-	glTranslated(-0.5, -UPPER_TORSO_RADIUS - 0.4, 0);
-	glRotated(48, 0.0, 0.0, -1.0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.3);
+	pushMatrix();
+	translate(-0.5, -UPPER_TORSO_RADIUS - 0.4, 0);
+	rotate(48, 0.0, 0.0, -1.0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.3);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.7, 0.2, 0.2);
 	else drawCylinder(0.7, 0.2, 0.2);
-	glPopMatrix();
+	popMatrix();
 
-	glPushMatrix();
-	glTranslated(-0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT, 0);
+	pushMatrix();
+	translate(-0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureSphere(0.3);
 	else drawSphere(0.3);
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawUpperLeftLeg() {
 
-	glPushMatrix();
-	glTranslated(-0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT, 0);
-	glRotated(VAL(LEFTKNEE), -1.0, 0.0, 0.0);
-	glRotated(VAL(LEFTLEGX), -1.0, 0, 0);
-	glRotated(VAL(LEFTLEGZ), 0.0, 0, 1.0);
+	pushMatrix();
+	translate(-0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT, 0);
+	rotate(VAL(LEFTKNEE), -1.0, 0.0, 0.0);
+	rotate(VAL(LEFTLEGX), -1.0, 0, 0);
+	rotate(VAL(LEFTLEGZ), 0.0, 0, 1.0);
 	if (animate){
-		glRotated(animUpperLegAngle, 1.0, 0, 0);
+		rotate(animUpperLegAngle, 1.0, 0, 0);
 		SETVAL(LEFTKNEE, 0);
 		SETVAL(LEFTLEGX, 0);
 		SETVAL(LEFTLEGZ, 0);
 	}
 
-	glTranslated(0, -0.7, 0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.6);
+	translate(0, -0.7, 0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.6);
 	if (VAL(TEXTURESKIN)) {
 		drawTextureCylinder(1.2, 0.35, 0.35);
-		glTranslated(0, 0, 1.25);
+		translate(0, 0, 1.25);
 		drawTextureSphere(0.3);
 	}
 	else {
 		drawCylinder(1.2, 0.35, 0.35);
-		glTranslated(0, 0, 1.25);
+		translate(0, 0, 1.25);
 		drawSphere(0.3);
 	}
 
 }
 void SampleModel::drawLowerLeftLeg() {
 	if (animate) {
-		glRotated(-animLowerLegAngle, 1.0, 0, 0);
+		rotate(-animLowerLegAngle, 1.0, 0, 0);
 		SETVAL(LEFTKNEE, 0);
 	}
 
 	//Undo transformations
-	glTranslated(0, 0, -1.25);
-	glTranslated(0, 0, 0.6);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0.7, 0);
-	glRotated(-VAL(LEFTKNEE), -1.0, 0.0, 0.0);
-	glTranslated(0.9, UPPER_TORSO_RADIUS + LOWER_TORSO_HEIGHT, 0);
-
-
-	glTranslated(-0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT - 0.7 - 0.7 - 0.7, 0);
-	glRotated(2 * VAL(LEFTKNEE), 1.0, 0.0, 0.0);
-	glRotated(90, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.7);
+	translate(0, 0, -1.25);
+	translate(0, 0, 0.6);
+	rotate(-90, 1.0, 0.0, 0.0);
+	translate(0, 0.7, 0);
+	rotate(-VAL(LEFTKNEE), -1.0, 0.0, 0.0);
+	translate(0.9, UPPER_TORSO_RADIUS + LOWER_TORSO_HEIGHT, 0);
+
+
+	translate(-0.9, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT - 0.7 - 0.7 - 0.7, 0);
+	rotate(2 * VAL(LEFTKNEE), 1.0, 0.0, 0.0);
+	rotate(90, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.7);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(1.4, 0.35, 0.25);
 	else drawCylinder(1.4, 0.35, 0.25);
 }
 void SampleModel::drawLeftFoot() {
 	if (animate) {
-		glRotated(-animLowerLegAngle, 1.0, 0, 0);
+		rotate(-animLowerLegAngle, 1.0, 0, 0);
 		SETVAL(LEFTKNEE,0);
 	}
 
 	// Undo Transformations
-	glTranslated(0, 0, 0.7);
-	glRotated(-90, 1.0, 0.0, 0.0);
-	glRotated(-VAL(LEFTKNEE) * 2, 1.0, 0.0, 0.0);
-	glTranslated(0.9, UPPER_TORSO_RADIUS + LOWER_TORSO_HEIGHT + 0.7 + 0.7 + 0.7, 0);
+	translate(0, 0, 0.7);
+	rotate(-90, 1.0, 0.0, 0.0);
+	rotate(-VAL(LEFTKNEE) * 2, 1.0, 0.0, 0.0);
+	translate(0.9, UPPER_TORSO_RADIUS + LOWER_TORSO_HEIGHT + 0.7 + 0.7 + 0.7, 0);
 
 
-	glTranslated(-0.9 - 0.2, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT - 0.7 - 0.7 - 1.3, 0.4);
-	glTranslated(0, 0, -VAL(LEFTKNEE) / 50);
-	glRotated(30, 0.0, -1.0, 0.0);
-	glTranslated(0, 0, -0.3);
+	translate(-0.9 - 0.2, -UPPER_TORSO_RADIUS - LOWER_TORSO_HEIGHT - 0.7 - 0.7 - 1.3, 0.4);
+	translate(0, 0, -VAL(LEFTKNEE) / 50);
+	rotate(30, 0.0, -1.0, 0.0);
+	translate(0, 0, -0.3);
 	if (animate)
-		glRotated(animLeftFootAngle, 1.0, 0, 0);
+		rotate(animLeftFootAngle, 1.0, 0, 0);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.25, 0.1);
 	else drawCylinder(0.6, 0.25, 0.1);
 
-	glPopMatrix();
+	popMatrix();
 }
 void SampleModel::drawTail() {
-	glPushMatrix();
-	glTranslated(0, -UPPER_TORSO_RADIUS, -0.8);
-	glTranslated(0, 0, -0.3);
+	pushMatrix();
+	translate(0, -UPPER_TORSO_RADIUS, -0.8);
+	translate(0, 0, -0.3);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
 
-	glRotated(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
-	glRotated(50, -1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
+	rotate(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
+	rotate(50, -1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
 
-	glRotated(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
-	glRotated(40, -1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
+	rotate(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
+	rotate(40, -1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
 
-	glRotated(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
-	glRotated(10, -1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
+	rotate(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
+	rotate(10, -1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
 
-	glRotated(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
-	glRotated(5, -1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
+	rotate(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
+	rotate(5, -1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
 
-	glRotated(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
-	glRotated(5, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
+	rotate(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
+	rotate(5, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
 
-	glRotated(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
-	glRotated(10, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
+	rotate(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
+	rotate(10, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
 
-	glRotated(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
-	glRotated(15, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
+	rotate(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
+	rotate(15, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
 
-	glRotated(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
-	glRotated(20, 1.0, 0.0, 0.0);
-	glTranslated(0, 0, -0.5);
+	rotate(VAL(TAILMOVEMENT), 1.0, 0.0, 0.0);
+	rotate(20, 1.0, 0.0, 0.0);
+	translate(0, 0, -0.5);
 	if (VAL(TEXTURESKIN))
 		drawTextureCylinder(0.6, 0.1, 0.1);
 	else drawCylinder(0.6, 0.1, 0.1);
-	glPopMatrix();
+	popMatrix();
 }
 
 void SampleModel::drawShell() {
@@ -937,8 +990,13 @@ void SampleModel::drawShell() {
 	
 }
 
+// Places both hands' emitters for BatchDriver, by posing the model
+static void sampleEmitter(const float* pfControls)
+{
+	SampleModel::instance->poseEmitters(pfControls);
+}
 
-int main()
+int main(int argc, char **argv)
 {
 	// Initialize the controls
 	// Constructor is ModelerControl(name, minimumvalue, maximumvalue, stepsize, defaultvalue)
@@ -970,12 +1028,34 @@ int main()
 	controls[NINJATURTLE] = ModelerControl("Ninja Turtle", 0, 1, 1, 0);
 	controls[EYEBANDANA] = ModelerControl("Eye Bandana", 0, 1, 1, 0);
 
-	ModelerApplication::Instance()->Init(&createSampleModel, controls, NUMCONTROLS);
-
 	// Hooking up the particle system
 	ParticleSystem *ps = new ParticleSystem();
 	ps->addFieldForce(Force(0.0, -1.0, 0.0));
 	ModelerApplication::Instance()->SetParticleSystem(ps);
 
-	return ModelerApplication::Instance()->Run();
+	// A second, slower emitter on the left hand, whose particles drift
+	// up against gravity
+	Emitter left("left hand");
+	left.rate = 5;
+	left.speed = 0.5f;
+	left.lifetime = 4.0f;
+	left.acceleration = Vec3f(0.0f, 1.5f, 0.0f);
+	left.drag = 0.5f;
+	ps->addEmitter(left);
+
+	// --batch: bake without opening a window (see batchdriver.h). The
+	// model is created, never shown, to place the emitters.
+	if (BatchDriver::requested(argc, argv)) {
+		SampleModel model(0, 0, 1, 1, NULL);
+		SampleModel::instance = &model;
+		BatchDriver batch(controls, NUMCONTROLS, ps, &sampleEmitter);
+		int result = batch.run(argc, argv);
+		SampleModel::instance = NULL;
+		delete ps;
+		return result;
+	}
+
+	ModelerApplication::Instance()->Init(&createSampleModel, controls, NUMCONTROLS);
+
+	return ModelerApplication::Instance()->Run(argc, argv);
 }
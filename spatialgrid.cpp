@@ -0,0 +1,51 @@
+#pragma warning(disable : 4786)
+
+#include "spatialgrid.h"
+#include "threadpool.h"
+#include "integrator.h"
+
+SpatialGrid::SpatialGrid()
+	: count(0), cell(1.0f), inverse(1.0f), mask(0)
+{
+}
+
+void SpatialGrid::build(const float* px, const float* py, const float* pz, int n,
+	float c, ThreadPool* pool)
+{
+	count = n;
+	cell = c;
+	inverse = 1.0f / c;
+	unsigned int buckets = 1024;
+	while (buckets < 2u * n)
+		buckets *= 2;
+	mask = buckets - 1;
+
+	keys.resize(n);
+	order.resize(n);
+	start.assign(buckets + 1, 0);
+
+	// keys are independent per particle; fill them in parallel
+	const int chunk = Integrator::CHUNK;
+	if (pool) {
+		pool->forRange(n, chunk, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				keys[i] = bucket(coord(px[i]), coord(py[i]), coord(pz[i]));
+		});
+	} else {
+		for (int i = 0; i < n; i++)
+			keys[i] = bucket(coord(px[i]), coord(py[i]), coord(pz[i]));
+	}
+
+	// counting sort: bucket sizes, their prefix sums, then each index
+	// placed at its bucket's cursor, which leaves start[b] at the end of
+	// bucket b; shifting back by one restores the starts
+	for (int i = 0; i < n; i++)
+		start[keys[i] + 1]++;
+	for (unsigned int b = 0; b < buckets; b++)
+		start[b + 1] += start[b];
+	for (int i = 0; i < n; i++)
+		order[start[keys[i]]++] = i;
+	for (unsigned int b = buckets; b > 0; b--)
+		start[b] = start[b - 1];
+	start[0] = 0;
+}
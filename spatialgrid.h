@@ -0,0 +1,81 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include <math.h>
+
+class ThreadPool;
+
+// SpatialGrid answers "which particles are near this point" in constant
+// time per query, for anything that makes particles interact.
+//
+// Space is divided into cubic cells, and cells are hashed into a table
+// of buckets (twice as many as particles), so the grid needs no bounds
+// and its memory follows the particle count, not the extent. build()
+// computes each particle's bucket and counting sorts the particle
+// indices by bucket: two linear passes, with indices in ascending order
+// within a bucket, so iteration order and everything computed from it
+// are reproducible.
+//
+// forNeighbors() visits the buckets of the 27 cells around a point, each
+// once. Different cells can share a bucket, so callers still check the
+// distance; with cells at least as large as the interaction radius, no
+// neighbor within it is missed.
+class SpatialGrid {
+public:
+	SpatialGrid();
+
+	// Sorts the n particles at px, py, pz into cells of size cell
+	void build(const float* px, const float* py, const float* pz, int n,
+		float cell, ThreadPool* pool = NULL);
+
+	int size() const { return count; }
+	float cellSize() const { return cell; }
+
+	// Calls f(j) for every particle j in the cells around x, y, z,
+	// and in buckets shared with them
+	template <class F>
+	void forNeighbors(float x, float y, float z, const F& f) const
+	{
+		if (count == 0)
+			return;
+		int cx = coord(x), cy = coord(y), cz = coord(z);
+		unsigned int seen[27];
+		int nSeen = 0;
+		for (int dz = -1; dz <= 1; dz++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					unsigned int b = bucket(cx + dx, cy + dy, cz + dz);
+					int k = 0;
+					while (k < nSeen && seen[k] != b)
+						k++;
+					if (k < nSeen)
+						continue;
+					seen[nSeen++] = b;
+					for (int i = start[b], end = start[b + 1]; i < end; i++)
+						f(order[i]);
+				}
+			}
+		}
+	}
+
+private:
+	int coord(float x) const { return (int)floorf(x * inverse); }
+	unsigned int bucket(int cx, int cy, int cz) const
+	{
+		return ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u
+			^ (unsigned int)cz * 83492791u) & mask;
+	}
+
+	int count;
+	float cell;
+	float inverse;						// 1 / cell
+	unsigned int mask;					// buckets - 1, a power of two less one
+	std::vector<unsigned int> keys;		// bucket of each particle
+	std::vector<int> start;				// first index in order per bucket, and the end
+	std::vector<int> order;				// particle indices by bucket
+};
+
+#endif
@@ -0,0 +1,153 @@
+#pragma warning(disable : 4786)
+
+#include <math.h>
+
+#include "sph.h"
+#include "particlestate.h"
+#include "threadpool.h"
+#include "integrator.h"
+#include "hash.h"
+
+static const float PI = 3.14159265f;
+
+SphFluid::SphFluid()
+	: smoothing(0.2f), restDensity(3000.0f), stiffness(10.0f),
+	viscosity(0.05f), tension(0.02f), count(0)
+{
+}
+
+unsigned long long SphFluid::hash(unsigned long long h) const
+{
+	h = hashBytes("SphFluid", 8, h);
+	h = hashValue(smoothing, h);
+	h = hashValue(restDensity, h);
+	h = hashValue(stiffness, h);
+	h = hashValue(viscosity, h);
+	return hashValue(tension, h);
+}
+
+float SphFluid::maxStep() const
+{
+	return stiffness > 0 ? 0.4f * smoothing / sqrtf(stiffness) : 0.0f;
+}
+
+void SphFluid::prepare(const ParticleState& s, ThreadPool* pool)
+{
+	count = s.size();
+	if (count == 0)
+		return;
+
+	float h = smoothing;
+	float h2 = h * h, h3 = h2 * h, h6 = h3 * h3, h9 = h6 * h3;
+	poly6 = 315.0f / (64.0f * PI * h9);
+	poly6Grad = -945.0f / (32.0f * PI * h9);
+	poly6Lap = -945.0f / (32.0f * PI * h9);
+	spikyGrad = -45.0f / (PI * h6);
+	viscLap = 45.0f / (PI * h6);
+
+	grid.build(s.px, s.py, s.pz, count, h, pool);
+	density.resize(count);
+	pressure.resize(count);
+	for (int c = 0; c < 3; c++)
+		acc[c].resize(count);
+
+	// densities must all be known before any force
+	const int chunk = Integrator::CHUNK;
+	if (pool) {
+		pool->forRange(count, chunk, [&](int begin, int end) { densityRange(s, begin, end); });
+		pool->forRange(count, chunk, [&](int begin, int end) { forceRange(s, begin, end); });
+	} else {
+		densityRange(s, 0, count);
+		forceRange(s, 0, count);
+	}
+}
+
+void SphFluid::densityRange(const ParticleState& s, int begin, int end)
+{
+	float h2 = smoothing * smoothing;
+	for (int i = begin; i < end; i++) {
+		float x = s.px[i], y = s.py[i], z = s.pz[i];
+		float rho = 0;
+		grid.forNeighbors(x, y, z, [&](int j) {
+			float dx = x - s.px[j], dy = y - s.py[j], dz = z - s.pz[j];
+			float r2 = dx * dx + dy * dy + dz * dz;
+			if (r2 < h2) {
+				float w = h2 - r2;
+				rho += s.mass[j] * w * w * w;
+			}
+		});
+		rho *= poly6;
+		density[i] = rho;
+		// no suction: a sparse spray does not pull itself together
+		float p = stiffness * (rho - restDensity);
+		pressure[i] = p > 0 ? p : 0;
+	}
+}
+
+void SphFluid::forceRange(const ParticleState& s, int begin, int end)
+{
+	float h = smoothing, h2 = h * h;
+	// surface tension only acts where the colour field changes fast,
+	// i.e. near the surface
+	float surface = 0.3f / h;
+	for (int i = begin; i < end; i++) {
+		float x = s.px[i], y = s.py[i], z = s.pz[i];
+		float vx = s.vx[i], vy = s.vy[i], vz = s.vz[i];
+		float pi = pressure[i];
+		float fp[3] = { 0, 0, 0 };		// pressure
+		float fv[3] = { 0, 0, 0 };		// viscosity
+		float normal[3] = { 0, 0, 0 };	// colour field gradient
+		// the colour field's laplacian, starting with the particle's own
+		float curvature = s.mass[i] / density[i] * poly6Lap * 3.0f * h2 * h2;
+
+		grid.forNeighbors(x, y, z, [&](int j) {
+			if (j == i)
+				return;
+			float dx = x - s.px[j], dy = y - s.py[j], dz = z - s.pz[j];
+			float r2 = dx * dx + dy * dy + dz * dz;
+			if (r2 >= h2 || r2 == 0)
+				return;
+			float r = sqrtf(r2);
+			float volume = s.mass[j] / density[j];
+
+			// symmetric pressure, spiky kernel gradient
+			float q = h - r;
+			float press = -volume * 0.5f * (pi + pressure[j]) * spikyGrad * q * q / r;
+			fp[0] += press * dx; fp[1] += press * dy; fp[2] += press * dz;
+
+			float visc = volume * viscLap * q;
+			fv[0] += visc * (s.vx[j] - vx);
+			fv[1] += visc * (s.vy[j] - vy);
+			fv[2] += visc * (s.vz[j] - vz);
+
+			float w = h2 - r2;
+			float grad = volume * poly6Grad * w * w;
+			normal[0] += grad * dx; normal[1] += grad * dy; normal[2] += grad * dz;
+			curvature += volume * poly6Lap * w * (3.0f * h2 - 7.0f * r2);
+		});
+
+		float inv = density[i] > 0 ? 1.0f / density[i] : 0.0f;
+		float st[3] = { 0, 0, 0 };
+		float len = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (len > surface) {
+			float k = -tension * curvature / len;
+			for (int c = 0; c < 3; c++)
+				st[c] = k * normal[c];
+		}
+		for (int c = 0; c < 3; c++)
+			acc[c][i] = fp[c] * inv + viscosity * fv[c] + st[c];
+	}
+}
+
+void SphFluid::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	// nothing prepared for this state, e.g. stepped without prepare()
+	if (in.first + in.n > count)
+		return;
+	const float* a[3] = { &acc[0][in.first], &acc[1][in.first], &acc[2][in.first] };
+	for (int i = 0; i < in.n; i++) {
+		ax[i] += a[0][i];
+		ay[i] += a[1][i];
+		az[i] += a[2][i];
+	}
+}
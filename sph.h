@@ -0,0 +1,61 @@
+#ifndef SPH_H
+#define SPH_H
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include "forcefield.h"
+#include "spatialgrid.h"
+
+// SphFluid makes the particles behave as a fluid, by smoothed particle
+// hydrodynamics in the formulation of Mueller et al. 2003: each
+// particle's density is summed over its neighbours within the smoothing
+// radius, pressure follows from how far that is above the rest density,
+// and the pressure gradient, viscosity and surface tension (from the
+// curvature of the smoothed "colour" field) give its acceleration.
+//
+// It is a force kernel, so the fluid is pushed around by the other
+// forces, emitted and baked like any particles. Everything is computed
+// in prepare(): the neighbours come from a SpatialGrid with cells of
+// the smoothing radius, then a density pass and a force pass run over
+// the particle arrays on the thread pool, each particle writing only its
+// own entries. The acceleration is held for the whole step, so every
+// integration stage sees the fluid forces of the step's start.
+//
+// The defaults suit the emitter's particles (mass 3, emitted a few
+// tenths apart): a rest spacing of half the smoothing radius.
+class SphFluid : public ForceKernel {
+public:
+	SphFluid();
+
+	virtual void prepare(const ParticleState& s, ThreadPool* pool);
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	virtual unsigned long long hash(unsigned long long h) const;
+
+	// Longest stable step: pressure waves must not cross more than part
+	// of a smoothing radius per step
+	float maxStep() const;
+
+	float smoothing;					// kernel radius h
+	float restDensity;
+	float stiffness;					// pressure = stiffness * (density - rest)
+	float viscosity;					// kinematic
+	float tension;						// surface tension coefficient
+
+	// per particle results of the last prepare()
+	const std::vector<float>& densities() const { return density; }
+
+private:
+	void densityRange(const ParticleState& s, int begin, int end);
+	void forceRange(const ParticleState& s, int begin, int end);
+
+	SpatialGrid grid;
+	int count;							// particles prepared for
+	std::vector<float> density;
+	std::vector<float> pressure;
+	std::vector<float> acc[3];
+	// kernel constants for the current smoothing radius
+	float poly6, poly6Grad, poly6Lap, spikyGrad, viscLap;
+};
+
+#endif
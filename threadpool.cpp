@@ -0,0 +1,130 @@
+#pragma warning(disable : 4786)
+
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int n)
+	: job(NULL), context(NULL), jobCount(0), pending(0), busy(0), generation(0), quit(false)
+{
+	next.store(0);
+	start(n);
+}
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+}
+
+int ThreadPool::hardwareThreads()
+{
+	int n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+void ThreadPool::threads(int n)
+{
+	if (n <= 0)
+		n = hardwareThreads();
+	if (n == threads())
+		return;
+	stop();
+	start(n);
+}
+
+void ThreadPool::start(int n)
+{
+	if (n <= 0)
+		n = hardwareThreads();
+	quit = false;
+	for (int i = 1; i < n; i++)
+		workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (int i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+}
+
+void ThreadPool::work()
+{
+	unsigned seen = 0;
+	std::unique_lock<std::mutex> l(lock);
+	for (;;) {
+		while (!quit && generation == seen)
+			wake.wait(l);
+		if (quit)
+			return;
+		seen = generation;
+		// job is NULL if the batch has already been completed without us
+		Job_f current = job;
+		void* pContext = context;
+		int jobs = jobCount;
+		if (current == NULL)
+			continue;
+		busy++;
+		l.unlock();
+
+		runJobs(current, pContext, jobs);
+
+		l.lock();
+		busy--;
+		done.notify_all();
+	}
+}
+
+void ThreadPool::runJobs(Job_f current, void* pContext, int jobs)
+{
+	int finished = 0;
+	for (;;) {
+		int j = next++;
+		if (j >= jobs)
+			break;
+		current(pContext, j);
+		finished++;
+	}
+	if (finished > 0) {
+		std::lock_guard<std::mutex> l(lock);
+		pending -= finished;
+		if (pending == 0)
+			done.notify_all();
+	}
+}
+
+void ThreadPool::run(int jobs, Job_f f, void* pContext)
+{
+	if (jobs <= 0)
+		return;
+	if (workers.empty() || jobs == 1) {
+		for (int j = 0; j < jobs; j++)
+			f(pContext, j);
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> l(lock);
+		// a worker that woke up late for the previous batch may still be
+		// looking at its job counter; let it leave before resetting it
+		while (busy > 0)
+			done.wait(l);
+		job = f;
+		context = pContext;
+		jobCount = jobs;
+		pending = jobs;
+		next.store(0);
+		generation++;
+	}
+	wake.notify_all();
+
+	runJobs(f, pContext, jobs);
+
+	std::unique_lock<std::mutex> l(lock);
+	while (pending > 0)
+		done.wait(l);
+	job = NULL;
+}
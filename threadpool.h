@@ -0,0 +1,91 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#pragma warning(disable : 4786)
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ThreadPool keeps a set of worker threads alive between calls, so
+// handing a batch of work to them costs a wake-up rather than thread
+// creation. The thread calling run() works on the batch too, so a pool
+// of n threads has n - 1 workers, and a pool of 1 runs everything inline.
+//
+// Jobs of one batch may run in any order and on any thread; callers get
+// reproducible results by making each job write only its own outputs.
+//
+// Jobs are any callable, passed by reference and never copied, so
+// handing out a batch does not allocate.
+class ThreadPool {
+public:
+	typedef void (*Job_f)(void* pContext, int job);
+
+	// n <= 0 uses one thread per hardware thread
+	ThreadPool(int n = 0);
+	~ThreadPool();
+
+	// Restarts the workers with n threads in all (n <= 0: hardware)
+	void threads(int n);
+	int threads() const { return workers.size() + 1; }
+	static int hardwareThreads();
+
+	// Calls job(0) .. job(jobs - 1) and returns once all have finished
+	void run(int jobs, Job_f job, void* pContext);
+	template <class F>
+	void run(int jobs, const F& job) { run(jobs, &call<F>, (void*)&job); }
+
+	// Splits [0, n) into ranges of chunk elements and calls
+	// range(begin, end) for each. The split only depends on n and chunk,
+	// never on the thread count.
+	template <class F>
+	void forRange(int n, int chunk, const F& range)
+	{
+		if (n <= 0)
+			return;
+		Ranges<F> ranges = { n, chunk, &range };
+		run((n + chunk - 1) / chunk, ranges);
+	}
+
+private:
+	ThreadPool(const ThreadPool&) {}
+	ThreadPool& operator=(const ThreadPool&) { return *this; }
+
+	template <class F>
+	static void call(void* pContext, int job) { (*(const F*)pContext)(job); }
+
+	template <class F>
+	struct Ranges {
+		int n, chunk;
+		const F* range;
+		void operator()(int c) const {
+			int begin = c * chunk;
+			(*range)(begin, (begin + chunk < n) ? begin + chunk : n);
+		}
+	};
+
+	void start(int n);
+	void stop();
+	void work();
+	// takes jobs of the current batch until none are left
+	void runJobs(Job_f job, void* pContext, int jobs);
+
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake;		// a batch was posted, or quit
+	std::condition_variable done;		// a batch or a worker finished
+
+	// current batch; guarded by lock, except next
+	Job_f job;
+	void* context;
+	int jobCount;
+	std::atomic<int> next;				// next job index to hand out
+	int pending;						// jobs not finished yet
+	int busy;							// workers inside runJobs()
+	unsigned generation;				// bumped per batch
+	bool quit;
+};
+
+#endif
@@ -0,0 +1,281 @@
+#pragma warning(disable : 4786)
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "vectorfield.h"
+#include "hash.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define VECTORFIELD_SSE
+#include <emmintrin.h>
+#endif
+
+// the volume file's header, all 4 byte fields
+struct VolumeHeader {
+	char magic[4];						// "VFLD"
+	int version;
+	int size[3];
+	int kind;
+	float lo[3];
+	float hi[3];
+	int reserved[4];
+};
+
+static const int VOLUME_VERSION = 1;
+
+VectorField::VectorField()
+	: strength(1.0f), voxels(NULL), type(ACCELERATION)
+{
+	for (int c = 0; c < 3; c++) {
+		dims[c] = 0;
+		lo[c] = 0;
+		hi[c] = 1;
+	}
+	update();
+}
+
+bool VectorField::open(const char* szFileName)
+{
+	close();
+	if (!file.open(szFileName))
+		return false;
+
+	VolumeHeader header;
+	bool ok = file.size() >= sizeof(header);
+	if (ok) {
+		memcpy(&header, file.data(), sizeof(header));
+		ok = memcmp(header.magic, "VFLD", 4) == 0 && header.version == VOLUME_VERSION &&
+			(header.kind == ACCELERATION || header.kind == VELOCITY);
+	}
+	// the vectors must all be there; counted in doubles, which can't
+	// overflow here
+	double count = 1;
+	for (int c = 0; c < 3 && ok; c++) {
+		ok = header.size[c] >= 2 && header.hi[c] > header.lo[c];
+		count *= header.size[c];
+	}
+	if (!ok || (file.size() - sizeof(header)) / (4 * sizeof(float)) < count) {
+		file.close();
+		return false;
+	}
+
+	name = szFileName;
+	voxels = (const float*)(file.data() + sizeof(header));
+	type = (Kind)header.kind;
+	for (int c = 0; c < 3; c++) {
+		dims[c] = header.size[c];
+		lo[c] = header.lo[c];
+		hi[c] = header.hi[c];
+	}
+	update();
+	return true;
+}
+
+void VectorField::close()
+{
+	file.close();
+	name.clear();
+	voxels = NULL;
+}
+
+void VectorField::setTransform(const Mat4f& localToWorld)
+{
+	transform = localToWorld;
+	update();
+}
+
+void VectorField::update()
+{
+	// grid coordinate c = (local c - lo) * (n - 1) / (hi - lo), where
+	// local = inverse(transform) * world
+	Mat4f inv = transform.inverse();
+	for (int r = 0; r < 3; r++) {
+		float scale = dims[r] > 1 ? (dims[r] - 1) / (hi[r] - lo[r]) : 0.0f;
+		for (int c = 0; c < 3; c++) {
+			toGrid[4 * r + c] = scale * inv[r][c];
+			toWorld[3 * r + c] = transform[r][c];
+		}
+		toGrid[4 * r + 3] = scale * (inv[r][3] - lo[r]);
+	}
+}
+
+bool VectorField::save(const char* szFileName, const int size[3], Kind kind,
+	const float lo[3], const float hi[3], const float* vectors)
+{
+	FILE* pf = fopen(szFileName, "wb");
+	if (pf == NULL)
+		return false;
+
+	VolumeHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "VFLD", 4);
+	header.version = VOLUME_VERSION;
+	header.kind = kind;
+	for (int c = 0; c < 3; c++) {
+		header.size[c] = size[c];
+		header.lo[c] = lo[c];
+		header.hi[c] = hi[c];
+	}
+	fwrite(&header, sizeof(header), 1, pf);
+
+	size_t count = (size_t)size[0] * size[1] * size[2];
+	for (size_t i = 0; i < count; i++) {
+		float v[4] = { vectors[3 * i], vectors[3 * i + 1], vectors[3 * i + 2], 0.0f };
+		fwrite(v, sizeof(v), 1, pf);
+	}
+
+	bool ok = !ferror(pf);
+	return fclose(pf) == 0 && ok;
+}
+
+// The trilinear blend of the cell whose lowest corner is base, at
+// fractions f; dy and dz step a corner in y and z, in floats
+static inline void blend(const float* base, size_t dy, size_t dz, const float f[3], float out[4])
+{
+#ifdef VECTORFIELD_SSE
+	__m128 fx = _mm_set1_ps(f[0]), fy = _mm_set1_ps(f[1]), fz = _mm_set1_ps(f[2]);
+	__m128 v00 = _mm_loadu_ps(base), v10 = _mm_loadu_ps(base + dy);
+	__m128 v01 = _mm_loadu_ps(base + dz), v11 = _mm_loadu_ps(base + dy + dz);
+	v00 = _mm_add_ps(v00, _mm_mul_ps(fx, _mm_sub_ps(_mm_loadu_ps(base + 4), v00)));
+	v10 = _mm_add_ps(v10, _mm_mul_ps(fx, _mm_sub_ps(_mm_loadu_ps(base + dy + 4), v10)));
+	v01 = _mm_add_ps(v01, _mm_mul_ps(fx, _mm_sub_ps(_mm_loadu_ps(base + dz + 4), v01)));
+	v11 = _mm_add_ps(v11, _mm_mul_ps(fx, _mm_sub_ps(_mm_loadu_ps(base + dy + dz + 4), v11)));
+	v00 = _mm_add_ps(v00, _mm_mul_ps(fy, _mm_sub_ps(v10, v00)));
+	v01 = _mm_add_ps(v01, _mm_mul_ps(fy, _mm_sub_ps(v11, v01)));
+	_mm_storeu_ps(out, _mm_add_ps(v00, _mm_mul_ps(fz, _mm_sub_ps(v01, v00))));
+#else
+	for (int c = 0; c < 3; c++) {
+		const float* p = base + c;
+		float v00 = p[0] + f[0] * (p[4] - p[0]);
+		float v10 = p[dy] + f[0] * (p[dy + 4] - p[dy]);
+		float v01 = p[dz] + f[0] * (p[dz + 4] - p[dz]);
+		float v11 = p[dy + dz] + f[0] * (p[dy + dz + 4] - p[dy + dz]);
+		v00 += f[1] * (v10 - v00);
+		v01 += f[1] * (v11 - v01);
+		out[c] = v00 + f[2] * (v01 - v00);
+	}
+#endif
+}
+
+int VectorField::sample4(const float* x, const float* y, const float* z, float out[3][4]) const
+{
+	// grid coordinates, clamped so that the cell's far corner is in the
+	// grid; cell indices and fractions
+	int index[3][4];
+	float frac[3][4];
+	int inside = 15;
+#ifdef VECTORFIELD_SSE
+	__m128 px = _mm_loadu_ps(x), py = _mm_loadu_ps(y), pz = _mm_loadu_ps(z);
+	for (int c = 0; c < 3; c++) {
+		const float* m = &toGrid[4 * c];
+		__m128 g = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), px), _mm_mul_ps(_mm_set1_ps(m[1]), py)),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2]), pz), _mm_set1_ps(m[3])));
+		__m128 last = _mm_set1_ps((float)(dims[c] - 1));
+		// NaN positions fail both tests
+		inside &= _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(g, _mm_setzero_ps()), _mm_cmple_ps(g, last)));
+		g = _mm_min_ps(_mm_max_ps(g, _mm_setzero_ps()), last);
+		__m128i cell = _mm_cvttps_epi32(_mm_min_ps(g, _mm_set1_ps((float)(dims[c] - 2))));
+		_mm_storeu_si128((__m128i*)index[c], cell);
+		_mm_storeu_ps(frac[c], _mm_sub_ps(g, _mm_cvtepi32_ps(cell)));
+	}
+#else
+	for (int c = 0; c < 3; c++) {
+		const float* m = &toGrid[4 * c];
+		float last = (float)(dims[c] - 1);
+		for (int l = 0; l < 4; l++) {
+			float g = m[0] * x[l] + m[1] * y[l] + m[2] * z[l] + m[3];
+			if (!(g >= 0 && g <= last))
+				inside &= ~(1 << l);
+			g = std::min(std::max(g, 0.0f), last);
+			index[c][l] = (int)std::min(g, last - 1);
+			frac[c][l] = g - index[c][l];
+		}
+	}
+#endif
+
+	size_t dy = 4 * (size_t)dims[0];
+	size_t dz = dy * dims[1];
+	for (int l = 0; l < 4; l++) {
+		float local[4] = { 0, 0, 0, 0 };
+		if (inside & (1 << l)) {
+			const float* base = voxels + 4 * (size_t)index[0][l] + dy * index[1][l] + dz * index[2][l];
+			float f[3] = { frac[0][l], frac[1][l], frac[2][l] };
+			blend(base, dy, dz, f, local);
+		}
+		for (int r = 0; r < 3; r++)
+			out[r][l] = toWorld[3 * r] * local[0] + toWorld[3 * r + 1] * local[1] + toWorld[3 * r + 2] * local[2];
+	}
+	return inside;
+}
+
+void VectorField::sample(const float* x, const float* y, const float* z, int n,
+	float* fx, float* fy, float* fz) const
+{
+	float* f[3] = { fx, fy, fz };
+	for (int i = 0; i < n; i += 4) {
+		int m = std::min(4, n - i);
+		if (voxels == NULL) {
+			for (int c = 0; c < 3; c++)
+				std::fill(f[c] + i, f[c] + i + m, 0.0f);
+			continue;
+		}
+		// a short last batch repeats its last particle
+		float p[3][4];
+		for (int l = 0; l < 4; l++) {
+			int j = i + std::min(l, m - 1);
+			p[0][l] = x[j]; p[1][l] = y[j]; p[2][l] = z[j];
+		}
+		float out[3][4];
+		sample4(p[0], p[1], p[2], out);
+		for (int c = 0; c < 3; c++)
+			memcpy(f[c] + i, out[c], m * sizeof(float));
+	}
+}
+
+void VectorField::accumulate(const ForceInput& in, float* ax, float* ay, float* az) const
+{
+	if (voxels == NULL)
+		return;
+	float* a[3] = { ax, ay, az };
+	const float* v[3] = { in.vx, in.vy, in.vz };
+	for (int i = 0; i < in.n; i += 4) {
+		int m = std::min(4, in.n - i);
+		float p[3][4];
+		for (int l = 0; l < 4; l++) {
+			int j = i + std::min(l, m - 1);
+			p[0][l] = in.px[j]; p[1][l] = in.py[j]; p[2][l] = in.pz[j];
+		}
+		float out[3][4];
+		int inside = sample4(p[0], p[1], p[2], out);
+		for (int l = 0; l < m; l++) {
+			if (!(inside & (1 << l)))
+				continue;
+			for (int c = 0; c < 3; c++) {
+				float field = type == VELOCITY ? out[c][l] - v[c][i + l] : out[c][l];
+				a[c][i + l] += strength * field;
+			}
+		}
+	}
+}
+
+unsigned long long VectorField::hash(unsigned long long h) const
+{
+	h = hashBytes("VectorField", 11, h);
+	h = hashValue(strength, h);
+	h = hashBytes(&transform[0][0], 16 * sizeof(float), h);
+	if (voxels == NULL)
+		return h;
+	h = hashBytes(name.c_str(), name.size(), h);
+	h = hashValue((unsigned long long)file.size(), h);
+	h = hashValue(file.modified(), h);
+	h = hashBytes(file.data(), sizeof(VolumeHeader), h);
+	// up to 4096 vectors spread over the grid
+	size_t count = (size_t)dims[0] * dims[1] * dims[2];
+	size_t stride = count / 4096 + 1;
+	for (size_t i = 0; i < count; i += stride)
+		h = hashBytes(voxels + 4 * i, 3 * sizeof(float), h);
+	return h;
+}
@@ -0,0 +1,89 @@
+#ifndef VECTORFIELD_H
+#define VECTORFIELD_H
+
+#pragma warning(disable : 4786)
+
+#include <string>
+#include "forcefield.h"
+#include "mappedfile.h"
+#include "mat.h"
+
+// VectorField drives particles with a grid of vectors made by another
+// tool, such as a wind or flow simulation: either accelerations applied
+// as they are, or flow velocities the particles are dragged towards.
+//
+// The grid is a volume file, mapped rather than read (see MappedFile),
+// so a field of hundreds of MB opens at once and only the pages the
+// particles reach are ever loaded. The file is a 64 byte header then the
+// vectors as they are sampled, nothing to parse:
+//
+//   "VFLD", version 1, nx ny nz (>= 2 each), kind (see Kind),
+//   lo[3], hi[3]: the box the grid spans, in the field's own space,
+//   16 reserved bytes,
+//   nx * ny * nz vectors of x, y, z and a pad, x index fastest.
+//
+// All as 32 bit little endian ints and floats. Samples are at the grid
+// points, lo to hi inclusive; between them the field is trilinear and
+// outside the box it is 0. setTransform() places the box in the world.
+//
+// Sampling works on 4 particles at a time: their grid coordinates and
+// weights are computed together in SSE registers, and each of the 8
+// corner vectors, padded to 16 bytes, is one load.
+class VectorField : public ForceKernel {
+public:
+	enum Kind {
+		ACCELERATION = 0,				// a += strength * field
+		VELOCITY						// a += strength * (field - v)
+	};
+
+	VectorField();
+
+	// Maps szFileName; false, leaving the field empty, if it can't be
+	// read or is not a volume file
+	bool open(const char* szFileName);
+	void close();
+	bool isOpen() const { return voxels != NULL; }
+	Kind kind() const { return type; }
+
+	// Where the field's space is in the world; identity by default
+	void setTransform(const Mat4f& localToWorld);
+
+	// Writes a volume file of nx * ny * nz vectors (3 floats each, x
+	// index fastest) spanning lo .. hi. False on I/O error.
+	static bool save(const char* szFileName, const int size[3], Kind kind,
+		const float lo[3], const float hi[3], const float* vectors);
+
+	// The field at n world positions, in world space
+	void sample(const float* x, const float* y, const float* z, int n,
+		float* fx, float* fy, float* fz) const;
+
+	virtual void accumulate(const ForceInput& in, float* ax, float* ay, float* az) const;
+	// the file's name, size, write time and header, a sparse sample of
+	// its vectors, the transform and strength; not every byte, which
+	// would read it all
+	virtual unsigned long long hash(unsigned long long h) const;
+
+	float strength;
+
+private:
+	VectorField(const VectorField&) {}
+	VectorField& operator=(const VectorField&) { return *this; }
+
+	// recomputes toGrid from the box and transform
+	void update();
+	// the field at 4 world positions into out (x, y, z rows); returns
+	// a bit per position that is inside the box
+	int sample4(const float* x, const float* y, const float* z, float out[3][4]) const;
+
+	MappedFile file;
+	std::string name;
+	const float* voxels;				// 4 floats each
+	int dims[3];
+	Kind type;
+	float lo[3], hi[3];
+	Mat4f transform;
+	float toGrid[12];					// world to grid coordinates, 3x4 row major
+	float toWorld[9];					// field vectors to world, 3x3 row major
+};
+
+#endif